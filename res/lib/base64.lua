@@ -1,6 +1,7 @@
 --[[--
 	
-	Base64 encoding/decoding for streams.
+	Base64 encoding/decoding for strings and streams.
+	Uses the native encoder from `Buffer` when it is available.
 	
 	@module base64
 	@author RedPolygon
@@ -9,6 +10,7 @@
 ]]--
 
 local stream = require "stream"
+local Buffer = require "prequire" "Buffer" -- Native encoding is optional
 
 local base64 = {}
 
@@ -76,6 +78,46 @@ end
 
 
 
+-- STRINGS
+
+-- The characters at index 62 and 63, and the padding, for Buffer
+local function nativeOptions()
+	return base64.c62..base64.c63, base64.padding or false
+end
+
+--- Encode a string (or `Buffer`) to base64.
+-- @tparam string|Buffer data
+-- @treturn string
+function base64.encode(data)
+	if not Buffer then
+		return stream(data):base64encode(true):string()
+	end
+	
+	local encoded = Buffer.toBase64(data, nativeOptions())
+	if base64.maxLength <= 0 or #encoded <= base64.maxLength then return encoded end
+	local lines = {}
+	for i = 1, #encoded, base64.maxLength do
+		table.insert(lines, encoded:sub(i, i+base64.maxLength-1))
+	end
+	return table.concat(lines, base64.newline)
+end
+
+--- Decode a base64 string.
+-- @tparam string str
+-- @treturn string
+function base64.decode(str)
+	if not Buffer then
+		return stream(str):base64decode(true):string()
+	end
+	
+	local chars, padding = nativeOptions()
+	local data, err = Buffer.fromBase64(str, chars, padding, base64.strictNonencoding, base64.strictPadding)
+	if not data then error(err, 2) end
+	return tostring(data)
+end
+
+
+
 -- ENCODING STREAM
 
 stream.base64encode = {}
@@ -100,17 +142,24 @@ function stream.base64encode.new(source, isString)
 	self.col = 0
 	
 	self.get = coroutine.wrap(function()
+		if Buffer then
+			-- Convert natively, in groups of 3072 (a multiple of 3)
+			self.source:map(isString and tostring or function(x) return string.char(tonumber(x)) end)
+				:groupBySize(3072):map(stream.string)
+				:forAll(function(chunk)
+					for v in Buffer.toBase64(chunk, nativeOptions()):gmatch(".") do
+						self:put(v)
+					end
+				end)
+			return
+		end
+		
 		self.source:map(isString and string.byte or tonumber)
 			:groupBySize(3):map(stream.table) -- Divide into groups of 3
 			:forAll(function(buf)
 				-- Convert
 				for _, v in ipairs(self:chunk(buf)) do
-					self.col = self.col+1
-					if base64.maxLength > 0 and self.col > base64.maxLength then
-						coroutine.yield(base64.newline)
-						self.col = 1
-					end
-					coroutine.yield(v)
+					self:put(v)
 				end
 			end)
 	end)
@@ -118,6 +167,16 @@ function stream.base64encode.new(source, isString)
 	return setmetatable(self, stream.base64encode)
 end
 
+-- Yield an encoded character, and a newline before it when the line is full
+function stream.base64encode:put(x)
+	self.col = self.col+1
+	if base64.maxLength > 0 and self.col > base64.maxLength then
+		coroutine.yield(base64.newline)
+		self.col = 1
+	end
+	coroutine.yield(x)
+end
+
 function stream.base64encode:enc(x)
 	if x == 62 then
 		return base64.c62
@@ -170,18 +229,27 @@ function stream.base64decode.new(source, toString)
 	self.allowedChars = table.concat(stream.base64encode.charmap)..base64.c62..base64.c63
 	
 	self.get = coroutine.wrap(function()
-		self.source:map(tostring):filter(stream.op.neq "\n"):filter(stream.op.neq "\r")
+		local chars = self.source:map(tostring):filter(stream.op.neq "\n"):filter(stream.op.neq "\r")
 			:filter(function(x)
 				if not base64.strictNonencoding then
 					return string.find(self.allowedChars, x, 1, true)
 				else return true end
 			end)
-			:groupBySize(4):map(stream.table)
-			:forAll(function(buf)
-				if #buf ~= 4 and base64.strict then
-					error("Invalid base64 string: length is not a multiple of 4 (check padding options)")
+		
+		if Buffer then
+			-- Convert natively, in groups of 4096 (a multiple of 4)
+			chars:groupBySize(4096):map(stream.string):forAll(function(chunk)
+				local c, padding = nativeOptions()
+				local data = assert(Buffer.fromBase64(chunk, c, padding, base64.strictNonencoding, base64.strictPadding))
+				for _, v in ipairs{tostring(data):byte(1, -1)} do
+					coroutine.yield(toString and string.char(v) or v)
 				end
-				
+			end)
+			return
+		end
+		
+		chars:groupBySize(4):map(stream.table)
+			:forAll(function(buf)
 				-- Convert
 				for _, v in ipairs(self:chunk(buf)) do
 					coroutine.yield(toString and string.char(v) or v)
@@ -205,17 +273,25 @@ function stream.base64decode:dec(x)
 end
 
 function stream.base64decode:chunk(buf)
-	local all =
-		  ((buf[1] and buf[1] ~= base64.padding) and self:dec(buf[1]) or 0) << 3*6
-		| ((buf[2] and buf[2] ~= base64.padding) and self:dec(buf[2]) or 0) << 2*6
-		| ((buf[3] and buf[3] ~= base64.padding) and self:dec(buf[3]) or 0) << 1*6
-		| ((buf[4] and buf[4] ~= base64.padding) and self:dec(buf[4]) or 0) << 0*6
+	if #buf ~= 4 and base64.strictPadding and base64.padding then
+		error("Invalid base64 string: length is not a multiple of 4 (check padding options)")
+	end
 	
-	return {
-		((all >> 2*8) & 0xFF ~= 0 and (all >> 2*8) & 0xFF or nil),
-		((all >> 1*8) & 0xFF ~= 0 and (all >> 1*8) & 0xFF or nil),
-		((all >> 0*8) & 0xFF ~= 0 and (all >> 0*8) & 0xFF or nil),
-	}
+	local all, n = 0, 0 -- n is the number of characters before the padding
+	for i = 1, 4 do
+		if buf[i] and buf[i] ~= base64.padding then
+			all = all | self:dec(buf[i]) << (4-i)*6
+			n = i
+		end
+	end
+	if n == 1 then error("Invalid base64 string: a single character in the last group") end
+	
+	-- n characters hold n-1 bytes, which can be 0
+	local bytes = {}
+	for i = 1, n-1 do
+		bytes[i] = (all >> (3-i)*8) & 0xFF
+	end
+	return bytes
 end
 
 setmetatable(stream.base64decode, stream)
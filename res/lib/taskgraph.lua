@@ -0,0 +1,258 @@
+--[[--
+
+	Task graphs: run jobs with dependencies on a pool of `safethread` workers.
+	
+	A job runs as soon as all jobs it depends on have finished. The results of
+	a job are passed to the jobs that depend on it through the `shared` store,
+	so they go directly from worker to worker instead of through the main
+	thread. The main thread only hands out jobs, and picks up the outcome of a
+	job from the store once its worker is idle again.
+	
+	@module taskgraph
+	@see safethread, shared
+	@usage
+	local graph = taskgraph.new()
+	graph:add("load", function() return io.open("in.txt"):read("a") end)
+	graph:add("upper", function(text) return text:upper() end, {"load"})
+	local report = graph:run()
+	print(graph:result("upper"), report.criticalTime)
+
+]]--
+
+local Thread = require "safethread"
+local shared = require "shared"
+local prequire = require "prequire"
+
+local taskgraph = {}
+taskgraph.__index = taskgraph
+
+
+
+-- WORKER SIDE
+
+-- Runs in the worker thread. Gets copied over to the worker, so it can not
+-- use any upvalues. Stores the outcome of the job under prefix..name.."!"
+local function runJob(prefix, name, fn, deps)
+	local store = require "shared"
+	local clock = require("safethread").time
+	
+	-- Get the first result of every dependency
+	local args = {}
+	for i, dep in ipairs(deps) do
+		local results = store.get(prefix..dep)
+		args[i] = results and results[1]
+	end
+	
+	local start = clock()
+	local results = table.pack(pcall(fn, table.unpack(args, 1, #deps)))
+	local duration = clock() - start
+	
+	if not results[1] then
+		store.set(prefix..name.."!", {ok = false, duration = duration, err = tostring(results[2])})
+		return
+	end
+	store.set(prefix..name, table.pack(table.unpack(results, 2, results.n)))
+	store.set(prefix..name.."!", {ok = true, duration = duration})
+end
+
+
+
+-- GRAPH
+
+--- Create a new task graph.
+-- @tparam[opt] number nWorkers the maximum number of worker threads,
+-- defaults to the number of CPU cores
+-- @treturn TaskGraph
+function taskgraph.new(nWorkers)
+	local sys = prequire "sys"
+	local self = {}
+	self.nWorkers = nWorkers or (sys and sys.cores) or 4
+	self.jobs = {}
+	self.order = {}
+	self.workers = {}
+	self.prefix = "taskgraph:"..shared.increment("taskgraph:id")..":"
+	return setmetatable(self, taskgraph)
+end
+
+--- @type TaskGraph
+
+--- Add a job.
+-- The job function gets the first return value of each of its dependencies
+-- as arguments, in the order of `deps`. Like with `safethread`, the function
+-- gets copied to the worker, and so do its upvalues.
+-- @tparam string name
+-- @tparam function fn
+-- @tparam[opt] {string,...} deps the names of the jobs this job depends on
+-- @treturn TaskGraph self
+function taskgraph:add(name, fn, deps)
+	if self.jobs[name] then error("job '"..name.."' already exists", 2) end
+	self.jobs[name] = {name = name, fn = fn, deps = deps or {}}
+	table.insert(self.order, name)
+	return self
+end
+
+function taskgraph:newWorker()
+	local worker = Thread()
+	table.insert(self.workers, worker)
+	return worker
+end
+
+-- Mark a job and everything that (indirectly) depends on it as skipped
+local function skip(name, dependents, report, done)
+	for _, dependent in ipairs(dependents[name] or {}) do
+		if not done[dependent] then
+			done[dependent] = true
+			report.skipped[dependent] = name
+			skip(dependent, dependents, report, done)
+		end
+	end
+end
+
+-- Find the chain of jobs with the largest total duration
+local function criticalPath(self, report, finishOrder)
+	local pathTime, previous = {}, {}
+	local last
+	for _, name in ipairs(finishOrder) do
+		local time = 0
+		for _, dep in ipairs(self.jobs[name].deps) do
+			if (pathTime[dep] or 0) > time then
+				time = pathTime[dep]
+				previous[name] = dep
+			end
+		end
+		pathTime[name] = time + report.jobs[name].duration
+		if not last or pathTime[name] > pathTime[last] then last = name end
+	end
+	
+	local path = {}
+	while last do
+		table.insert(path, 1, last)
+		last = previous[last]
+	end
+	return path, pathTime[path[#path]] or 0
+end
+
+--- Run all jobs, and wait until they are finished.
+-- While waiting, the event loop of the calling thread keeps running.
+-- When a job fails, all jobs that depend on it are skipped. When a worker can
+-- not run a job at all, for example because its function can not be copied,
+-- the run stops with an error. Times are in seconds, measured with the
+-- monotonic clock of `safethread.time`.
+-- @treturn table report, with the fields:
+--
+-- - `total`: the wall-clock time it took to run the graph
+-- - `jobs`: for every job name a table with `start` and `finish` times
+--   (relative to the start of the graph), the `duration` of the job
+--   function itself and the index of the `worker` it ran on
+-- - `criticalPath`: the names of the chain of dependent jobs that took the longest
+-- - `criticalTime`: the total duration of the jobs on the critical path
+-- - `failed`: for every failed job its error message
+-- - `skipped`: for every skipped job the name of the job that caused it
+function taskgraph:run()
+	local report = {jobs = {}, failed = {}, skipped = {}}
+	
+	-- Find dependents and the jobs that are ready to run
+	local waiting, dependents, ready = {}, {}, {}
+	for _, name in ipairs(self.order) do
+		local job = self.jobs[name]
+		waiting[name] = #job.deps
+		for _, dep in ipairs(job.deps) do
+			if not self.jobs[dep] then
+				error("job '"..name.."' depends on unknown job '"..dep.."'", 2)
+			end
+			dependents[dep] = dependents[dep] or {}
+			table.insert(dependents[dep], name)
+		end
+		if #job.deps == 0 then table.insert(ready, name) end
+	end
+	
+	local idle, running, finishOrder, done = {}, {}, {}, {}
+	local nRunning, nDone = 0, 0
+	local startTime = Thread.time()
+	
+	while nDone < #self.order do
+		-- Dispatch ready jobs to idle workers
+		while #ready > 0 and (#idle > 0 or #self.workers < self.nWorkers) do
+			local worker = table.remove(idle) or #self.workers + 1
+			if worker > #self.workers then self:newWorker() end
+			local name = table.remove(ready, 1)
+			local job = self.jobs[name]
+			report.jobs[name] = {start = Thread.time() - startTime, worker = worker}
+			nRunning = nRunning + 1
+			running[worker] = name
+			shared.set(self.prefix..name.."!", nil) -- from an earlier run
+			assert(self.workers[worker]:async(runJob, self.prefix, name, job.fn, job.deps)())
+		end
+		
+		if nRunning == 0 then
+			error("dependency cycle between jobs that did not run", 2)
+		end
+		
+		-- Let the workers run
+		os.sleep(0.001)
+		
+		-- Handle finished jobs, in the order of the workers
+		for worker = 1, #self.workers do
+			local name = running[worker]
+			if name and self.workers[worker]:status() == "idle" then
+				local outcome = shared.get(self.prefix..name.."!")
+				if not outcome then
+					error("job '"..name.."' could not be run by its worker", 2)
+				end
+				local info = report.jobs[name]
+				info.finish = Thread.time() - startTime
+				info.duration = outcome.duration
+				nRunning = nRunning - 1
+				running[worker] = nil
+				done[name] = true
+				table.insert(idle, worker)
+				table.insert(finishOrder, name)
+				
+				if outcome.ok then
+					for _, dependent in ipairs(dependents[name] or {}) do
+						waiting[dependent] = waiting[dependent] - 1
+						if waiting[dependent] == 0 and not done[dependent] then
+							table.insert(ready, dependent)
+						end
+					end
+				else
+					report.failed[name] = outcome.err
+					skip(name, dependents, report, done)
+				end
+			end
+		end
+		
+		nDone = 0
+		for _ in pairs(done) do nDone = nDone + 1 end
+	end
+	
+	report.total = Thread.time() - startTime
+	report.criticalPath, report.criticalTime = criticalPath(self, report, finishOrder)
+	return report
+end
+
+--- Get the results of a finished job.
+-- @tparam string name
+-- @return the values returned by the job function
+function taskgraph:result(name)
+	local results = shared.get(self.prefix..name)
+	if results then return table.unpack(results, 1, results.n) end
+end
+
+--- Stop the worker threads and remove all stored results.
+function taskgraph:close()
+	for _, worker in ipairs(self.workers) do worker:wait() end
+	self.workers = {}
+	for _, name in ipairs(self.order) do
+		shared.set(self.prefix..name, nil)
+		shared.set(self.prefix..name.."!", nil)
+	end
+end
+
+
+
+-- RETURN
+
+return setmetatable(taskgraph, {
+	__call = function(_, ...) return taskgraph.new(...) end,
+})
@@ -1,28 +1,29 @@
 local window = require "SDLWindow"
 local event = require "event"
+local Buffer = require "Buffer"
 
 local screen = window.new()
 screen:loadFont("res/poly4x3-r_meta.lua")
 
-local input = ""
+local input = Buffer.text()
 local x, y = 0, 0
 
 function onkeydown(key)
 	if key == "backspace" and x > 0 then
-		input = input:sub(1, -2)
+		input:remove(input:move(#input, -1), #input)
 		x = x-4
 		screen:colour(0)
 		screen:rect(x, y, 4, 5, true)
 		screen:colour(255)
 	elseif key == "return" then
-		input = ""
+		input = Buffer.text()
 		y = y + 6
 		x = 0
 	end
 end
 
 function oninput(text)
-	input = input .. text
+	input:insert(#input, text)
 	screen:write(text, x, y)
 	x = x+4
 end
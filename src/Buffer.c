@@ -3,7 +3,28 @@
  * @module Buffer
  */
 
+#include <stdlib.h> // for realloc, free
+#include <stdio.h> // for FILE, fread, fwrite
 #include <string.h>
+#include <errno.h> // for EAGAIN, ETIMEDOUT, EINTR
+
+#if defined(_WIN32) || defined(__WIN32__)
+	#include <windows.h> // for WaitOnAddress
+#elif defined(__linux__)
+	#include <unistd.h> // for syscall
+	#include <sys/syscall.h> // for SYS_futex
+	#include <linux/futex.h> // for FUTEX_WAIT_PRIVATE
+	#include <time.h> // for struct timespec, clock_gettime
+#else
+	#include <time.h> // for nanosleep
+#endif
+
+#if !defined(_WIN32) && !defined(__WIN32__)
+	#include <fcntl.h> // for open
+	#include <unistd.h> // for close
+	#include <sys/stat.h> // for fstat
+	#include <sys/mman.h> // for mmap
+#endif
 
 #include <lua.h>
 #include <lualib.h>
@@ -11,23 +32,116 @@
 
 #include "Buffer.h"
 #include "Value.h"
+#include "TypedArray.h"
+#include "bytes.h"
+#include "vecmath.h"
+#include "Schema.h"
+#include "hash.h"
+#include "lz4.h"
+#include "encoding.h"
+#include "bits.h"
+#include "convert.h"
+#include "ring.h"
+#include "text.h"
 
 /* C library definitions */
 
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	#define NATIVE_LITTLE_ENDIAN 1
+#else
+	#define NATIVE_LITTLE_ENDIAN 0
+#endif
+
+// Reverse the byte order of a value, used by the typed read and write functions
+#define bswap8(x) (x)
+#define bswap16(x) __builtin_bswap16(x)
+#define bswap32(x) __builtin_bswap32(x)
+#define bswap64(x) __builtin_bswap64(x)
+
 static const struct luaL_Reg buffer_f[]; // forward-declare for __index
 
 Buffer *buffer_newbuffer(lua_State *L, lua_Integer size){
 	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer) + sizeof(uint8_t[size]));
 	buffer->size = size;
 	buffer->buffer = buffer->data;
+	buffer->capacity = size;
+	buffer->kind = BUFFER_FIXED;
+	buffer->owner = NULL;
+	buffer->views = 0;
+	luaL_setmetatable(L, "Buffer");
+	return buffer;
+}
+
+Buffer *buffer_newgrowable(lua_State *L, size_t capacity){
+	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer));
+	buffer->size = 0;
+	buffer->buffer = NULL;
+	buffer->capacity = 0;
+	buffer->kind = BUFFER_GROWABLE;
+	buffer->owner = NULL;
+	buffer->views = 0;
 	luaL_setmetatable(L, "Buffer");
+	buffer_reserve_capacity(L, buffer, capacity);
 	return buffer;
 }
 
+// Make sure a growable buffer has room for capacity bytes, or throw an error
+// This can move the data, which is refused while views of the buffer exist
+void buffer_reserve_capacity(lua_State *L, Buffer *buffer, size_t capacity){
+	if(capacity <= buffer->capacity) return;
+	if(buffer->kind != BUFFER_GROWABLE) luaL_error(L, "buffer is not growable");
+	if(buffer->views > 0){
+		/* Views that are no longer used only go away when collected */
+		lua_gc(L, LUA_GCCOLLECT, 0);
+		if(buffer->views > 0) luaL_error(L, "buffer has views, so it cannot grow past its capacity");
+	}
+	
+	/* Double the capacity, to make appending amortised O(1) */
+	size_t new_capacity = (buffer->capacity < 16) ? 16 : buffer->capacity;
+	while(new_capacity < capacity){
+		if(new_capacity > SIZE_MAX / 2){
+			new_capacity = capacity;
+			break;
+		}
+		new_capacity *= 2;
+	}
+	uint8_t *data = realloc(buffer->buffer, new_capacity);
+	if(data == NULL) luaL_error(L, "not enough memory");
+	buffer->buffer = data;
+	buffer->capacity = new_capacity;
+}
+
+// Add size bytes to the end of a growable buffer, and return a pointer to them
+uint8_t *buffer_grow(lua_State *L, Buffer *buffer, size_t size){
+	if(size > SIZE_MAX - buffer->size) luaL_error(L, "not enough memory");
+	buffer_reserve_capacity(L, buffer, buffer->size + size);
+	uint8_t *end = buffer->buffer + buffer->size;
+	buffer->size += size;
+	return end;
+}
+
+// Count a view of the data of buffer, and return the growable buffer that
+// owns the data, or NULL when the data never moves
+Buffer *buffer_addview(Buffer *buffer){
+	Buffer *owner = (buffer->kind == BUFFER_GROWABLE) ? buffer : buffer->owner;
+	if(owner != NULL) owner->views++;
+	return owner;
+}
+
+// Undo buffer_addview, when the view is collected
+void buffer_removeview(Buffer *owner){
+	if(owner != NULL) owner->views--;
+}
+
 int buffer_within(Buffer *buffer, lua_Integer index){
 	return index >= 0 && (size_t)index < buffer->size;
 }
 
+// Whether index up to index+size is inside the buffer
+int buffer_within_range(Buffer *buffer, lua_Integer index, size_t size){
+	return index >= 0 && size <= buffer->size && (size_t)index <= buffer->size - size;
+}
+
 void buffer_set_with_size(Buffer *buffer, lua_Integer index, lua_Integer value, size_t size, int littleEndian){
 	for(size_t i = 0; i < size; i++){
 		buffer->buffer[index + (littleEndian ? i : size-1-i)] = (uint8_t)(value >> i*8);
@@ -43,6 +157,135 @@ lua_Integer buffer_get_with_size(Buffer *buffer, lua_Integer index, size_t size,
 	return value;
 }
 
+// Get a pointer to an aligned 4 or 8 byte slot for atomic access, or throw an error
+// size_arg is the argument position of the size, for the error message
+static void *buffer_check_atomic(lua_State *L, Buffer *buffer, lua_Integer index, size_t size, int size_arg){
+	luaL_argcheck(L, size == sizeof(uint32_t) || size == sizeof(uint64_t), size_arg, "size must be 4 or 8");
+	luaL_argcheck(L, buffer_within_range(buffer, index, size), 2, "index out of bounds");
+	void *ptr = &buffer->buffer[index];
+	luaL_argcheck(L, (uintptr_t)ptr % size == 0, 2, "index is not aligned to size");
+	return ptr;
+}
+
+// Wait until the 32-bit value at address is woken, when it equals expected
+// Returns 0 when woken, EAGAIN when the value did not equal expected or ETIMEDOUT
+static int buffer_wait_address(uint32_t *address, uint32_t expected, double timeout){
+#if defined(_WIN32) || defined(__WIN32__)
+	if(__atomic_load_n(address, __ATOMIC_SEQ_CST) != expected) return EAGAIN;
+	DWORD ms = (timeout < 0) ? INFINITE : (DWORD)(timeout * 1000);
+	return WaitOnAddress(address, &expected, sizeof(expected), ms) ? 0 : ETIMEDOUT;
+#elif defined(__linux__)
+	struct timespec start, now, ts;
+	clock_gettime(CLOCK_MONOTONIC, &start);
+	while(1){
+		/* The timeout is relative, so take off the time waited before a signal */
+		double left = timeout;
+		if(timeout > 0){
+			clock_gettime(CLOCK_MONOTONIC, &now);
+			left -= (now.tv_sec - start.tv_sec) + (now.tv_nsec - start.tv_nsec) * 1e-9;
+			if(left < 0) left = 0;
+		}
+		ts.tv_sec = (time_t)left;
+		ts.tv_nsec = (long)((left - ts.tv_sec) * 1e9);
+		if(syscall(SYS_futex, address, FUTEX_WAIT_PRIVATE, expected, (timeout < 0) ? NULL : &ts, NULL, 0) == 0){
+			return 0;
+		}
+		if(errno != EINTR) return (errno == ETIMEDOUT) ? ETIMEDOUT : EAGAIN;
+	}
+#else
+	/* No futex available, fall back to polling */
+	if(__atomic_load_n(address, __ATOMIC_SEQ_CST) != expected) return EAGAIN;
+	struct timespec ts = {0, 100000}; // 0.1 ms
+	for(double waited = 0; timeout < 0 || waited < timeout; waited += 1e-4){
+		nanosleep(&ts, NULL);
+		if(__atomic_load_n(address, __ATOMIC_SEQ_CST) != expected) return 0;
+	}
+	return ETIMEDOUT;
+#endif
+}
+
+// Wake up to count threads waiting on address, returns the number of woken threads if known
+static int buffer_wake_address(uint32_t *address, int count){
+#if defined(_WIN32) || defined(__WIN32__)
+	if(count == 1){
+		WakeByAddressSingle(address);
+	}else{
+		WakeByAddressAll(address);
+	}
+	return 0;
+#elif defined(__linux__)
+	long woken = syscall(SYS_futex, address, FUTEX_WAKE_PRIVATE, count, NULL, NULL, 0);
+	return (woken < 0) ? 0 : (int)woken;
+#else
+	return 0;
+#endif
+}
+
+// Map a whole file into memory, returns 0 on success or -1 and sets errno
+// Writable maps are shared with the file, others are private copy-on-write
+static int buffer_map_file(const char *path, int writable, uint8_t **data, size_t *size){
+	*data = NULL;
+#if defined(_WIN32) || defined(__WIN32__)
+	HANDLE file = CreateFileA(path, GENERIC_READ | (writable ? GENERIC_WRITE : 0),
+		FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	LARGE_INTEGER length;
+	if(file == INVALID_HANDLE_VALUE || !GetFileSizeEx(file, &length)){
+		DWORD error = GetLastError();
+		errno = (error == ERROR_FILE_NOT_FOUND || error == ERROR_PATH_NOT_FOUND) ? ENOENT
+			: (error == ERROR_ACCESS_DENIED) ? EACCES : EIO;
+		if(file != INVALID_HANDLE_VALUE) CloseHandle(file);
+		return -1;
+	}
+	*size = length.QuadPart;
+	if(*size > 0){
+		HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_READWRITE : PAGE_WRITECOPY, 0, 0, NULL);
+		if(mapping != NULL){
+			*data = MapViewOfFile(mapping, writable ? FILE_MAP_WRITE : FILE_MAP_COPY, 0, 0, 0);
+			CloseHandle(mapping); // the view keeps the mapping alive
+		}
+		if(*data == NULL) errno = EIO;
+	}
+	CloseHandle(file);
+	return (*size > 0 && *data == NULL) ? -1 : 0;
+#else
+	int fd = open(path, writable ? O_RDWR : O_RDONLY);
+	if(fd < 0) return -1;
+	struct stat st;
+	if(fstat(fd, &st) != 0){
+		close(fd);
+		return -1;
+	}
+	if((uintmax_t)st.st_size > SIZE_MAX){
+		close(fd);
+		errno = EFBIG;
+		return -1;
+	}
+	*size = st.st_size;
+	if(*size > 0){
+		void *ptr = mmap(NULL, *size, PROT_READ | PROT_WRITE, writable ? MAP_SHARED : MAP_PRIVATE, fd, 0);
+		if(ptr == MAP_FAILED){
+			int error = errno;
+			close(fd);
+			errno = error;
+			return -1;
+		}
+		*data = ptr;
+	}
+	close(fd); // the map keeps the file open
+	return 0;
+#endif
+}
+
+static void buffer_unmap(Buffer *buffer){
+	if(buffer->buffer == NULL) return;
+#if defined(_WIN32) || defined(__WIN32__)
+	UnmapViewOfFile(buffer->buffer);
+#else
+	munmap(buffer->buffer, buffer->capacity);
+#endif
+	buffer->buffer = NULL;
+}
+
 /* Lua API definitions */
 
 /***
@@ -68,9 +311,11 @@ int buffer_of(lua_State *L){
 				buffer = buffer_newbuffer(L, 1); // stack: {Buffer, item}
 				buffer->buffer[0] = lua_tointeger(L, 1);
 				break;
-			case LUA_TSTRING:
-				buffer = buffer_newbuffer(L, luaL_len(L, 1)); // stack: {Buffer, item}
-				strcpy((char*)buffer->buffer, lua_tostring(L, 1));
+			case LUA_TSTRING: ;
+				size_t length;
+				const char *str = lua_tolstring(L, 1, &length);
+				buffer = buffer_newbuffer(L, length); // stack: {Buffer, item}
+				memcpy(buffer->buffer, str, length);
 				break;
 			case LUA_TTABLE:
 				buffer = buffer_newbuffer(L, luaL_len(L, 1)); // stack: {Buffer, table}
@@ -100,6 +345,62 @@ int buffer_new(lua_State *L){
 	return 1;
 }
 
+/***
+ * Create a new, empty `Buffer` which can grow.
+ * Use `Buffer:append` to add data to it. Growing moves the data when the
+ * buffer runs out of capacity, so while views of it (from `Buffer:view` and
+ * `Buffer:as`) exist it raises an error instead. Create views only after
+ * the buffer is done growing, or reserve enough capacity up front.
+ * @function builder
+ * @tparam[opt=0] number capacity the number of bytes to reserve
+ * @treturn Buffer
+ * @usage
+ * local out = Buffer.builder()
+ * out:append("MBOX"):append(1, 2):append(body)
+ */
+int buffer_builder(lua_State *L){
+	lua_Integer capacity = luaL_optinteger(L, 1, 0);
+	luaL_argcheck(L, capacity >= 0, 1, "capacity must be >= 0");
+	buffer_newgrowable(L, capacity);
+	return 1;
+}
+
+/***
+ * Create a `Buffer` backed by a memory-mapped file.
+ * The file is not read up front, pages are loaded by the OS when they are
+ * accessed, so even very large files open instantly. The file is unmapped
+ * when the buffer and all of its views are garbage collected.
+ * @function map
+ * @tparam string path
+ * @tparam[opt="r"] string mode `"r"` to only read the file, in which case
+ * changes to the buffer stay private to this process (copy-on-write), or
+ * `"rw"` to write changes back to the file, shared with other processes
+ * @treturn[1] Buffer
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ * @usage local data = Buffer.map("res/levels.bin")
+ */
+int buffer_map(lua_State *L){
+	static const char *const modes[] = {"r", "rw", NULL};
+	const char *path = luaL_checkstring(L, 1);
+	int writable = luaL_checkoption(L, 2, "r", modes);
+	
+	uint8_t *data;
+	size_t size;
+	if(buffer_map_file(path, writable, &data, &size) != 0){
+		return luaL_fileresult(L, 0, path);
+	}
+	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer));
+	buffer->size = size;
+	buffer->buffer = data;
+	buffer->capacity = size;
+	buffer->kind = BUFFER_MAPPED;
+	buffer->owner = NULL;
+	buffer->views = 0;
+	luaL_setmetatable(L, "Buffer");
+	return 1;
+}
+
 int buffer__call(lua_State *L){
 	lua_pushcfunction(L, buffer_new); // stack: {buffer_new, (size?), t}
 	lua_rotate(L, 1, -1); // stack: {t, buffer_new, (size?)}
@@ -363,6 +664,214 @@ int buffer_getUint64(lua_State *L){ BUFFER_GET(uint64_t, 0); return 1; }
  */
 int buffer_getInt64(lua_State *L){ BUFFER_GET(uint64_t, 1); return 1; }
 
+#define BUFFER_READ(bits, type) \
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer"); \
+	lua_Integer index = luaL_checkinteger(L, 2); \
+	int littleEndian = lua_toboolean(L, 3); \
+	luaL_argcheck(L, buffer_within_range(buffer, index, (bits)/8), 2, "index out of bounds"); \
+	uint##bits##_t raw; \
+	memcpy(&raw, &buffer->buffer[index], sizeof(raw)); \
+	if(littleEndian != NATIVE_LITTLE_ENDIAN) raw = bswap##bits(raw); \
+	type value; \
+	memcpy(&value, &raw, sizeof(value));
+
+#define BUFFER_WRITE(bits, type, v) \
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer"); \
+	lua_Integer index = luaL_checkinteger(L, 2); \
+	type value = (type)(v); \
+	int littleEndian = lua_toboolean(L, 4); \
+	luaL_argcheck(L, buffer_within_range(buffer, index, (bits)/8), 2, "index out of bounds"); \
+	uint##bits##_t raw; \
+	memcpy(&raw, &value, sizeof(raw)); \
+	if(littleEndian != NATIVE_LITTLE_ENDIAN) raw = bswap##bits(raw); \
+	memcpy(&buffer->buffer[index], &raw, sizeof(raw));
+
+/***
+ * Read an unsigned 8-bit value from a given index.
+ * Unlike `getUint8`, returns a plain number.
+ * @function readUint8
+ * @tparam number index
+ * @treturn number
+ */
+int buffer_readUint8(lua_State *L){ BUFFER_READ(8, uint8_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read a signed 8-bit value from a given index.
+ * Unlike `getInt8`, returns a plain number.
+ * @function readInt8
+ * @tparam number index
+ * @treturn number
+ */
+int buffer_readInt8(lua_State *L){ BUFFER_READ(8, int8_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read an unsigned 16-bit value from a given index.
+ * Unlike `getUint16`, returns a plain number.
+ * @function readUint16
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readUint16(lua_State *L){ BUFFER_READ(16, uint16_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read a signed 16-bit value from a given index.
+ * Unlike `getInt16`, returns a plain number.
+ * @function readInt16
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readInt16(lua_State *L){ BUFFER_READ(16, int16_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read an unsigned 32-bit value from a given index.
+ * Unlike `getUint32`, returns a plain number.
+ * @function readUint32
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readUint32(lua_State *L){ BUFFER_READ(32, uint32_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read a signed 32-bit value from a given index.
+ * Unlike `getInt32`, returns a plain number.
+ * @function readInt32
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readInt32(lua_State *L){ BUFFER_READ(32, int32_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read an unsigned 64-bit value from a given index.
+ * Unlike `getUint64`, returns a plain number.
+ * @function readUint64
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readUint64(lua_State *L){ BUFFER_READ(64, uint64_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read a signed 64-bit value from a given index.
+ * Unlike `getInt64`, returns a plain number.
+ * @function readInt64
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readInt64(lua_State *L){ BUFFER_READ(64, int64_t); lua_pushinteger(L, value); return 1; }
+
+/***
+ * Read a 32-bit floating point value from a given index.
+ * The value is widened to a Lua float, which represents it exactly.
+ * @function readFloat32
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readFloat32(lua_State *L){ BUFFER_READ(32, float); lua_pushnumber(L, value); return 1; }
+
+/***
+ * Read a 64-bit floating point value from a given index.
+ * The value is returned as a Lua float.
+ * @function readFloat64
+ * @tparam number index
+ * @tparam[opt] boolean littleEndian
+ * @treturn number
+ */
+int buffer_readFloat64(lua_State *L){ BUFFER_READ(64, double); lua_pushnumber(L, value); return 1; }
+
+/***
+ * Write an unsigned 8-bit value at a given index.
+ * @function writeUint8
+ * @tparam number index
+ * @tparam number value
+ */
+int buffer_writeUint8(lua_State *L){ BUFFER_WRITE(8, uint8_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write a signed 8-bit value at a given index.
+ * @function writeInt8
+ * @tparam number index
+ * @tparam number value
+ */
+int buffer_writeInt8(lua_State *L){ BUFFER_WRITE(8, uint8_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write an unsigned 16-bit value at a given index.
+ * @function writeUint16
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeUint16(lua_State *L){ BUFFER_WRITE(16, uint16_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write a signed 16-bit value at a given index.
+ * @function writeInt16
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeInt16(lua_State *L){ BUFFER_WRITE(16, uint16_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write an unsigned 32-bit value at a given index.
+ * @function writeUint32
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeUint32(lua_State *L){ BUFFER_WRITE(32, uint32_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write a signed 32-bit value at a given index.
+ * @function writeInt32
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeInt32(lua_State *L){ BUFFER_WRITE(32, uint32_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write an unsigned 64-bit value at a given index.
+ * @function writeUint64
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeUint64(lua_State *L){ BUFFER_WRITE(64, uint64_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write a signed 64-bit value at a given index.
+ * @function writeInt64
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeInt64(lua_State *L){ BUFFER_WRITE(64, uint64_t, luaL_checkinteger(L, 3)); return 0; }
+
+/***
+ * Write a 32-bit floating point value at a given index.
+ * @function writeFloat32
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeFloat32(lua_State *L){ BUFFER_WRITE(32, float, luaL_checknumber(L, 3)); return 0; }
+
+/***
+ * Write a 64-bit floating point value at a given index.
+ * @function writeFloat64
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt] boolean littleEndian
+ */
+int buffer_writeFloat64(lua_State *L){ BUFFER_WRITE(64, double, luaL_checknumber(L, 3)); return 0; }
+
 // upvalue 1: Value table
 // upvalue 2: buffer userdata
 // upvalue 3: index counter
@@ -422,6 +931,8 @@ int buffer_stream(lua_State *L){
 
 /***
  * Create a new view of a part of this buffer.
+ * While views (or `as` arrays) of a growable buffer exist, it cannot grow
+ * past its capacity, so `reserve` enough room before taking them.
  * @function view
  * @tparam[opt=0] number from
  * @tparam[optchain] number size defaults to the rest of the buffer
@@ -432,17 +943,537 @@ int buffer_view(lua_State *L){
 	lua_Integer from = luaL_optinteger(L, 2, 0);
 	lua_Integer size = luaL_optinteger(L, 3, source->size - from);
 	luaL_argcheck(L, buffer_within(source, from), 2, "out of bounds");
-	luaL_argcheck(L, buffer_within(source, from+size), 3, "out of bounds");
 	luaL_argcheck(L, size > 0, 3, "size must be > 0");
+	luaL_argcheck(L, buffer_within_range(source, from, size), 3, "out of bounds");
 	
 	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer));
 	buffer->size = size;
 	buffer->buffer = &source->buffer[from];
+	buffer->capacity = size;
+	buffer->kind = BUFFER_VIEW;
+	buffer->owner = buffer_addview(source);
+	buffer->views = 0;
 	
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2); // keep the source alive
 	luaL_setmetatable(L, "Buffer");
 	return 1;
 }
 
+// Get the bytes of a Buffer or string argument
+const uint8_t *buffer_checkbytes(lua_State *L, int idx, size_t *size){
+	if(lua_type(L, idx) == LUA_TSTRING){
+		return (const uint8_t*)lua_tolstring(L, idx, size);
+	}
+	Buffer *buffer = luaL_checkudata(L, idx, "Buffer");
+	*size = buffer->size;
+	return buffer->buffer;
+}
+
+/***
+ * Set a range of bytes to one value.
+ * @function fill
+ * @tparam number value
+ * @tparam[opt=0] number from
+ * @tparam[opt] number length until the end of the buffer when not given
+ * @treturn Buffer self
+ */
+int buffer_fill(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	uint8_t value = luaL_checkinteger(L, 2);
+	lua_Integer from = luaL_optinteger(L, 3, 0);
+	lua_Integer length = luaL_optinteger(L, 4, buffer->size - from);
+	luaL_argcheck(L, length >= 0 && buffer_within_range(buffer, from, length), 3, "out of bounds");
+	memset(&buffer->buffer[from], value, length);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Copy bytes from another `Buffer` or string into this buffer.
+ * The source and destination may overlap.
+ * @function copyFrom
+ * @tparam Buffer|string source
+ * @tparam[opt=0] number offset where to start writing in this buffer
+ * @tparam[opt=0] number from where to start reading in the source
+ * @tparam[opt] number length the rest of the source when not given
+ * @treturn Buffer self
+ */
+int buffer_copyFrom(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	size_t size;
+	const uint8_t *source = buffer_checkbytes(L, 2, &size);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	lua_Integer from = luaL_optinteger(L, 4, 0);
+	luaL_argcheck(L, from >= 0 && (size_t)from <= size, 4, "out of bounds");
+	lua_Integer length = luaL_optinteger(L, 5, size - from);
+	luaL_argcheck(L, length >= 0 && (size_t)length <= size - from, 5, "out of bounds");
+	luaL_argcheck(L, buffer_within_range(buffer, offset, length), 3, "out of bounds");
+	memmove(&buffer->buffer[offset], &source[from], length);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Compare the bytes with another `Buffer` or string, like `memcmp`.
+ * When one is a prefix of the other, the shortest one is smaller.
+ * @function compare
+ * @tparam Buffer|string other
+ * @treturn number -1, 0 or 1 when this buffer is smaller, equal or larger
+ * @treturn[opt] number the index of the first byte that differs, or nil when equal
+ */
+int buffer_compare(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	size_t size;
+	const uint8_t *other = buffer_checkbytes(L, 2, &size);
+	size_t length = (buffer->size < size) ? buffer->size : size;
+	size_t i = bytes_mismatch(buffer->buffer, other, length);
+	
+	if(i < length){
+		lua_pushinteger(L, (buffer->buffer[i] < other[i]) ? -1 : 1);
+	}else if(buffer->size == size){
+		lua_pushinteger(L, 0);
+		return 1;
+	}else{
+		lua_pushinteger(L, (buffer->size < size) ? -1 : 1);
+	}
+	lua_pushinteger(L, i);
+	return 2;
+}
+
+/***
+ * Find a byte or a sequence of bytes.
+ * @function find
+ * @tparam number|string|Buffer pattern a single byte value, or the bytes to find
+ * @tparam[opt=0] number from where to start searching
+ * @treturn[1] number the index of the first match
+ * @treturn[2] nil when not found
+ */
+int buffer_find(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer from = luaL_optinteger(L, 3, 0);
+	luaL_argcheck(L, from >= 0 && (size_t)from <= buffer->size, 3, "out of bounds");
+	const uint8_t *start = &buffer->buffer[from];
+	size_t left = buffer->size - from;
+	
+	uint8_t byte;
+	size_t size = 1;
+	const uint8_t *pattern = &byte;
+	if(lua_type(L, 2) == LUA_TNUMBER){
+		byte = luaL_checkinteger(L, 2);
+	}else{
+		pattern = buffer_checkbytes(L, 2, &size);
+	}
+	if(size == 0){
+		lua_pushinteger(L, from);
+		return 1;
+	}
+	
+	// Find the first byte with memchr (vectorised by the C library),
+	// then check the rest of the pattern
+	while(left >= size){
+		const uint8_t *match = memchr(start, pattern[0], left - size + 1);
+		if(!match) break;
+		if(memcmp(match + 1, pattern + 1, size - 1) == 0){
+			lua_pushinteger(L, match - buffer->buffer);
+			return 1;
+		}
+		left -= match + 1 - start;
+		start = match + 1;
+	}
+	lua_pushnil(L);
+	return 1;
+}
+
+/***
+ * Exclusive-or the bytes of another `Buffer` or string into this buffer.
+ * @function xor
+ * @tparam Buffer|string other
+ * @tparam[opt=0] number offset where to start in this buffer
+ * @treturn Buffer self
+ */
+int buffer_xor(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	size_t size;
+	const uint8_t *other = buffer_checkbytes(L, 2, &size);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	luaL_argcheck(L, buffer_within_range(buffer, offset, size), 3, "out of bounds");
+	bytes_xor(&buffer->buffer[offset], other, size);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Count the number of bits that are set.
+ * @function popcount
+ * @tparam[opt=0] number from
+ * @tparam[opt] number length until the end of the buffer when not given
+ * @treturn number
+ */
+int buffer_popcount(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer from = luaL_optinteger(L, 2, 0);
+	lua_Integer length = luaL_optinteger(L, 3, buffer->size - from);
+	luaL_argcheck(L, length >= 0 && buffer_within_range(buffer, from, length), 2, "out of bounds");
+	lua_pushinteger(L, bytes_popcount(&buffer->buffer[from], length));
+	return 1;
+}
+
+/***
+ * Add data to the end of a growable buffer.
+ * @function append
+ * @tparam number|string|Buffer value a string or `Buffer` to copy, or an integer
+ * @tparam[opt=1] number width the number of bytes of an integer value
+ * @tparam[optchain=false] boolean littleEndian
+ * @treturn Buffer self
+ * @see builder
+ */
+int buffer_append(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	luaL_argcheck(L, buffer->kind == BUFFER_GROWABLE, 1, "buffer is not growable");
+	if(lua_type(L, 2) == LUA_TNUMBER){
+		lua_Integer value = luaL_checkinteger(L, 2);
+		lua_Integer width = luaL_optinteger(L, 3, 1);
+		luaL_argcheck(L, width >= 1 && width <= 8, 3, "width must be between 1 and 8");
+		size_t index = buffer->size;
+		buffer_grow(L, buffer, width);
+		buffer_set_with_size(buffer, index, value, width, lua_toboolean(L, 4));
+	}else{
+		size_t size, grown;
+		buffer_checkbytes(L, 2, &size);
+		uint8_t *end = buffer_grow(L, buffer, size);
+		// Get the source again, it has moved (and grown) when appending a buffer to itself
+		const uint8_t *source = buffer_checkbytes(L, 2, &grown);
+		memmove(end, source, size);
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Make sure a growable buffer can hold a number of bytes without moving.
+ * @function reserve
+ * @tparam number capacity
+ * @treturn Buffer self
+ */
+int buffer_reserve(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer capacity = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, capacity >= 0, 2, "capacity must be >= 0");
+	luaL_argcheck(L, buffer->kind == BUFFER_GROWABLE || (size_t)capacity <= buffer->capacity,
+		1, "buffer is not growable");
+	buffer_reserve_capacity(L, buffer, capacity);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Shrink the buffer.
+ * This keeps the memory, so the buffer can grow again without moving.
+ * @function truncate
+ * @tparam number size the new size, at most the current size
+ * @treturn Buffer self
+ */
+int buffer_truncate(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer size = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, size >= 0 && (size_t)size <= buffer->size, 2, "out of bounds");
+	buffer->size = size;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Write changes to a buffer from `Buffer.map` back to its file.
+ * @function sync
+ * @tparam[opt=false] boolean async return before the data is written
+ * @treturn[1] boolean true
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ */
+int buffer_sync(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	luaL_argcheck(L, buffer->kind == BUFFER_MAPPED, 1, "buffer is not mapped");
+	if(buffer->buffer == NULL) return luaL_fileresult(L, 1, NULL);
+#if defined(_WIN32) || defined(__WIN32__)
+	int ok = FlushViewOfFile(buffer->buffer, 0);
+	if(!ok) errno = EIO;
+#else
+	int ok = msync(buffer->buffer, buffer->capacity, lua_toboolean(L, 2) ? MS_ASYNC : MS_SYNC) == 0;
+#endif
+	return luaL_fileresult(L, ok, NULL);
+}
+
+/***
+ * Tell the OS how a buffer from `Buffer.map` will be accessed.
+ * @function advise
+ * @tparam string advice `"normal"`, `"sequential"`, `"random"`, `"willneed"`
+ * to start loading the file, or `"dontneed"`
+ * @treturn[1] boolean true
+ * @treturn[2] nil
+ * @treturn[2] string error message, also when not supported on this platform
+ */
+int buffer_advise(lua_State *L){
+	static const char *const advices[] = {"normal", "sequential", "random", "willneed", "dontneed", NULL};
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	int advice = luaL_checkoption(L, 2, NULL, advices);
+	luaL_argcheck(L, buffer->kind == BUFFER_MAPPED, 1, "buffer is not mapped");
+	if(buffer->buffer == NULL) return luaL_fileresult(L, 1, NULL);
+#if defined(_WIN32) || defined(__WIN32__)
+	(void)advice;
+	errno = ENOSYS;
+	return luaL_fileresult(L, 0, NULL);
+#else
+	static const int values[] = {POSIX_MADV_NORMAL, POSIX_MADV_SEQUENTIAL,
+		POSIX_MADV_RANDOM, POSIX_MADV_WILLNEED, POSIX_MADV_DONTNEED};
+	errno = posix_madvise(buffer->buffer, buffer->capacity, values[advice]);
+	return luaL_fileresult(L, errno == 0, NULL);
+#endif
+}
+
+// Get the bytes of the Buffer at idx from the offset at idx+1 to be read or written
+static uint8_t *buffer_checkfilerange(lua_State *L, int idx, size_t *n){
+	Buffer *buffer = luaL_checkudata(L, idx, "Buffer");
+	lua_Integer offset = luaL_optinteger(L, idx + 1, 0);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, idx + 1, "offset out of bounds");
+	lua_Integer size = luaL_optinteger(L, idx + 2, buffer->size - offset);
+	luaL_argcheck(L, size >= 0 && buffer_within_range(buffer, offset, size), idx + 2, "size out of bounds");
+	*n = size;
+	return buffer->buffer + offset;
+}
+
+static FILE *buffer_checkfile(lua_State *L){
+	luaL_Stream *stream = luaL_checkudata(L, 1, LUA_FILEHANDLE);
+	if(stream->closef == NULL) luaL_error(L, "attempt to use a closed file");
+	return stream->f;
+}
+
+/***
+ * Read bytes from an io file straight into a `Buffer`, without copying them.
+ * Added to the methods of io files when the `Buffer` module is loaded.
+ * @function file:readInto
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset index in the buffer
+ * @tparam[optchain] number n the maximum number of bytes, up to the end of the buffer by default
+ * @treturn[1] number the number of bytes read, 0 at the end of the file
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ * @usage
+ * local block = Buffer.new(65536)
+ * while file:readInto(block) > 0 do ... end
+ */
+int buffer_fileReadInto(lua_State *L){
+	FILE *file = buffer_checkfile(L);
+	size_t n;
+	uint8_t *dst = buffer_checkfilerange(L, 2, &n);
+	clearerr(file);
+	size_t n_read = fread(dst, 1, n, file);
+	if(n_read < n && ferror(file)) return luaL_fileresult(L, 0, NULL);
+	lua_pushinteger(L, n_read);
+	return 1;
+}
+
+/***
+ * Write bytes from a `Buffer` to an io file, without copying them.
+ * Added to the methods of io files when the `Buffer` module is loaded.
+ * @function file:writeFrom
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset index in the buffer
+ * @tparam[optchain] number n the number of bytes, up to the end of the buffer by default
+ * @treturn[1] number the number of bytes written
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ */
+int buffer_fileWriteFrom(lua_State *L){
+	FILE *file = buffer_checkfile(L);
+	size_t n;
+	const uint8_t *src = buffer_checkfilerange(L, 2, &n);
+	if(fwrite(src, 1, n, file) != n) return luaL_fileresult(L, 0, NULL);
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+// Add readInto and writeFrom to the methods of io files, if the io library is loaded
+static void buffer_registerio(lua_State *L){
+	luaL_getmetatable(L, LUA_FILEHANDLE); // stack: {metatable, ...}
+	if(lua_istable(L, -1) && lua_getfield(L, -1, "__index") == LUA_TTABLE){ // stack: {methods, metatable, ...}
+		lua_pushcfunction(L, buffer_fileReadInto);
+		lua_setfield(L, -2, "readInto");
+		lua_pushcfunction(L, buffer_fileWriteFrom);
+		lua_setfield(L, -2, "writeFrom");
+		lua_pop(L, 1); // stack: {metatable, ...}
+	}else if(lua_istable(L, -1)){
+		lua_pop(L, 1); // stack: {metatable, ...}
+	}
+	lua_pop(L, 1); // stack: {...}
+}
+
+/***
+ * Atomically get a value.
+ * Atomic operations use the native byte order, and need `index` to be a
+ * multiple of `size`. They can be used to coordinate multiple threads
+ * using the same `Buffer`.
+ * @function atomicLoad
+ * @tparam number index
+ * @tparam[opt=4] number size 4 or 8
+ * @treturn number
+ */
+int buffer_atomicLoad(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	size_t size = luaL_optinteger(L, 3, sizeof(uint32_t));
+	void *ptr = buffer_check_atomic(L, buffer, index, size, 3);
+	if(size == sizeof(uint32_t)){
+		lua_pushinteger(L, __atomic_load_n((uint32_t*)ptr, __ATOMIC_SEQ_CST));
+	}else{
+		lua_pushinteger(L, __atomic_load_n((uint64_t*)ptr, __ATOMIC_SEQ_CST));
+	}
+	return 1;
+}
+
+/***
+ * Atomically set a value.
+ * @function atomicStore
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt=4] number size 4 or 8
+ */
+int buffer_atomicStore(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	lua_Integer value = luaL_checkinteger(L, 3);
+	size_t size = luaL_optinteger(L, 4, sizeof(uint32_t));
+	void *ptr = buffer_check_atomic(L, buffer, index, size, 4);
+	if(size == sizeof(uint32_t)){
+		__atomic_store_n((uint32_t*)ptr, (uint32_t)value, __ATOMIC_SEQ_CST);
+	}else{
+		__atomic_store_n((uint64_t*)ptr, (uint64_t)value, __ATOMIC_SEQ_CST);
+	}
+	return 0;
+}
+
+/***
+ * Atomically add to a value.
+ * @function atomicAdd
+ * @tparam number index
+ * @tparam number delta may be negative
+ * @tparam[opt=4] number size 4 or 8
+ * @treturn number the previous value
+ */
+int buffer_atomicAdd(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	lua_Integer delta = luaL_checkinteger(L, 3);
+	size_t size = luaL_optinteger(L, 4, sizeof(uint32_t));
+	void *ptr = buffer_check_atomic(L, buffer, index, size, 4);
+	if(size == sizeof(uint32_t)){
+		lua_pushinteger(L, __atomic_fetch_add((uint32_t*)ptr, (uint32_t)delta, __ATOMIC_SEQ_CST));
+	}else{
+		lua_pushinteger(L, __atomic_fetch_add((uint64_t*)ptr, (uint64_t)delta, __ATOMIC_SEQ_CST));
+	}
+	return 1;
+}
+
+/***
+ * Atomically replace a value.
+ * @function atomicExchange
+ * @tparam number index
+ * @tparam number value
+ * @tparam[opt=4] number size 4 or 8
+ * @treturn number the previous value
+ */
+int buffer_atomicExchange(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	lua_Integer value = luaL_checkinteger(L, 3);
+	size_t size = luaL_optinteger(L, 4, sizeof(uint32_t));
+	void *ptr = buffer_check_atomic(L, buffer, index, size, 4);
+	if(size == sizeof(uint32_t)){
+		lua_pushinteger(L, __atomic_exchange_n((uint32_t*)ptr, (uint32_t)value, __ATOMIC_SEQ_CST));
+	}else{
+		lua_pushinteger(L, __atomic_exchange_n((uint64_t*)ptr, (uint64_t)value, __ATOMIC_SEQ_CST));
+	}
+	return 1;
+}
+
+/***
+ * Atomically compare and swap a value.
+ * Replaces the value with `new` only when it is equal to `expected`.
+ * @function atomicCas
+ * @tparam number index
+ * @tparam number expected
+ * @tparam number new
+ * @tparam[opt=4] number size 4 or 8
+ * @treturn boolean whether the value was replaced
+ * @treturn number the previous value
+ */
+int buffer_atomicCas(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	lua_Integer expected = luaL_checkinteger(L, 3);
+	lua_Integer value = luaL_checkinteger(L, 4);
+	size_t size = luaL_optinteger(L, 5, sizeof(uint32_t));
+	void *ptr = buffer_check_atomic(L, buffer, index, size, 5);
+	int swapped;
+	if(size == sizeof(uint32_t)){
+		uint32_t e = expected;
+		swapped = __atomic_compare_exchange_n((uint32_t*)ptr, &e, (uint32_t)value,
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		lua_pushboolean(L, swapped);
+		lua_pushinteger(L, e);
+	}else{
+		uint64_t e = expected;
+		swapped = __atomic_compare_exchange_n((uint64_t*)ptr, &e, (uint64_t)value,
+			0, __ATOMIC_SEQ_CST, __ATOMIC_SEQ_CST);
+		lua_pushboolean(L, swapped);
+		lua_pushinteger(L, e);
+	}
+	return 2;
+}
+
+/***
+ * Wait until another thread calls `notify` on an index.
+ * Only waits when the 32-bit value at `index` equals `expected`, like a futex.
+ * This blocks the whole thread, including its event loop.
+ * @function wait
+ * @tparam number index
+ * @tparam number expected
+ * @tparam[opt] number timeout in seconds, waits forever when not given
+ * @treturn string `"ok"` when woken, `"not-equal"` when the value was not
+ * `expected`, or `"timed-out"`
+ */
+int buffer_wait(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	uint32_t expected = luaL_checkinteger(L, 3);
+	double timeout = luaL_optnumber(L, 4, -1);
+	uint32_t *ptr = buffer_check_atomic(L, buffer, index, sizeof(uint32_t), 2);
+	
+	switch(buffer_wait_address(ptr, expected, timeout)){
+		case 0: lua_pushstring(L, "ok"); break;
+		case EAGAIN: lua_pushstring(L, "not-equal"); break;
+		default: lua_pushstring(L, "timed-out"); break;
+	}
+	return 1;
+}
+
+/***
+ * Wake threads waiting on an index.
+ * @function notify
+ * @tparam number index
+ * @tparam[opt] number count the maximum number of threads to wake,
+ * wakes all threads when not given
+ * @treturn number the number of woken threads (when known, else 0)
+ */
+int buffer_notify(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer index = luaL_checkinteger(L, 2);
+	lua_Integer count = luaL_optinteger(L, 3, INT32_MAX);
+	uint32_t *ptr = buffer_check_atomic(L, buffer, index, sizeof(uint32_t), 2);
+	lua_pushinteger(L, buffer_wake_address(ptr, count > INT32_MAX ? INT32_MAX : (int)count));
+	return 1;
+}
+
 /* Lua metamethods */
 
 /// @type Buffer
@@ -516,13 +1547,70 @@ int buffer__length(lua_State *L){
 	return 1;
 }
 
+/***
+ * __gc metamethod, frees the data of a growable `Buffer` or unmaps a mapped one.
+ * A view lets the growable buffer it points into move again.
+ * @function __gc
+ */
+int buffer__gc(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	if(buffer->kind == BUFFER_GROWABLE){
+		free(buffer->buffer);
+		buffer->buffer = NULL;
+		buffer->size = buffer->capacity = 0;
+	}else if(buffer->kind == BUFFER_MAPPED){
+		buffer_unmap(buffer);
+		buffer->size = buffer->capacity = 0;
+	}else if(buffer->kind == BUFFER_VIEW){
+		buffer_removeview(buffer->owner);
+		buffer->owner = NULL;
+	}
+	return 0;
+}
+
 static const struct luaL_Reg buffer_f[] = {
 	{"new", buffer_new},
 	{"of", buffer_of},
+	{"builder", buffer_builder},
+	{"map", buffer_map},
+	{"schema", schema_new},
+	{"crc32c", hash_crc32c},
+	{"xxh32", hash_xxh32},
+	{"xxh64", hash_xxh64},
+	{"hasher", hash_hasher},
+	{"compress", lz4_compress},
+	{"decompress", lz4_decompress},
+	{"compressFrame", lz4_compressFrame},
+	{"decompressFrame", lz4_decompressFrame},
+	{"compressor", lz4_compressor},
+	{"decompressor", lz4_decompressor},
+	{"toBase64", encoding_toBase64},
+	{"fromBase64", encoding_fromBase64},
+	{"toHex", encoding_toHex},
+	{"fromHex", encoding_fromHex},
+	{"bitReader", bits_bitReader},
+	{"bitWriter", bits_bitWriter},
+	{"sync", buffer_sync},
+	{"advise", buffer_advise},
 	{"set", buffer_set},
 	{"get", buffer_get},
 	{"stream", buffer_stream},
 	{"view", buffer_view},
+	{"append", buffer_append},
+	{"reserve", buffer_reserve},
+	{"truncate", buffer_truncate},
+	{"as", typedarray_as},
+	{"array", typedarray_array},
+	{"setThreads", vecmath_setThreads},
+	{"fill", buffer_fill},
+	{"copyFrom", buffer_copyFrom},
+	{"compare", buffer_compare},
+	{"find", buffer_find},
+	{"xor", buffer_xor},
+	{"popcount", buffer_popcount},
+	{"byteswap", convert_byteswap},
+	{"ring", ring_ring},
+	{"text", text_text},
 	{"length", buffer__length},
 	{"setUint8", buffer_setUint8},
 	{"setInt8", buffer_setInt8},
@@ -540,6 +1628,33 @@ static const struct luaL_Reg buffer_f[] = {
 	{"getInt32", buffer_getInt32},
 	{"getUint64", buffer_getUint64},
 	{"getInt64", buffer_getInt64},
+	{"readUint8", buffer_readUint8},
+	{"readInt8", buffer_readInt8},
+	{"readUint16", buffer_readUint16},
+	{"readInt16", buffer_readInt16},
+	{"readUint32", buffer_readUint32},
+	{"readInt32", buffer_readInt32},
+	{"readUint64", buffer_readUint64},
+	{"readInt64", buffer_readInt64},
+	{"readFloat32", buffer_readFloat32},
+	{"readFloat64", buffer_readFloat64},
+	{"writeUint8", buffer_writeUint8},
+	{"writeInt8", buffer_writeInt8},
+	{"writeUint16", buffer_writeUint16},
+	{"writeInt16", buffer_writeInt16},
+	{"writeUint32", buffer_writeUint32},
+	{"writeInt32", buffer_writeInt32},
+	{"writeUint64", buffer_writeUint64},
+	{"writeInt64", buffer_writeInt64},
+	{"writeFloat32", buffer_writeFloat32},
+	{"writeFloat64", buffer_writeFloat64},
+	{"atomicLoad", buffer_atomicLoad},
+	{"atomicStore", buffer_atomicStore},
+	{"atomicAdd", buffer_atomicAdd},
+	{"atomicExchange", buffer_atomicExchange},
+	{"atomicCas", buffer_atomicCas},
+	{"wait", buffer_wait},
+	{"notify", buffer_notify},
 	{NULL, NULL}
 };
 
@@ -548,6 +1663,7 @@ static const struct luaL_Reg buffer_mt[] = {
 	{"__newindex", buffer__newindex},
 	{"__tostring", buffer__tostring},
 	{"__len", buffer__length},
+	{"__gc", buffer__gc},
 	{NULL, NULL}
 };
 
@@ -575,5 +1691,22 @@ LUAMOD_API int luaopen_Buffer(lua_State *L){
 	// add Buffer and Value table as upvalue
 	lua_pop(L, 1); // stack: {table, ...}
 	
+	typedarray_register(L);
+	schema_register(L);
+	hash_register(L);
+	lz4_register(L);
+	bits_register(L);
+	ring_register(L);
+	text_register(L);
+	buffer_registerio(L);
+	
+	/* Pick the byte kernels, and expose which ones for benchmarks */
+	bytes_init();
+	hash_init();
+	encoding_init();
+	convert_init();
+	lua_pushstring(L, bytes_isa());
+	lua_setfield(L, -2, "simd");
+	
 	return 1;
 }
@@ -7,14 +7,34 @@
 
 /* C library definitions */
 
+typedef enum BufferKind {
+	BUFFER_FIXED,    // owns its data, stored after the struct
+	BUFFER_VIEW,     // points into the data of another buffer
+	BUFFER_GROWABLE, // owns heap-allocated data, which can grow
+	BUFFER_MAPPED,   // owns a memory-mapped file
+} BufferKind;
+
+typedef struct Buffer Buffer; // forward-declare
+
 typedef struct Buffer {
 	size_t size;     // size of the buffer
 	uint8_t *buffer; // pointer to the data, can point to its own data or somewhere else
+	size_t capacity; // number of bytes available at buffer, at least size
+	BufferKind kind;
+	Buffer *owner;   // for a view, the growable buffer that owns the data, or NULL
+	size_t views;    // for a growable buffer, the views that keep its data from moving
 	uint8_t data[];  // the actual data
 } Buffer;
 
 Buffer *buffer_newbuffer(lua_State *L, lua_Integer size);
+Buffer *buffer_newgrowable(lua_State *L, size_t capacity);
+void buffer_reserve_capacity(lua_State *L, Buffer *buffer, size_t capacity);
+uint8_t *buffer_grow(lua_State *L, Buffer *buffer, size_t size);
+Buffer *buffer_addview(Buffer *buffer);
+void buffer_removeview(Buffer *owner);
+const uint8_t *buffer_checkbytes(lua_State *L, int idx, size_t *size);
 int buffer_within(Buffer *buffer, lua_Integer position);
+int buffer_within_range(Buffer *buffer, lua_Integer index, size_t size);
 void buffer_set_with_size(Buffer *buffer, lua_Integer index, lua_Integer value, size_t size, int littleEndian);
 lua_Integer buffer_get_with_size(Buffer *buffer, lua_Integer index, size_t size, int littleEndian, int isSigned);
 
@@ -22,11 +42,26 @@ lua_Integer buffer_get_with_size(Buffer *buffer, lua_Integer index, size_t size,
 
 int buffer_of(lua_State *L);
 int buffer_new(lua_State *L);
+int buffer_builder(lua_State *L);
+int buffer_map(lua_State *L);
 int buffer__call(lua_State *L);
 int buffer_set(lua_State *L);
 int buffer_get(lua_State *L);
 int buffer_stream(lua_State *L);
 int buffer_view(lua_State *L);
+int buffer_append(lua_State *L);
+int buffer_reserve(lua_State *L);
+int buffer_truncate(lua_State *L);
+int buffer_sync(lua_State *L);
+int buffer_advise(lua_State *L);
+int buffer_fileReadInto(lua_State *L);
+int buffer_fileWriteFrom(lua_State *L);
+int buffer_fill(lua_State *L);
+int buffer_copyFrom(lua_State *L);
+int buffer_compare(lua_State *L);
+int buffer_find(lua_State *L);
+int buffer_xor(lua_State *L);
+int buffer_popcount(lua_State *L);
 
 int buffer_setUint8(lua_State *L);
 int buffer_setInt8(lua_State *L);
@@ -46,11 +81,42 @@ int buffer_getInt32(lua_State *L);
 int buffer_getUint64(lua_State *L);
 int buffer_getInt64(lua_State *L);
 
+int buffer_readUint8(lua_State *L);
+int buffer_readInt8(lua_State *L);
+int buffer_readUint16(lua_State *L);
+int buffer_readInt16(lua_State *L);
+int buffer_readUint32(lua_State *L);
+int buffer_readInt32(lua_State *L);
+int buffer_readUint64(lua_State *L);
+int buffer_readInt64(lua_State *L);
+int buffer_readFloat32(lua_State *L);
+int buffer_readFloat64(lua_State *L);
+
+int buffer_writeUint8(lua_State *L);
+int buffer_writeInt8(lua_State *L);
+int buffer_writeUint16(lua_State *L);
+int buffer_writeInt16(lua_State *L);
+int buffer_writeUint32(lua_State *L);
+int buffer_writeInt32(lua_State *L);
+int buffer_writeUint64(lua_State *L);
+int buffer_writeInt64(lua_State *L);
+int buffer_writeFloat32(lua_State *L);
+int buffer_writeFloat64(lua_State *L);
+
+int buffer_atomicLoad(lua_State *L);
+int buffer_atomicStore(lua_State *L);
+int buffer_atomicAdd(lua_State *L);
+int buffer_atomicExchange(lua_State *L);
+int buffer_atomicCas(lua_State *L);
+int buffer_wait(lua_State *L);
+int buffer_notify(lua_State *L);
+
 /* Lua metamethods */
 
 int buffer__index(lua_State *L);
 int buffer__newindex(lua_State *L);
 int buffer__tostring(lua_State *L);
 int buffer__length(lua_State *L);
+int buffer__gc(lua_State *L);
 
 LUAMOD_API int luaopen_Buffer(lua_State *L);
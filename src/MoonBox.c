@@ -6,6 +6,7 @@
 
 #include "MoonBox.h"
 #include "event.h"
+#include "alloc.h"
 
 int mb_error_handler(lua_State *L){
 	luaL_traceback(L, L, lua_tostring(L, -1), 2);
@@ -45,8 +46,24 @@ int mb_os_sleep(lua_State *L){
 	return 0;
 }
 
+// Same as the panic function of luaL_newstate
+static int mb_panic(lua_State *L){
+	fprintf(stderr, "PANIC: unprotected error in call to Lua API (%s)\n", lua_tostring(L, -1));
+	return 0; // return to Lua to abort
+}
+
 lua_State *mb_init(){
-	lua_State *L = luaL_newstate();
+	/* Create state with its own allocator */
+	Allocator *allocator = alloc_new();
+	lua_State *L = lua_newstate(alloc_lua, allocator);
+	if(L == NULL){
+		alloc_free(allocator);
+		return NULL;
+	}
+	lua_atpanic(L, mb_panic);
+	lua_pushlightuserdata(L, allocator);
+	lua_setfield(L, LUA_REGISTRYINDEX, "mb_allocator");
+	
 	luaL_openlibs(L); // Open standard libraries (math, string, table, ...)
 	
 	/* Set cpath and path */
@@ -90,6 +107,13 @@ lua_State *mb_init(){
 	return L;
 }
 
+void mb_close(lua_State *L){
+	void *allocator;
+	lua_Alloc f = lua_getallocf(L, &allocator);
+	lua_close(L);
+	if(f == alloc_lua) alloc_free(allocator);
+}
+
 int mb_load(lua_State *L, const char *file){
 	if(luaL_loadfile(L, file) == LUA_OK){
 		return 1;
@@ -0,0 +1,347 @@
+/***
+ * A `Schema` describes the layout of a binary record, to move whole records
+ * between a `Buffer` and Lua tables in one call.
+ * 
+ * A schema is a list of fields, each a table `{name, type}`. Fields are
+ * packed one after the other, without padding. The types are `"u8"`, `"i8"`,
+ * `"u16"`, `"i16"`, `"u32"`, `"i32"`, `"u64"`, `"i64"` for integers and
+ * `"f32"`, `"f64"` for floats, optionally followed by `"le"` for little endian
+ * or `"be"` for big endian (the default, like `Buffer:readUint16`).
+ * `{name, "bytes", n}` is a string of `n` bytes.
+ * 
+ * @classmod Schema
+ * @see Buffer
+ * @usage
+ * local Point = Buffer.schema{ {"id", "u32le"}, {"x", "f32le"}, {"y", "f32le"} }
+ * local points = Point:readMany(Buffer.map("points.bin"))
+ * print(#Point, points[1].id, points[1].x)
+ */
+
+#include <string.h> // for memcpy, memset, strcmp
+#include <stdlib.h> // for strtol
+#include <stdint.h> // for SIZE_MAX
+#include <limits.h> // for INT_MAX
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "Schema.h"
+
+/* C library definitions */
+
+Schema *schema_check(lua_State *L, int idx){
+	return luaL_checkudata(L, idx, "Schema");
+}
+
+// Parse a type name like "u16le" into field, returns 0 when it is invalid
+static int parse_type(const char *name, SchemaField *field){
+	field->littleEndian = 0;
+	switch(name[0]){
+		case 'u': field->kind = SCHEMA_UINT; break;
+		case 'i': field->kind = SCHEMA_INT; break;
+		case 'f': field->kind = SCHEMA_FLOAT; break;
+		default: return 0;
+	}
+	char *end;
+	long bits = strtol(name+1, &end, 10);
+	if(end == name+1) return 0;
+	if(field->kind == SCHEMA_FLOAT ? (bits != 32 && bits != 64)
+			: (bits != 8 && bits != 16 && bits != 32 && bits != 64)) return 0;
+	field->size = bits / 8;
+	
+	if(strcmp(end, "le") == 0) field->littleEndian = 1;
+	else if(*end != '\0' && strcmp(end, "be") != 0) return 0;
+	return 1;
+}
+
+static uint64_t load_raw(const uint8_t *p, size_t size, int littleEndian){
+	uint64_t value = 0;
+	if(littleEndian){
+		for(size_t i = size; i-- > 0; ) value = (value << 8) | p[i];
+	}else{
+		for(size_t i = 0; i < size; i++) value = (value << 8) | p[i];
+	}
+	return value;
+}
+
+static void store_raw(uint8_t *p, size_t size, int littleEndian, uint64_t value){
+	for(size_t i = 0; i < size; i++){
+		p[littleEndian ? i : size-1-i] = (uint8_t)(value >> i*8);
+	}
+}
+
+// Push the value of a field in the record at p
+static void push_field(lua_State *L, SchemaField *field, const uint8_t *p){
+	p += field->offset;
+	if(field->kind == SCHEMA_BYTES){
+		lua_pushlstring(L, (const char*)p, field->size);
+		return;
+	}
+	uint64_t raw = load_raw(p, field->size, field->littleEndian);
+	switch(field->kind){
+		case SCHEMA_INT:
+			// Sign-extend
+			if(field->size < 8 && (raw >> (field->size*8 - 1)) & 1) raw |= ~(uint64_t)0 << field->size*8;
+			lua_pushinteger(L, (lua_Integer)raw);
+			break;
+		case SCHEMA_FLOAT:
+			if(field->size == 4){
+				uint32_t raw32 = (uint32_t)raw;
+				float value;
+				memcpy(&value, &raw32, sizeof(value));
+				lua_pushnumber(L, value);
+			}else{
+				double value;
+				memcpy(&value, &raw, sizeof(value));
+				lua_pushnumber(L, value);
+			}
+			break;
+		default:
+			lua_pushinteger(L, (lua_Integer)raw);
+			break;
+	}
+}
+
+// Store the value at the top of the stack as a field in the record at p
+// Returns 0 when the value has the wrong type
+static int store_field(lua_State *L, SchemaField *field, uint8_t *p){
+	p += field->offset;
+	int ok;
+	uint64_t raw;
+	switch(field->kind){
+		case SCHEMA_BYTES: {
+			size_t length;
+			const char *str = (lua_type(L, -1) == LUA_TSTRING) ? lua_tolstring(L, -1, &length) : NULL;
+			if(str == NULL) return 0;
+			if(length > field->size) length = field->size;
+			memcpy(p, str, length);
+			memset(p + length, 0, field->size - length);
+			return 1;
+		}
+		case SCHEMA_FLOAT: {
+			lua_Number value = lua_tonumberx(L, -1, &ok);
+			if(field->size == 4){
+				float value32 = (float)value;
+				uint32_t raw32;
+				memcpy(&raw32, &value32, sizeof(raw32));
+				raw = raw32;
+			}else{
+				memcpy(&raw, &value, sizeof(raw));
+			}
+			break;
+		}
+		default:
+			raw = (uint64_t)lua_tointegerx(L, -1, &ok);
+			break;
+	}
+	if(ok) store_raw(p, field->size, field->littleEndian, raw);
+	return ok;
+}
+
+// Read the record at p into the table at the top of the stack, names at names_idx
+static void read_record(lua_State *L, Schema *schema, const uint8_t *p, int names_idx){
+	for(size_t i = 0; i < schema->n_fields; i++){
+		lua_rawgeti(L, names_idx, i+1);
+		push_field(L, &schema->fields[i], p);
+		lua_rawset(L, -3);
+	}
+}
+
+// Get the buffer at idx and check that a record at offset (at idx+1) fits
+static Buffer *check_record(lua_State *L, Schema *schema, int idx, lua_Integer *offset){
+	Buffer *buffer = luaL_checkudata(L, idx, "Buffer");
+	*offset = luaL_optinteger(L, idx+1, 0);
+	luaL_argcheck(L, buffer_within_range(buffer, *offset, schema->size), idx+1, "record out of bounds");
+	return buffer;
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a `Schema` from a list of fields.
+ * Part of the `Buffer` module.
+ * @function Buffer.schema
+ * @tparam table fields a list of `{name, type}` or `{name, "bytes", n}` tables
+ * @treturn Schema
+ */
+int schema_new(lua_State *L){
+	luaL_checktype(L, 1, LUA_TTABLE);
+	lua_Integer n = luaL_len(L, 1);
+	luaL_argcheck(L, n > 0, 1, "a schema needs at least one field");
+	luaL_argcheck(L, n <= INT_MAX && (size_t)n <= (SIZE_MAX - sizeof(Schema)) / sizeof(SchemaField), 1, "too many fields");
+	
+	Schema *schema = lua_newuserdata(L, sizeof(Schema) + n * sizeof(SchemaField)); // stack: {Schema, fields}
+	schema->size = 0;
+	schema->n_fields = n;
+	lua_createtable(L, n, 0); // stack: {names, Schema, fields}
+	
+	for(lua_Integer i = 1; i <= n; i++){
+		SchemaField *field = &schema->fields[i-1];
+		if(lua_geti(L, 1, i) != LUA_TTABLE){ // stack: {field, names, Schema, fields}
+			return luaL_error(L, "field %d is not a table", (int)i);
+		}
+		if(lua_geti(L, -1, 1) == LUA_TNIL){ // stack: {name, field, names, Schema, fields}
+			return luaL_error(L, "field %d has no name", (int)i);
+		}
+		lua_rawseti(L, -3, i); // stack: {field, names, Schema, fields}
+		
+		lua_geti(L, -1, 2); // stack: {type, field, names, Schema, fields}
+		const char *type = lua_tostring(L, -1);
+		if(type != NULL && strcmp(type, "bytes") == 0){
+			lua_geti(L, -2, 3); // stack: {n, type, field, names, Schema, fields}
+			lua_Integer size = lua_tointeger(L, -1);
+			if(size <= 0) return luaL_error(L, "field %d needs a size > 0", (int)i);
+			field->kind = SCHEMA_BYTES;
+			field->size = size;
+			field->littleEndian = 0;
+			lua_pop(L, 1);
+		}else if(type == NULL || !parse_type(type, field)){
+			return luaL_error(L, "field %d has an invalid type", (int)i);
+		}
+		if(field->size > (size_t)LUA_MAXINTEGER - schema->size){
+			return luaL_error(L, "field %d makes the record too large", (int)i);
+		}
+		field->offset = schema->size;
+		schema->size += field->size;
+		lua_pop(L, 2); // stack: {names, Schema, fields}
+	}
+	
+	lua_setuservalue(L, -2); // stack: {Schema, fields}
+	luaL_setmetatable(L, "Schema");
+	return 1;
+}
+
+/// @type Schema
+
+/***
+ * Read a record from a `Buffer` into a table.
+ * @function read
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset
+ * @tparam[opt] table into the table to fill in, to avoid creating a new one
+ * @treturn table
+ */
+int schema_read(lua_State *L){
+	Schema *schema = schema_check(L, 1);
+	lua_Integer offset;
+	Buffer *buffer = check_record(L, schema, 2, &offset);
+	lua_getuservalue(L, 1); // stack: {names, ...}
+	int names_idx = lua_gettop(L);
+	if(lua_istable(L, 4)){
+		lua_pushvalue(L, 4);
+	}else{
+		lua_createtable(L, 0, schema->n_fields);
+	}
+	read_record(L, schema, buffer->buffer + offset, names_idx);
+	return 1;
+}
+
+/***
+ * Write a record from a table into a `Buffer`.
+ * Byte fields shorter than their size are padded with zeroes.
+ * @function write
+ * @tparam Buffer buffer
+ * @tparam number offset
+ * @tparam table record
+ */
+int schema_write(lua_State *L){
+	Schema *schema = schema_check(L, 1);
+	lua_Integer offset;
+	Buffer *buffer = check_record(L, schema, 2, &offset);
+	luaL_checktype(L, 4, LUA_TTABLE);
+	lua_getuservalue(L, 1); // stack: {names, ...}
+	
+	for(size_t i = 0; i < schema->n_fields; i++){
+		lua_rawgeti(L, -1, i+1); // stack: {name, names, ...}
+		lua_pushvalue(L, -1);
+		lua_gettable(L, 4); // stack: {value, name, names, ...}
+		if(!store_field(L, &schema->fields[i], buffer->buffer + offset)){
+			return luaL_error(L, "invalid value for field '%s'", luaL_tolstring(L, -2, NULL));
+		}
+		lua_pop(L, 2); // stack: {names, ...}
+	}
+	return 0;
+}
+
+/***
+ * Read consecutive records from a `Buffer` into a list of tables.
+ * @function readMany
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset
+ * @tparam[optchain] number count defaults to as many records as fit
+ * @tparam[optchain] number stride the number of bytes from one record to the
+ * next, defaults to the size of the schema
+ * @treturn table
+ */
+int schema_readMany(lua_State *L){
+	Schema *schema = schema_check(L, 1);
+	Buffer *buffer = luaL_checkudata(L, 2, "Buffer");
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	lua_Integer stride = luaL_optinteger(L, 5, schema->size);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, 3, "out of bounds");
+	luaL_argcheck(L, stride > 0, 5, "stride must be > 0");
+	
+	size_t available = buffer->size - offset;
+	lua_Integer max = (available < schema->size) ? 0 : (available - schema->size) / stride + 1;
+	lua_Integer count = luaL_opt(L, luaL_checkinteger, 4, max);
+	luaL_argcheck(L, count >= 0 && count <= max, 4, "out of bounds");
+	
+	lua_getuservalue(L, 1); // stack: {names, ...}
+	int names_idx = lua_gettop(L);
+	lua_createtable(L, count, 0); // stack: {records, names, ...}
+	for(lua_Integer i = 0; i < count; i++){
+		lua_createtable(L, 0, schema->n_fields);
+		read_record(L, schema, buffer->buffer + offset + i*stride, names_idx);
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
+/***
+ * __tostring metamethod.
+ * @function __tostring
+ * @treturn string
+ */
+int schema__tostring(lua_State *L){
+	Schema *schema = schema_check(L, 1);
+	lua_pushfstring(L, "Schema(%d fields, %d bytes)", (int)schema->n_fields, (int)schema->size);
+	return 1;
+}
+
+/***
+ * __len metamethod, returns the size of a record in bytes.
+ * @function __len
+ * @treturn number
+ */
+int schema__length(lua_State *L){
+	Schema *schema = schema_check(L, 1);
+	lua_pushinteger(L, schema->size);
+	return 1;
+}
+
+static const struct luaL_Reg schema_f[] = {
+	{"read", schema_read},
+	{"write", schema_write},
+	{"readMany", schema_readMany},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg schema_mt[] = {
+	{"__tostring", schema__tostring},
+	{"__len", schema__length},
+	{NULL, NULL}
+};
+
+void schema_register(lua_State *L){
+	if(!luaL_newmetatable(L, "Schema")){ // stack: {metatable, ...}
+		lua_pop(L, 1);
+		return; // already registered
+	}
+	luaL_setfuncs(L, schema_mt, 0);
+	lua_newtable(L); // stack: {methods, metatable, ...}
+	luaL_setfuncs(L, schema_f, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1); // stack: {...}
+}
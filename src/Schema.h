@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+typedef enum SchemaKind {
+	SCHEMA_UINT,
+	SCHEMA_INT,
+	SCHEMA_FLOAT,
+	SCHEMA_BYTES,
+} SchemaKind;
+
+typedef struct SchemaField {
+	size_t offset; // from the start of the record
+	size_t size;   // in bytes
+	SchemaKind kind;
+	int littleEndian;
+} SchemaField;
+
+// A record layout, with the field names in the user value table
+// (at the same index as the field, starting at 1)
+typedef struct Schema {
+	size_t size; // of a whole record
+	size_t n_fields;
+	SchemaField fields[];
+} Schema;
+
+Schema *schema_check(lua_State *L, int idx);
+
+// Create the Schema metatable
+void schema_register(lua_State *L);
+
+/* Lua API definitions */
+
+int schema_new(lua_State *L);
+int schema_read(lua_State *L);
+int schema_write(lua_State *L);
+int schema_readMany(lua_State *L);
+
+/* Lua metamethods */
+
+int schema__tostring(lua_State *L);
+int schema__length(lua_State *L);
@@ -0,0 +1,432 @@
+/***
+ * A `TypedArray` is a view of numbers of one type inside a `Buffer`.
+ * 
+ * Elements use the native byte order, and are indexed from 0, like the bytes
+ * of a `Buffer`. Changing an element changes the underlying `Buffer`, and the
+ * other way around. A `TypedArray` keeps its `Buffer` alive.
+ * 
+ * Supported types are `"int8"`, `"uint8"`, `"int16"`, `"uint16"`, `"int32"`,
+ * `"uint32"`, `"int64"`, `"uint64"`, `"float32"` and `"float64"`.
+ * 
+ * @classmod TypedArray
+ * @see Buffer
+ * @usage
+ * local samples = Buffer.array("float32", {0.5, 0.25, -1})
+ * samples[1] = 0.75
+ * print(#samples, samples:totable()[2]) --> 3	0.75
+ */
+
+#include <string.h> // for memcpy, memset, memmove
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "TypedArray.h"
+#include "vecmath.h"
+#include "convert.h"
+#include "sort.h"
+
+/* C library definitions */
+
+const char *const typedarray_types[] = {
+	"int8", "uint8", "int16", "uint16", "int32", "uint32",
+	"int64", "uint64", "float32", "float64", NULL
+};
+
+size_t typedarray_size(TypedArrayType type){
+	static const size_t sizes[] = {1, 1, 2, 2, 4, 4, 8, 8, 4, 8};
+	return sizes[type];
+}
+
+int typedarray_contiguous(TypedArray *array){
+	return array->stride == typedarray_size(array->type);
+}
+
+TypedArray *typedarray_check(lua_State *L, int idx){
+	return luaL_checkudata(L, idx, "TypedArray");
+}
+
+// Push a new TypedArray, which keeps the Buffer at owner alive
+static TypedArray *push_array(lua_State *L, uint8_t *data, size_t length,
+		size_t stride, TypedArrayType type, int owner){
+	owner = lua_absindex(L, owner);
+	TypedArray *array = lua_newuserdata(L, sizeof(TypedArray));
+	array->data = data;
+	array->length = length;
+	array->stride = stride;
+	array->type = type;
+	array->owner = buffer_addview(lua_touserdata(L, owner));
+	lua_pushvalue(L, owner);
+	lua_setuservalue(L, -2);
+	luaL_setmetatable(L, "TypedArray");
+	return array;
+}
+
+TypedArray *typedarray_new(lua_State *L, TypedArrayType type, size_t length){
+	size_t size = typedarray_size(type);
+	Buffer *buffer = buffer_newbuffer(L, length * size); // stack: {Buffer}
+	memset(buffer->buffer, 0, buffer->size);
+	TypedArray *array = push_array(L, buffer->buffer, length, size, type, -1);
+	lua_remove(L, -2); // stack: {TypedArray}
+	return array;
+}
+
+#define TYPEDARRAY_LOAD(ctype, p) { ctype x; memcpy(&x, (p), sizeof(x)); return x; }
+#define TYPEDARRAY_STORE(ctype, p, v) { ctype x = (ctype)(v); memcpy((p), &x, sizeof(x)); return; }
+
+lua_Integer typedarray_get_integer(TypedArray *array, size_t i){
+	uint8_t *p = typedarray_at(array, i);
+	switch(array->type){
+		case TYPEDARRAY_INT8: TYPEDARRAY_LOAD(int8_t, p)
+		case TYPEDARRAY_UINT8: TYPEDARRAY_LOAD(uint8_t, p)
+		case TYPEDARRAY_INT16: TYPEDARRAY_LOAD(int16_t, p)
+		case TYPEDARRAY_UINT16: TYPEDARRAY_LOAD(uint16_t, p)
+		case TYPEDARRAY_INT32: TYPEDARRAY_LOAD(int32_t, p)
+		case TYPEDARRAY_UINT32: TYPEDARRAY_LOAD(uint32_t, p)
+		case TYPEDARRAY_INT64: TYPEDARRAY_LOAD(int64_t, p)
+		case TYPEDARRAY_UINT64: TYPEDARRAY_LOAD(uint64_t, p)
+		default: {
+			lua_Integer value;
+			if(!lua_numbertointeger(typedarray_get_number(array, i), &value)) value = 0;
+			return value;
+		}
+	}
+}
+
+lua_Number typedarray_get_number(TypedArray *array, size_t i){
+	uint8_t *p = typedarray_at(array, i);
+	switch(array->type){
+		case TYPEDARRAY_FLOAT32: TYPEDARRAY_LOAD(float, p)
+		case TYPEDARRAY_FLOAT64: TYPEDARRAY_LOAD(double, p)
+		default: return (lua_Number)typedarray_get_integer(array, i);
+	}
+}
+
+void typedarray_put_integer(TypedArray *array, size_t i, lua_Integer value){
+	uint8_t *p = typedarray_at(array, i);
+	switch(array->type){
+		case TYPEDARRAY_INT8:
+		case TYPEDARRAY_UINT8: TYPEDARRAY_STORE(uint8_t, p, value)
+		case TYPEDARRAY_INT16:
+		case TYPEDARRAY_UINT16: TYPEDARRAY_STORE(uint16_t, p, value)
+		case TYPEDARRAY_INT32:
+		case TYPEDARRAY_UINT32: TYPEDARRAY_STORE(uint32_t, p, value)
+		case TYPEDARRAY_INT64:
+		case TYPEDARRAY_UINT64: TYPEDARRAY_STORE(uint64_t, p, value)
+		case TYPEDARRAY_FLOAT32: TYPEDARRAY_STORE(float, p, value)
+		case TYPEDARRAY_FLOAT64: TYPEDARRAY_STORE(double, p, value)
+	}
+}
+
+void typedarray_put_number(TypedArray *array, size_t i, lua_Number value){
+	uint8_t *p = typedarray_at(array, i);
+	switch(array->type){
+		case TYPEDARRAY_FLOAT32: TYPEDARRAY_STORE(float, p, value)
+		case TYPEDARRAY_FLOAT64: TYPEDARRAY_STORE(double, p, value)
+		default: {
+			lua_Integer integer;
+			if(!lua_numbertointeger(value, &integer)) integer = 0;
+			typedarray_put_integer(array, i, integer);
+		}
+	}
+}
+
+void typedarray_push(lua_State *L, TypedArray *array, size_t i){
+	if(typedarray_isfloat(array->type)){
+		lua_pushnumber(L, typedarray_get_number(array, i));
+	}else{
+		lua_pushinteger(L, typedarray_get_integer(array, i));
+	}
+}
+
+// Store the value at idx as element i, returns 0 when it is not a number
+// or when it has no integer representation for an integer type
+static int store(lua_State *L, TypedArray *array, size_t i, int idx){
+	int isnum;
+	if(typedarray_isfloat(array->type)){
+		lua_Number value = lua_tonumberx(L, idx, &isnum);
+		if(isnum) typedarray_put_number(array, i, value);
+	}else{
+		lua_Integer value = lua_tointegerx(L, idx, &isnum);
+		if(isnum) typedarray_put_integer(array, i, value);
+	}
+	return isnum;
+}
+
+void typedarray_store(lua_State *L, TypedArray *array, size_t i, int idx){
+	if(!store(L, array, i, idx)){
+		luaL_argerror(L, idx, typedarray_isfloat(array->type) ? "expected number" : "expected integer");
+	}
+}
+
+// Store the elements of the table at idx, starting at element offset
+static void store_table(lua_State *L, TypedArray *array, size_t offset, int idx){
+	lua_Integer n = luaL_len(L, idx);
+	luaL_argcheck(L, offset + n <= array->length, idx, "table does not fit");
+	for(lua_Integer i = 1; i <= n; i++){
+		lua_geti(L, idx, i);
+		if(!store(L, array, offset + i - 1, -1)){
+			luaL_error(L, "table element %d is not %s", (int)i,
+				typedarray_isfloat(array->type) ? "a number" : "an integer");
+		}
+		lua_pop(L, 1);
+	}
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a new `TypedArray` with its own `Buffer`.
+ * Part of the `Buffer` module.
+ * @function Buffer.array
+ * @tparam string type
+ * @tparam number|table contents the number of elements (which start at 0),
+ * or a table with the elements
+ * @treturn TypedArray
+ */
+int typedarray_array(lua_State *L){
+	TypedArrayType type = luaL_checkoption(L, 1, NULL, typedarray_types);
+	int fromTable = lua_istable(L, 2);
+	lua_Integer length = fromTable ? luaL_len(L, 2) : luaL_checkinteger(L, 2);
+	luaL_argcheck(L, length >= 0, 2, "length must be >= 0");
+	luaL_argcheck(L, length <= LUA_MAXINTEGER / (lua_Integer)typedarray_size(type), 2, "length too large");
+	TypedArray *array = typedarray_new(L, type, length);
+	if(fromTable) store_table(L, array, 0, 2);
+	return 1;
+}
+
+/***
+ * Create a `TypedArray` view of a `Buffer`.
+ * Part of the `Buffer` module, called as `buffer:as(type, ...)`.
+ * @function Buffer:as
+ * @tparam string type
+ * @tparam[opt=0] number offset the byte offset of the first element
+ * @tparam[optchain] number length the number of elements, defaults to as many
+ * as fit in the rest of the buffer
+ * @tparam[optchain] number stride the number of bytes from one element to the
+ * next, defaults to the element size
+ * @treturn TypedArray
+ * @usage local xs = buffer:as("float32", 0, nil, 8) -- every other float
+ */
+int typedarray_as(lua_State *L){
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	TypedArrayType type = luaL_checkoption(L, 2, NULL, typedarray_types);
+	size_t size = typedarray_size(type);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	lua_Integer stride = luaL_optinteger(L, 5, size);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, 3, "out of bounds");
+	luaL_argcheck(L, stride > 0, 5, "stride must be > 0");
+	
+	size_t available = buffer->size - offset;
+	lua_Integer max = (available < size) ? 0 : (available - size) / stride + 1;
+	lua_Integer length = luaL_opt(L, luaL_checkinteger, 4, max);
+	luaL_argcheck(L, length >= 0 && length <= max, 4, "out of bounds");
+	
+	push_array(L, buffer->buffer + offset, length, stride, type, 1);
+	return 1;
+}
+
+/***
+ * Get the element type.
+ * @function type
+ * @treturn string
+ */
+int typedarray_type(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_pushstring(L, typedarray_types[array->type]);
+	return 1;
+}
+
+/***
+ * Get the `Buffer` this array is a view of.
+ * @function buffer
+ * @treturn Buffer
+ */
+int typedarray_buffer(lua_State *L){
+	typedarray_check(L, 1);
+	lua_getuservalue(L, 1);
+	return 1;
+}
+
+/***
+ * Create a view of a part of this array.
+ * The new array shares the elements with this one.
+ * @function slice
+ * @tparam[opt=0] number from the index of the first element
+ * @tparam[optchain] number length defaults to the rest of the array
+ * @tparam[optchain=1] number step take every step-th element
+ * @treturn TypedArray
+ */
+int typedarray_slice(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_Integer from = luaL_optinteger(L, 2, 0);
+	lua_Integer step = luaL_optinteger(L, 4, 1);
+	luaL_argcheck(L, from >= 0 && (size_t)from <= array->length, 2, "out of bounds");
+	luaL_argcheck(L, step > 0, 4, "step must be > 0");
+	lua_Integer max = (array->length - from + step - 1) / step;
+	lua_Integer length = luaL_opt(L, luaL_checkinteger, 3, max);
+	luaL_argcheck(L, length >= 0 && length <= max, 3, "out of bounds");
+	
+	lua_getuservalue(L, 1); // stack: {Buffer, ...}
+	push_array(L, typedarray_at(array, from), length, array->stride * step, array->type, -1);
+	return 1;
+}
+
+/***
+ * Copy elements from a table or another `TypedArray` into this array.
+ * Values are converted to the element type of this array.
+ * @function set
+ * @tparam table|TypedArray source
+ * @tparam[opt=0] number offset the index of the first element to set
+ */
+int typedarray_set(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_Integer offset = luaL_optinteger(L, 3, 0);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= array->length, 3, "out of bounds");
+	
+	if(lua_istable(L, 2)){
+		store_table(L, array, offset, 2);
+		return 0;
+	}
+	
+	TypedArray *source = typedarray_check(L, 2);
+	luaL_argcheck(L, offset + source->length <= array->length, 2, "source does not fit");
+	if(source->type == array->type && typedarray_contiguous(source) && typedarray_contiguous(array)){
+		memmove(typedarray_at(array, offset), source->data, source->length * source->stride);
+	}else{
+		convert_elements(typedarray_at(array, offset), array->stride, array->type,
+			source->data, source->stride, source->type, source->length, 1, 0);
+	}
+	return 0;
+}
+
+/***
+ * Convert the elements to a table.
+ * Like any Lua sequence, the table starts at index 1.
+ * @function totable
+ * @treturn table
+ */
+int typedarray_totable(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_createtable(L, array->length, 0);
+	for(size_t i = 0; i < array->length; i++){
+		typedarray_push(L, array, i);
+		lua_rawseti(L, -2, i+1);
+	}
+	return 1;
+}
+
+/***
+ * __index metamethod, returns the element at the given index, or the method with the given name.
+ * @function __index
+ * @tparam number|string key
+ * @treturn number|function|nil
+ */
+int typedarray__index(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	if(lua_type(L, 2) == LUA_TNUMBER){
+		int isnum;
+		lua_Integer i = lua_tointegerx(L, 2, &isnum);
+		if(!isnum || i < 0 || (size_t)i >= array->length) return 0;
+		typedarray_push(L, array, i);
+	}else{
+		lua_gettable(L, lua_upvalueindex(1));
+	}
+	return 1;
+}
+
+/***
+ * __newindex metamethod, sets the element at the given index.
+ * @function __newindex
+ * @tparam number key
+ * @tparam number value
+ */
+int typedarray__newindex(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_Integer i = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, i >= 0 && (size_t)i < array->length, 2, "index out of bounds");
+	typedarray_store(L, array, i, 3);
+	return 0;
+}
+
+/***
+ * __tostring metamethod.
+ * @function __tostring
+ * @treturn string
+ */
+int typedarray__tostring(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_pushfstring(L, "TypedArray(%s, %d)", typedarray_types[array->type], (int)array->length);
+	return 1;
+}
+
+/***
+ * __len metamethod, returns the number of elements.
+ * @function __len
+ * @treturn number
+ */
+int typedarray__length(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	lua_pushinteger(L, array->length);
+	return 1;
+}
+
+/***
+ * __gc metamethod, lets a growable `Buffer` this array points into move again.
+ * @function __gc
+ */
+int typedarray__gc(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	buffer_removeview(array->owner);
+	array->owner = NULL;
+	return 0;
+}
+
+static const struct luaL_Reg typedarray_f[] = {
+	{"type", typedarray_type},
+	{"buffer", typedarray_buffer},
+	{"slice", typedarray_slice},
+	{"set", typedarray_set},
+	{"totable", typedarray_totable},
+	{"convert", convert_convert},
+	{"byteswap", convert_byteswap},
+	{"sort", sort_sort},
+	{"argsort", sort_argsort},
+	{"lowerBound", sort_lowerBound},
+	{"upperBound", sort_upperBound},
+	{"binarySearch", sort_binarySearch},
+	{"length", typedarray__length},
+	{"add", vecmath_add},
+	{"sub", vecmath_sub},
+	{"mul", vecmath_mul},
+	{"scale", vecmath_scale},
+	{"clamp", vecmath_clamp},
+	{"sum", vecmath_sum},
+	{"min", vecmath_min},
+	{"max", vecmath_max},
+	{"dot", vecmath_dot},
+	{"mean", vecmath_mean},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg typedarray_mt[] = {
+	{"__index", typedarray__index},
+	{"__newindex", typedarray__newindex},
+	{"__tostring", typedarray__tostring},
+	{"__len", typedarray__length},
+	{"__gc", typedarray__gc},
+	{NULL, NULL}
+};
+
+void typedarray_register(lua_State *L){
+	if(!luaL_newmetatable(L, "TypedArray")){ // stack: {metatable, ...}
+		lua_pop(L, 1);
+		return; // already registered
+	}
+	lua_newtable(L); // stack: {methods, metatable, ...}
+	luaL_setfuncs(L, typedarray_f, 0);
+	luaL_setfuncs(L, typedarray_mt, 1); // methods table as upvalue
+	lua_pop(L, 1); // stack: {...}
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <stddef.h> // for size_t, ptrdiff_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+
+/* C library definitions */
+
+typedef enum TypedArrayType {
+	TYPEDARRAY_INT8,
+	TYPEDARRAY_UINT8,
+	TYPEDARRAY_INT16,
+	TYPEDARRAY_UINT16,
+	TYPEDARRAY_INT32,
+	TYPEDARRAY_UINT32,
+	TYPEDARRAY_INT64,
+	TYPEDARRAY_UINT64,
+	TYPEDARRAY_FLOAT32,
+	TYPEDARRAY_FLOAT64,
+} TypedArrayType;
+
+// A view of numbers of one type inside a Buffer
+// The Buffer is kept alive as the user value of the TypedArray userdata
+typedef struct TypedArray {
+	uint8_t *data;       // pointer to the first element
+	size_t length;       // number of elements
+	size_t stride;       // number of bytes from one element to the next
+	TypedArrayType type;
+	Buffer *owner;       // the growable buffer that owns the data, see buffer_addview
+} TypedArray;
+
+// Type names, in the order of TypedArrayType, for luaL_checkoption
+extern const char *const typedarray_types[];
+
+// Size of one element of a type, in bytes
+size_t typedarray_size(TypedArrayType type);
+
+// Whether the elements are next to each other, without gaps
+int typedarray_contiguous(TypedArray *array);
+
+// Pointer to the element at index i
+#define typedarray_at(array, i) ((array)->data + (i)*(array)->stride)
+
+TypedArray *typedarray_check(lua_State *L, int idx);
+
+// Create a new TypedArray with its own zero-filled Buffer, and push it
+TypedArray *typedarray_new(lua_State *L, TypedArrayType type, size_t length);
+
+// Whether the elements are floating point numbers
+#define typedarray_isfloat(type) ((type) >= TYPEDARRAY_FLOAT32)
+
+// Get the element at index i, converted to an integer or a float
+lua_Integer typedarray_get_integer(TypedArray *array, size_t i);
+lua_Number typedarray_get_number(TypedArray *array, size_t i);
+
+// Set the element at index i, wrapping integers around like a C cast
+// Floats that do not fit in an integer type are stored as 0
+void typedarray_put_integer(TypedArray *array, size_t i, lua_Integer value);
+void typedarray_put_number(TypedArray *array, size_t i, lua_Number value);
+
+// Push the element at index i
+void typedarray_push(lua_State *L, TypedArray *array, size_t i);
+
+// Store the number at stack index idx as element i, or throw an argument error
+void typedarray_store(lua_State *L, TypedArray *array, size_t i, int idx);
+
+// Create the TypedArray metatable
+void typedarray_register(lua_State *L);
+
+/* Lua API definitions */
+
+int typedarray_as(lua_State *L);
+int typedarray_array(lua_State *L);
+int typedarray_type(lua_State *L);
+int typedarray_buffer(lua_State *L);
+int typedarray_slice(lua_State *L);
+int typedarray_set(lua_State *L);
+int typedarray_totable(lua_State *L);
+
+/* Lua metamethods */
+
+int typedarray__index(lua_State *L);
+int typedarray__newindex(lua_State *L);
+int typedarray__tostring(lua_State *L);
+int typedarray__length(lua_State *L);
+int typedarray__gc(lua_State *L);
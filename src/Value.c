@@ -11,6 +11,21 @@
 
 /* C library definitions */
 
+// Mask of the bits of a value of size bytes
+static uint64_t value_mask(size_t size){
+	return (size >= sizeof(uint64_t)) ? ~UINT64_C(0) : (UINT64_C(1) << size*8) - 1;
+}
+
+// Truncate bits to size bytes, then sign or zero extend them back to 64 bits
+static uint64_t value_extend(size_t size, int isSigned, uint64_t bits){
+	switch(size){
+		case sizeof(uint8_t):  return isSigned ? (uint64_t)(int8_t)bits  : (uint8_t)bits;
+		case sizeof(uint16_t): return isSigned ? (uint64_t)(int16_t)bits : (uint16_t)bits;
+		case sizeof(uint32_t): return isSigned ? (uint64_t)(int32_t)bits : (uint32_t)bits;
+		default:               return bits;
+	}
+}
+
 int value_from(lua_State *L, int idx, Value *value){
 	switch(lua_type(L, idx)){
 		case LUA_TNUMBER: ;
@@ -60,24 +75,102 @@ int value_setvalue(lua_State *L, int idx, Value *value){
 }
 
 void value_push(lua_State *L, Value *value){
-	switch(value->size){
-		case sizeof(uint8_t):  lua_pushinteger(L, value->isSigned ? (int8_t)value->v8 : value->v8);  break;
-		case sizeof(uint16_t): lua_pushinteger(L, value->isSigned ? (int16_t)value->v16 : value->v16); break;
-		case sizeof(uint32_t): lua_pushinteger(L, value->isSigned ? (int32_t)value->v32 : value->v32); break;
-		case sizeof(uint64_t): lua_pushinteger(L, value->isSigned ? (int64_t)value->v64 : value->v64); break;
-		default:               lua_pushinteger(L, 0);
+	lua_pushinteger(L, (lua_Integer)value_extend(value->size, value->isSigned, value->v64));
+}
+
+// Get a number, string or Value as 64 bits, sign extended when signed
+static int value_operand(lua_State *L, int idx, uint64_t *bits){
+	Value value;
+	if(!value_from(L, idx, &value)) return 0;
+	*bits = value_extend(value.size, value.isSigned, value.v64);
+	return 1;
+}
+
+// Apply an operator (LUA_OPADD etc) to value in place, wrapping at its size.
+// The operand is first converted to the size and signedness of value, except
+// for shift distances. Returns 0 on division by zero
+static int value_apply(Value *value, int op, uint64_t operand){
+	uint64_t a = value_extend(value->size, value->isSigned, value->v64);
+	uint64_t b = value_extend(value->size, value->isSigned, operand);
+	uint64_t result;
+	switch(op){
+		case LUA_OPADD:  result = a + b; break;
+		case LUA_OPSUB:  result = a - b; break;
+		case LUA_OPMUL:  result = a * b; break;
+		case LUA_OPBAND: result = a & b; break;
+		case LUA_OPBOR:  result = a | b; break;
+		case LUA_OPBXOR: result = a ^ b; break;
+		case LUA_OPUNM:  result = 0 - a; break;
+		case LUA_OPBNOT: result = ~a;    break;
+		case LUA_OPIDIV:
+		case LUA_OPMOD:
+			if(b == 0) return 0;
+			if(!value->isSigned){
+				result = (op == LUA_OPIDIV) ? a / b : a % b;
+			}else if((int64_t)b == -1){
+				result = (op == LUA_OPIDIV) ? 0 - a : 0; // avoid overflow of INT64_MIN / -1
+			}else{
+				/* Round towards minus infinity, like Lua */
+				int64_t q = (int64_t)a / (int64_t)b, r = (int64_t)a % (int64_t)b;
+				if(r != 0 && ((r ^ (int64_t)b) < 0)){
+					q--;
+					r += (int64_t)b;
+				}
+				result = (op == LUA_OPIDIV) ? (uint64_t)q : (uint64_t)r;
+			}
+			break;
+		case LUA_OPSHL:
+		case LUA_OPSHR: ;
+			/* Logical shifts within the size, negative distances shift the other way */
+			int64_t n = (int64_t)operand;
+			int left = (op == LUA_OPSHL) == (n >= 0);
+			uint64_t distance = (n >= 0) ? (uint64_t)n : 0 - (uint64_t)n;
+			if(distance >= value->size*8){
+				result = 0;
+			}else{
+				result = left ? a << distance : (a & value_mask(value->size)) >> distance;
+			}
+			break;
+		default:
+			result = a;
 	}
+	value->v64 = result & value_mask(value->size);
+	return 1;
+}
+
+// Raise the error for a failed value_apply
+static int value_applyerror(lua_State *L, int op){
+	if(op == LUA_OPMOD) return luaL_error(L, "attempt to perform 'n%%0'");
+	return luaL_error(L, "attempt to perform 'n//0'");
 }
 
-int value_unop(lua_State *L, int op){
+// Metamethod for operators on integers, the result has the size and
+// signedness of the first Value operand
+int value_arith(lua_State *L, int op){
+	Value *template = luaL_testudata(L, 1, "Value");
+	if(template == NULL) template = luaL_checkudata(L, 2, "Value");
+	uint64_t a, b;
+	if(!value_operand(L, 1, &a)) return luaL_argerror(L, 1, "Only number, string or Value supported");
+	if(!value_operand(L, 2, &b)) return luaL_argerror(L, 2, "Only number, string or Value supported");
+	
+	Value *value = lua_newuserdata(L, sizeof(Value));
+	value->size = template->size;
+	value->isSigned = template->isSigned;
+	value->v64 = a;
+	if(!value_apply(value, op, b)) return value_applyerror(L, op);
+	luaL_setmetatable(L, "Value");
+	return 1;
+}
+
+// Method for operators in place on the Value at index 1, returns it
+int value_inplace(lua_State *L, int op){
 	Value *value = luaL_checkudata(L, 1, "Value");
-	lua_pushcfunction(L, value_of);
-	value_push(L, value);
-	lua_arith(L, op);
-	lua_call(L, 1, 1);
-	Value *newvalue = lua_touserdata(L, -1);
-	newvalue->size = value->size;
-	newvalue->isSigned = value->isSigned;
+	uint64_t operand = 0;
+	if(op != LUA_OPUNM && op != LUA_OPBNOT && !value_operand(L, 2, &operand)){
+		return luaL_argerror(L, 2, "Only number, string or Value supported");
+	}
+	if(!value_apply(value, op, operand)) return value_applyerror(L, op);
+	lua_settop(L, 1);
 	return 1;
 }
 
@@ -142,6 +235,100 @@ int value_get(lua_State *L){
 	return 1;
 }
 
+/***
+ * Add to the value in place, wrapping around at its size.
+ * @function add
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_add(lua_State *L){ return value_inplace(L, LUA_OPADD); }
+
+/***
+ * Subtract from the value in place, wrapping around at its size.
+ * @function sub
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_sub(lua_State *L){ return value_inplace(L, LUA_OPSUB); }
+
+/***
+ * Multiply the value in place, wrapping around at its size.
+ * @function mul
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_mul(lua_State *L){ return value_inplace(L, LUA_OPMUL); }
+
+/***
+ * Floor divide the value in place.
+ * @function idiv
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_idiv(lua_State *L){ return value_inplace(L, LUA_OPIDIV); }
+
+/***
+ * Set the value to its modulo in place.
+ * @function mod
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_mod(lua_State *L){ return value_inplace(L, LUA_OPMOD); }
+
+/***
+ * Bitwise and the value in place.
+ * @function band
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_band(lua_State *L){ return value_inplace(L, LUA_OPBAND); }
+
+/***
+ * Bitwise or the value in place.
+ * @function bor
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_bor(lua_State *L){ return value_inplace(L, LUA_OPBOR); }
+
+/***
+ * Bitwise exclusive or the value in place.
+ * @function bxor
+ * @tparam number|string|Value x
+ * @treturn Value self
+ */
+int value_bxor(lua_State *L){ return value_inplace(L, LUA_OPBXOR); }
+
+/***
+ * Shift the value left in place, bits shifted past its size are dropped.
+ * @function shl
+ * @tparam number n the distance, negative to shift right
+ * @treturn Value self
+ */
+int value_shl(lua_State *L){ return value_inplace(L, LUA_OPSHL); }
+
+/***
+ * Shift the value right in place, filling with zeros even when signed.
+ * @function shr
+ * @tparam number n the distance, negative to shift left
+ * @treturn Value self
+ */
+int value_shr(lua_State *L){ return value_inplace(L, LUA_OPSHR); }
+
+/***
+ * Negate the value in place, wrapping around at its size.
+ * @function neg
+ * @treturn Value self
+ */
+int value_neg(lua_State *L){ return value_inplace(L, LUA_OPUNM); }
+
+/***
+ * Bitwise not the value in place.
+ * @function bnot
+ * @treturn Value self
+ */
+int value_bnot(lua_State *L){ return value_inplace(L, LUA_OPBNOT); }
+
 /// @section end
 
 /***
@@ -170,9 +357,11 @@ int value_of(lua_State *L){
  */
 int value_new(lua_State *L){
 	size_t size = luaL_optinteger(L, 1, sizeof(uint8_t));
+	int isSigned = lua_toboolean(L, 2);
 	Value *value = lua_newuserdata(L, sizeof(Value));
 	value->size = size;
-	value->isSigned = lua_toboolean(L, 2);
+	value->isSigned = isSigned;
+	value->v64 = 0;
 	if(value->size != 1 && value->size != 2 && value->size != 4 && value->size != 8){
 		return luaL_argerror(L, 1, "invalid size (1,2,4 or 8 expected)");
 	}
@@ -263,20 +452,20 @@ int value__eq(lua_State *L){   return value_cmp(L, LUA_OPEQ);     }
 int value__lt(lua_State *L){   return value_cmp(L, LUA_OPLT);     }
 int value__le(lua_State *L){   return value_cmp(L, LUA_OPLE);     }
 
-int value__add(lua_State *L){  return value_binop(L, LUA_OPADD);  }
-int value__sub(lua_State *L){  return value_binop(L, LUA_OPSUB);  }
-int value__mul(lua_State *L){  return value_binop(L, LUA_OPMUL);  }
-int value__mod(lua_State *L){  return value_binop(L, LUA_OPMOD);  }
+int value__add(lua_State *L){  return value_arith(L, LUA_OPADD);  }
+int value__sub(lua_State *L){  return value_arith(L, LUA_OPSUB);  }
+int value__mul(lua_State *L){  return value_arith(L, LUA_OPMUL);  }
+int value__mod(lua_State *L){  return value_arith(L, LUA_OPMOD);  }
 int value__pow(lua_State *L){  return value_binop(L, LUA_OPPOW);  }
 int value__div(lua_State *L){  return value_binop(L, LUA_OPDIV);  }
-int value__idiv(lua_State *L){ return value_binop(L, LUA_OPIDIV); }
-int value__band(lua_State *L){ return value_binop(L, LUA_OPBAND); }
-int value__bor(lua_State *L){  return value_binop(L, LUA_OPBOR);  }
-int value__bxor(lua_State *L){ return value_binop(L, LUA_OPBXOR); }
-int value__shl(lua_State *L){  return value_binop(L, LUA_OPSHL);  }
-int value__shr(lua_State *L){  return value_binop(L, LUA_OPSHR);  }
-int value__unm(lua_State *L){  return value_unop(L, LUA_OPUNM);   }
-int value__bnot(lua_State *L){ return value_unop(L, LUA_OPBNOT);  }
+int value__idiv(lua_State *L){ return value_arith(L, LUA_OPIDIV); }
+int value__band(lua_State *L){ return value_arith(L, LUA_OPBAND); }
+int value__bor(lua_State *L){  return value_arith(L, LUA_OPBOR);  }
+int value__bxor(lua_State *L){ return value_arith(L, LUA_OPBXOR); }
+int value__shl(lua_State *L){  return value_arith(L, LUA_OPSHL);  }
+int value__shr(lua_State *L){  return value_arith(L, LUA_OPSHR);  }
+int value__unm(lua_State *L){  return value_arith(L, LUA_OPUNM);  }
+int value__bnot(lua_State *L){ return value_arith(L, LUA_OPBNOT); }
 
 static const struct luaL_Reg value_f[] = {
 	{"new", value_new},
@@ -287,6 +476,18 @@ static const struct luaL_Reg value_f[] = {
 	{"tobinary", value_tobinary},
 	{"size", value_size},
 	{"signed", value_signed},
+	{"add", value_add},
+	{"sub", value_sub},
+	{"mul", value_mul},
+	{"idiv", value_idiv},
+	{"mod", value_mod},
+	{"band", value_band},
+	{"bor", value_bor},
+	{"bxor", value_bxor},
+	{"shl", value_shl},
+	{"shr", value_shr},
+	{"neg", value_neg},
+	{"bnot", value_bnot},
 	{NULL, NULL}
 };
 
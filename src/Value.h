@@ -24,6 +24,18 @@ int value_set(lua_State *L);
 int value_get(lua_State *L);
 int value_of(lua_State *L);
 int value_new(lua_State *L);
+int value_add(lua_State *L);
+int value_sub(lua_State *L);
+int value_mul(lua_State *L);
+int value_idiv(lua_State *L);
+int value_mod(lua_State *L);
+int value_band(lua_State *L);
+int value_bor(lua_State *L);
+int value_bxor(lua_State *L);
+int value_shl(lua_State *L);
+int value_shr(lua_State *L);
+int value_neg(lua_State *L);
+int value_bnot(lua_State *L);
 
 /* Lua metamethods */
 
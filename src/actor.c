@@ -0,0 +1,483 @@
+/***
+ * Actors: named handlers with a mailbox, running on a shared pool of threads.
+ * 
+ * Unlike a `Thread`, which runs one call at a time for one caller, any number
+ * of actors are spread over a fixed number of worker threads. Sending a
+ * message never waits for the actor: messages are queued in its mailbox, and
+ * the actor handles them one by one, in the order they were sent.
+ * 
+ * Messages are serialised, so the same types as for `shared` can be sent.
+ * Every actor gets its own global environment, which falls back to the
+ * globals of its worker. The worker runs its event loop between messages, so
+ * actors can also use timers and events.
+ * 
+ * @submodule safethread
+ * @usage
+ * safethread.spawn("counter", function(n)
+ * 	count = (count or 0) + n
+ * 	print("count", count)
+ * end)
+ * safethread.send("counter", 1)
+ * safethread.send("counter", 2)
+ */
+
+#include <stdlib.h> // for malloc, calloc, free
+#include <string.h> // for memcpy, memcmp, strcmp
+#include <stdint.h> // for uint64_t
+#include <sched.h> // for sched_yield
+
+#include <SDL2/SDL.h> // for SDL_GetCPUCount
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "threads.h"
+#include "serialise.h"
+#include "MoonBox.h"
+#include "event.h"
+#include "actor.h"
+
+/* C library definitions */
+
+// The library is only loaded once per process, so all Lua states
+// (and all threads) see the same actors and workers
+static Actor *actors[ACTOR_N_BUCKETS];
+static MUTEX actors_mutex; // protects the actors table and the worker pool
+static ActorWorker *workers = NULL;
+static int n_workers = 0;
+static int pool_size = 0; // 0 means one worker per CPU core
+static unsigned int next_worker = 0;
+
+void actor_init(void){
+	static int state = 0; // 0: not initialised, 1: initialising, 2: initialised
+	int expected = 0;
+	if(__atomic_compare_exchange_n(&state, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+		create_mutex(actors_mutex);
+		__atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+	}else{
+		// Another thread is initialising, wait for it to finish
+		while(__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) sched_yield();
+	}
+}
+
+// FNV-1a hash
+static uint64_t hash_name(const char *name, size_t len){
+	uint64_t hash = 0xcbf29ce484222325;
+	for(size_t i = 0; i < len; i++){
+		hash ^= (uint8_t)name[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+// Find an actor by name, actors_mutex must be locked
+static Actor **find_actor(const char *name, size_t len){
+	Actor **actor = &actors[hash_name(name, len) & (ACTOR_N_BUCKETS-1)];
+	while(*actor != NULL){
+		if((*actor)->namelen == len && memcmp((*actor)->name, name, len) == 0) return actor;
+		actor = &(*actor)->next;
+	}
+	return actor; // points to the NULL at the end of the chain
+}
+
+// Put an actor at the end of the run queue of its worker, worker must be locked
+static void schedule(ActorWorker *w, Actor *a){
+	a->next_ready = NULL;
+	if(w->ready_tail != NULL){
+		w->ready_tail->next_ready = a;
+	}else{
+		w->ready_head = a;
+	}
+	w->ready_tail = a;
+	a->scheduled = 1;
+	signal_cond(w->cond);
+}
+
+// Load the handler of an actor into the worker state
+// stack: {init (light userdata), actor (light userdata)}
+static int load_handler(lua_State *L){
+	Actor *a = lua_touserdata(L, 1);
+	Serialised *init = lua_touserdata(L, 2);
+	lua_settop(L, 0);
+	lua_getfield(L, LUA_REGISTRYINDEX, "mb_actors"); // stack: {actors}
+	if(deserialise_value(L, init->data, init->data + init->size) == NULL){
+		return luaL_error(L, "malformed handler for actor '%s'", a->name);
+	} // stack: {init, actors}
+	
+	/* Load function code */
+	size_t len;
+	lua_getfield(L, 2, "code"); // stack: {code, init, actors}
+	const char *code = lua_tolstring(L, -1, &len);
+	if(luaL_loadbuffer(L, code, len, a->name) != LUA_OK) return lua_error(L);
+	lua_remove(L, 3); // stack: {fn, init, actors}
+	
+	/* Set upvalues */
+	int env = (lua_getfield(L, 2, "env") == LUA_TNUMBER) ? lua_tointeger(L, -1) : 0;
+	lua_pop(L, 1);
+	for(int i = 1; lua_getupvalue(L, 3, i) != NULL; i++){
+		lua_pop(L, 1);
+		if(i == env){
+			/* Give the actor its own globals, which fall back to the worker's globals */
+			lua_newtable(L);
+			lua_createtable(L, 0, 1);
+			lua_rawgeti(L, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
+			lua_setfield(L, -2, "__index");
+			lua_setmetatable(L, -2);
+		}else{
+			lua_geti(L, 2, i);
+		}
+		lua_setupvalue(L, 3, i);
+	}
+	
+	lua_rawsetp(L, 1, a); // stack: {init, actors}
+	return 0;
+}
+
+// Call the handler of an actor with a message
+// stack: {message (light userdata), actor (light userdata)}
+static int deliver(lua_State *L){
+	Actor *a = lua_touserdata(L, 1);
+	Serialised *message = lua_touserdata(L, 2);
+	lua_settop(L, 0);
+	lua_getfield(L, LUA_REGISTRYINDEX, "mb_actors"); // stack: {actors}
+	lua_rawgetp(L, 1, a); // stack: {handler, actors}
+	lua_remove(L, 1); // stack: {handler}
+	int n = deserialise_values(L, message->data, message->size);
+	lua_call(L, n, 0);
+	return 0;
+}
+
+// Call a C function in protected mode with an actor and a pointer
+// The stack of a worker only contains mb_error_handler, which prints errors
+static void call_protected(lua_State *L, lua_CFunction fn, Actor *a, void *data){
+	lua_pushcfunction(L, fn);
+	lua_pushlightuserdata(L, a);
+	lua_pushlightuserdata(L, data);
+	lua_pcall(L, 2, 0, 1);
+	lua_settop(L, 1);
+}
+
+// Handle a batch of messages of the first actor in the run queue
+// The worker must be locked, and is locked again when this function returns
+static void run_actor(ActorWorker *w){
+	Actor *a = w->ready_head;
+	w->ready_head = a->next_ready;
+	if(w->ready_head == NULL) w->ready_tail = NULL;
+	
+	/* Take a batch of messages out of the mailbox */
+	ActorMessage *batch = a->head;
+	ActorMessage *last = NULL;
+	for(int i = 0; i < ACTOR_BATCH && a->head != NULL; i++){
+		last = a->head;
+		a->head = a->head->next;
+	}
+	if(last != NULL) last->next = NULL;
+	if(a->head == NULL) a->tail = NULL;
+	
+	Serialised init = a->init;
+	serialise_init(&a->init);
+	a->scheduled = 0;
+	if(a->head != NULL) schedule(w, a); // Handle the rest of the messages later
+	int finished = a->stopped && !a->scheduled;
+	unlock_mutex(w->mutex);
+	
+	/* Handle messages without holding the lock, so sending does not wait */
+	if(init.data != NULL) call_protected(w->L, load_handler, a, &init);
+	serialise_free(&init);
+	while(batch != NULL){
+		ActorMessage *next = batch->next;
+		call_protected(w->L, deliver, a, &batch->data);
+		serialise_free(&batch->data);
+		free(batch);
+		batch = next;
+	}
+	
+	if(finished){
+		/* The actor is not in the actors table or the run queue anymore */
+		lua_getfield(w->L, LUA_REGISTRYINDEX, "mb_actors");
+		lua_pushnil(w->L);
+		lua_rawsetp(w->L, -2, a);
+		lua_pop(w->L, 1);
+		free(a->name);
+		free(a);
+	}
+	
+	lock_mutex(w->mutex);
+}
+
+// Gets called in the new worker thread
+#if defined(_WIN32) || defined(__WIN32__)
+static DWORD WINAPI actor_worker_run(LPVOID data){
+#else
+static void *actor_worker_run(void *data){
+#endif
+	ActorWorker *w = (ActorWorker*)data;
+	lua_State *L = mb_init(); // stack: {mb_error_handler}
+	if(L == NULL){
+		fprintf(stderr, "[C] Could not create Lua state for actor worker\n");
+		return 0;
+	}
+	lua_newtable(L);
+	lua_setfield(L, LUA_REGISTRYINDEX, "mb_actors");
+	safethread_adopt(L, &w->self);
+	
+	lock_mutex(w->mutex);
+	w->L = L;
+	while(!w->stop){
+		if(w->ready_head == NULL) wait_cond_ms(w->cond, w->mutex, ACTOR_IDLE_MS);
+		if(w->ready_head != NULL && !w->stop) run_actor(w);
+		
+		/* Handle timers and events */
+		unlock_mutex(w->mutex);
+		event_dispatch(L, 0);
+		lock_mutex(w->mutex);
+	}
+	w->L = NULL;
+	unlock_mutex(w->mutex);
+	
+	mb_close(L);
+	safethread_release(&w->self);
+	return 0;
+}
+
+static void free_actor(Actor *a){
+	while(a->head != NULL){
+		ActorMessage *next = a->head->next;
+		serialise_free(&a->head->data);
+		free(a->head);
+		a->head = next;
+	}
+	serialise_free(&a->init);
+	free(a->name);
+	free(a);
+}
+
+void actor_shutdown(void){
+	lock_mutex(actors_mutex);
+	for(int i = 0; i < n_workers; i++){
+		lock_mutex(workers[i].mutex);
+		workers[i].stop = 1;
+		signal_cond(workers[i].cond);
+		unlock_mutex(workers[i].mutex);
+	}
+	for(int i = 0; i < n_workers; i++){
+		join_thread(workers[i].thread);
+		
+		/* Stopped actors are only in the run queue anymore */
+		for(Actor *a = workers[i].ready_head, *next; a != NULL; a = next){
+			next = a->next_ready;
+			if(a->stopped) free_actor(a);
+		}
+		destroy_mutex(workers[i].mutex);
+		destroy_cond(workers[i].cond);
+	}
+	for(int i = 0; i < ACTOR_N_BUCKETS; i++){
+		for(Actor *a = actors[i], *next; a != NULL; a = next){
+			next = a->next;
+			free_actor(a);
+		}
+		actors[i] = NULL;
+	}
+	free(workers);
+	workers = NULL;
+	n_workers = 0;
+	unlock_mutex(actors_mutex);
+}
+
+// Start the worker threads, actors_mutex must be locked
+static void start_pool(void){
+	int n = (pool_size > 0) ? pool_size : SDL_GetCPUCount();
+	workers = calloc(n, sizeof(ActorWorker));
+	for(int i = 0; i < n; i++){
+		create_mutex(workers[i].mutex);
+		create_cond(workers[i].cond);
+		create_thread(workers[i].thread, actor_worker_run, &workers[i]);
+	}
+	n_workers = n;
+}
+
+static int writer(lua_State *L, const void *data, size_t size, void *buffer){
+	luaL_addlstring((luaL_Buffer *)buffer, (const char *)data, size);
+	return 0; // 0 means no errors
+}
+
+// Serialise a Lua function with its upvalues, or throw an argument error
+static void serialise_function(lua_State *L, int idx, Serialised *s){
+	lua_newtable(L); // stack: {init}
+	
+	/* Dump function code */
+	luaL_Buffer buffer;
+	lua_pushvalue(L, idx); // stack: {fn, init}
+	luaL_buffinit(L, &buffer);
+	lua_dump(L, writer, &buffer, 0);
+	luaL_pushresult(&buffer); // stack: {code, fn, init}
+	lua_setfield(L, -3, "code"); // stack: {fn, init}
+	lua_pop(L, 1); // stack: {init}
+	
+	/* Store upvalues, except _ENV which gets replaced by the actor's globals */
+	const char *name;
+	for(int i = 1; (name = lua_getupvalue(L, idx, i)) != NULL; i++){
+		if(strcmp(name, "_ENV") == 0){
+			lua_pop(L, 1);
+			lua_pushinteger(L, i);
+			lua_setfield(L, -2, "env");
+		}else{
+			lua_seti(L, -2, i);
+		}
+	}
+	
+	serialise_init(s);
+	if(!serialise_value(L, -1, s)){
+		serialise_free(s);
+		luaL_argerror(L, idx, "upvalue of unsupported type");
+	}
+	lua_pop(L, 1); // stack: {}
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a named actor.
+ * The handler function gets called with the arguments of every message sent
+ * to the actor. Like with `Thread`, the function gets copied to a worker
+ * thread, and so do its upvalues. Errors in the handler are printed, and the
+ * actor continues with its next message.
+ * @function spawn
+ * @tparam string name
+ * @tparam function handler
+ */
+int actor_spawn(lua_State *L){
+	size_t len;
+	const char *name = luaL_checklstring(L, 1, &len);
+	luaL_argcheck(L, lua_isfunction(L, 2) && !lua_iscfunction(L, 2), 2, "expected Lua function");
+	Serialised init;
+	serialise_function(L, 2, &init);
+	
+	lock_mutex(actors_mutex);
+	Actor **slot = find_actor(name, len);
+	if(*slot != NULL){
+		unlock_mutex(actors_mutex);
+		serialise_free(&init);
+		return luaL_error(L, "actor '%s' already exists", name);
+	}
+	if(n_workers == 0) start_pool();
+	
+	/* Create actor */
+	Actor *a = calloc(1, sizeof(Actor));
+	a->name = malloc(len + 1);
+	memcpy(a->name, name, len + 1);
+	a->namelen = len;
+	a->init = init;
+	a->worker = &workers[next_worker++ % n_workers];
+	*slot = a;
+	
+	/* Schedule the actor, so its handler gets loaded */
+	lock_mutex(a->worker->mutex);
+	schedule(a->worker, a);
+	unlock_mutex(a->worker->mutex);
+	unlock_mutex(actors_mutex);
+	return 0;
+}
+
+/***
+ * Send a message to an actor.
+ * Does not wait for the actor to handle the message.
+ * @function send
+ * @tparam string name
+ * @param[opt] ... the message arguments
+ * @treturn[1] boolean `true`
+ * @treturn[2] boolean `false` when there is no actor with this name
+ * @treturn[2] string error
+ */
+int actor_send(lua_State *L){
+	size_t len;
+	const char *name = luaL_checklstring(L, 1, &len);
+	
+	/* Serialise message before locking */
+	ActorMessage *m = malloc(sizeof(ActorMessage));
+	serialise_init(&m->data);
+	m->next = NULL;
+	for(int i = 2; i <= lua_gettop(L); i++){
+		if(!serialise_value(L, i, &m->data)){
+			serialise_free(&m->data);
+			free(m);
+			luaL_argerror(L, i, "unsupported type");
+		}
+	}
+	
+	lock_mutex(actors_mutex);
+	Actor *a = *find_actor(name, len);
+	if(a == NULL){
+		unlock_mutex(actors_mutex);
+		serialise_free(&m->data);
+		free(m);
+		lua_pushboolean(L, 0);
+		lua_pushfstring(L, "no actor named '%s'", name);
+		return 2;
+	}
+	
+	/* Put message in mailbox */
+	lock_mutex(a->worker->mutex);
+	if(a->tail != NULL){
+		a->tail->next = m;
+	}else{
+		a->head = m;
+	}
+	a->tail = m;
+	if(!a->scheduled) schedule(a->worker, a);
+	unlock_mutex(a->worker->mutex);
+	unlock_mutex(actors_mutex);
+	
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/***
+ * Stop an actor.
+ * The actor still handles the messages that were sent before, but no new
+ * messages can be sent to it. After that, the name can be used again.
+ * @function stop
+ * @tparam string name
+ * @treturn boolean whether there was an actor with this name
+ */
+int actor_stop(lua_State *L){
+	size_t len;
+	const char *name = luaL_checklstring(L, 1, &len);
+	
+	lock_mutex(actors_mutex);
+	Actor **slot = find_actor(name, len);
+	Actor *a = *slot;
+	if(a == NULL){
+		unlock_mutex(actors_mutex);
+		lua_pushboolean(L, 0);
+		return 1;
+	}
+	*slot = a->next; // Remove from actors table
+	
+	lock_mutex(a->worker->mutex);
+	a->stopped = 1;
+	if(!a->scheduled) schedule(a->worker, a);
+	unlock_mutex(a->worker->mutex);
+	unlock_mutex(actors_mutex);
+	
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/***
+ * Set the number of worker threads for actors.
+ * Can only be called before the first actor is spawned.
+ * @function setPoolSize
+ * @tparam number n the number of threads, defaults to the number of CPU cores
+ */
+int actor_setPoolSize(lua_State *L){
+	int n = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, n > 0, 1, "pool size must be positive");
+	lock_mutex(actors_mutex);
+	int started = (n_workers > 0);
+	if(!started) pool_size = n;
+	unlock_mutex(actors_mutex);
+	if(started) return luaL_error(L, "actor pool has already started");
+	return 0;
+}
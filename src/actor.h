@@ -0,0 +1,75 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+
+#include <lua.h>
+
+#include "threads.h"
+#include "serialise.h"
+#include "safethread.h"
+
+/* C library definitions */
+
+// Number of buckets in the actor name table, must be a power of 2
+#define ACTOR_N_BUCKETS 256
+
+// Maximum number of messages an actor handles before other actors on the
+// same worker get their turn
+#define ACTOR_BATCH 64
+
+// Time in milliseconds an idle worker waits before running its event loop
+#define ACTOR_IDLE_MS 10
+
+typedef struct ActorMessage ActorMessage; // forward-declare
+typedef struct ActorWorker ActorWorker; // forward-declare
+typedef struct Actor Actor; // forward-declare
+
+typedef struct ActorMessage {
+	Serialised data; // the serialised message arguments
+	ActorMessage *next;
+} ActorMessage;
+
+typedef struct Actor {
+	char *name;
+	size_t namelen;
+	ActorWorker *worker;
+	Serialised init;     // the serialised handler, until the worker loads it
+	ActorMessage *head;  // mailbox, oldest message first
+	ActorMessage *tail;
+	int scheduled;       // whether the actor is in the run queue of its worker
+	int stopped;         // whether the actor should stop after its last message
+	Actor *next_ready;   // next actor in the run queue
+	Actor *next;         // next actor in the same name table bucket
+} Actor;
+
+typedef struct ActorWorker {
+	lua_State *L;
+	THREAD thread;
+	MUTEX mutex; // protects the run queue and the mailboxes of its actors
+	CONDITION cond;
+	Actor *ready_head; // run queue
+	Actor *ready_tail;
+	int stop;    // whether the worker should close its state and exit
+	Thread self; // what safethread.self returns in the worker
+} ActorWorker;
+
+// Initialise the actors table, can be called multiple times
+void actor_init(void);
+
+// Stop and join the worker threads, and free all actors
+// Messages that were not handled yet are dropped
+void actor_shutdown(void);
+
+/* Lua API definitions */
+
+// Create a named actor
+int actor_spawn(lua_State *L);
+
+// Send a message to an actor
+int actor_send(lua_State *L);
+
+// Stop an actor after it has handled its messages
+int actor_stop(lua_State *L);
+
+// Set the number of worker threads for actors
+int actor_setPoolSize(lua_State *L);
@@ -0,0 +1,114 @@
+#include <stdlib.h> // for malloc, realloc, free
+#include <string.h> // for memcpy
+
+#include <lua.h>
+
+#include "alloc.h"
+
+/* C library definitions */
+
+Allocator *alloc_new(void){
+	Allocator *a = calloc(1, sizeof(Allocator));
+	return a;
+}
+
+void alloc_free(Allocator *a){
+	AllocSlab *slab = a->slabs;
+	while(slab != NULL){
+		AllocSlab *next = slab->next;
+		free(slab);
+		slab = next;
+	}
+	free(a);
+}
+
+// Get the size class of a block size, or -1 when it is too large for the pools
+static int size_class(size_t size){
+	if(size > ALLOC_CLASS_SIZE * ALLOC_N_CLASSES) return -1;
+	return (size - 1) / ALLOC_CLASS_SIZE;
+}
+
+static void *pool_alloc(Allocator *a, int class){
+	/* Reuse a free block */
+	AllocBlock *block = a->free[class];
+	if(block != NULL){
+		a->free[class] = block->next;
+		return block;
+	}
+	
+	/* Take a new block from the current slab */
+	size_t size = (class + 1) * ALLOC_CLASS_SIZE;
+	if(a->slab_pos == NULL || a->slab_pos + size > a->slab_end){
+		AllocSlab *slab = malloc(ALLOC_SLAB_SIZE);
+		if(slab == NULL) return NULL;
+		slab->next = a->slabs;
+		a->slabs = slab;
+		a->pooled += ALLOC_SLAB_SIZE;
+		// Keep blocks aligned to ALLOC_CLASS_SIZE
+		a->slab_pos = (char*)slab + ALLOC_CLASS_SIZE;
+		a->slab_end = (char*)slab + ALLOC_SLAB_SIZE;
+	}
+	void *ptr = a->slab_pos;
+	a->slab_pos += size;
+	return ptr;
+}
+
+static void pool_free(Allocator *a, int class, void *ptr){
+	AllocBlock *block = ptr;
+	block->next = a->free[class];
+	a->free[class] = block;
+}
+
+void *alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize){
+	Allocator *a = ud;
+	// When ptr is NULL, osize is the type of the object instead of its size
+	if(ptr == NULL) osize = 0;
+	int oclass = (ptr == NULL) ? -1 : size_class(osize);
+	
+	/* Free */
+	if(nsize == 0){
+		if(ptr == NULL) return NULL;
+		if(oclass >= 0){
+			pool_free(a, oclass, ptr);
+		}else{
+			free(ptr);
+		}
+		a->live -= osize;
+		return NULL;
+	}
+	
+	/* Check memory limit. Shrinking must never fail */
+	if(a->limit > 0 && nsize > osize && a->live - osize + nsize > a->limit) return NULL;
+	
+	/* Allocate or reallocate */
+	int nclass = size_class(nsize);
+	void *newptr;
+	if(ptr != NULL && oclass >= 0 && nclass == oclass){
+		// The block is already the right size
+		newptr = ptr;
+	}else if(ptr != NULL && oclass < 0 && nclass < 0){
+		newptr = realloc(ptr, nsize);
+	}else{
+		newptr = (nclass >= 0) ? pool_alloc(a, nclass) : malloc(nsize);
+		if(newptr != NULL && ptr != NULL){
+			memcpy(newptr, ptr, (osize < nsize) ? osize : nsize);
+			if(oclass >= 0){
+				pool_free(a, oclass, ptr);
+			}else{
+				free(ptr);
+			}
+		}
+	}
+	if(newptr == NULL){
+		if(nsize > osize) return NULL;
+		// Shrinking must never fail, so keep the block where it is. It is
+		// at least as large as the new size class, so it can be freed into
+		// that class later. A block from malloc then stays in the pool
+		newptr = ptr;
+	}
+	
+	a->live = a->live - osize + nsize;
+	if(a->live > a->peak) a->peak = a->live;
+	a->n_allocs++;
+	return newptr;
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+
+#include <lua.h>
+
+/* C library definitions */
+
+// Blocks up to ALLOC_N_CLASSES * ALLOC_CLASS_SIZE bytes come from the pools,
+// larger blocks come from malloc directly
+#define ALLOC_CLASS_SIZE 16
+#define ALLOC_N_CLASSES 16
+#define ALLOC_SLAB_SIZE (64 * 1024)
+
+typedef struct AllocBlock AllocBlock; // forward-declare
+
+// A free block in a size class pool
+typedef struct AllocBlock {
+	AllocBlock *next;
+} AllocBlock;
+
+typedef struct AllocSlab AllocSlab; // forward-declare
+
+// A chunk of memory which gets divided into blocks
+typedef struct AllocSlab {
+	AllocSlab *next;
+} AllocSlab;
+
+// Memory allocator for a single lua_State
+// A lua_State is only used by one thread at a time, so the pools need no locking
+typedef struct Allocator {
+	size_t live;   // bytes currently in use
+	size_t peak;   // maximum of live
+	size_t limit;  // maximum number of live bytes, 0 for no limit
+	size_t pooled; // bytes reserved for the pools
+	size_t n_allocs; // total number of allocations
+	AllocBlock *free[ALLOC_N_CLASSES]; // free blocks per size class
+	AllocSlab *slabs; // all slabs, so they can be freed
+	char *slab_pos;   // start of the unused part of the current slab
+	char *slab_end;   // end of the current slab
+} Allocator;
+
+// Create a new allocator
+Allocator *alloc_new(void);
+
+// Free an allocator and all of its pools
+// Only call this after closing the lua_State which used it
+void alloc_free(Allocator *a);
+
+// The lua_Alloc function, with an Allocator as ud
+void *alloc_lua(void *ud, void *ptr, size_t osize, size_t nsize);
@@ -0,0 +1,683 @@
+/***
+ * Bit-level reading and writing of `Buffer`s.
+ * 
+ * A `BitReader` reads fields of any number of bits from a `Buffer` or string,
+ * a `BitWriter` appends them to a growable `Buffer`. Bits are most significant
+ * first by default, like in most file formats and network protocols. Pass
+ * `lsbFirst` for formats like deflate and GIF, which start at the lowest bit
+ * of each byte.
+ * 
+ * Besides plain fields, both support Exp-Golomb codes (`UE` and `SE`, as in
+ * H.264) and LEB128 varints (`Varint` and zigzag-encoded `SVarint`). All read
+ * and write methods take a count or several values, and `readFields` and
+ * `writeFields` handle a list of mixed fields, so one call can do many fields.
+ * 
+ * @submodule Buffer
+ * @usage
+ * local reader = Buffer.of(data):bitReader()
+ * local version, flags, length = reader:readFields{4, 4, "varint"}
+ * local samples = {reader:read(12, length)}
+ */
+
+#include <limits.h> // for INT_MAX
+#include <string.h> // for memcpy, strcmp
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "bits.h"
+
+/* C library definitions */
+
+/* Field codes, widths are 1 to 64 for unsigned and -1 to -64 for signed */
+#define BITS_UE 100
+#define BITS_SE 101
+#define BITS_VARINT 102
+#define BITS_SVARINT 103
+
+/* Exp-Golomb codes have at most 32 leading zeros, so they fit in 65 bits */
+#define BITS_UE_ZEROS 32
+#define BITS_UE_MAX ((UINT64_C(1) << (BITS_UE_ZEROS + 1)) - 2)
+#define BITS_SE_MAX ((lua_Integer)(BITS_UE_MAX / 2))
+
+static const uint8_t *reader_data(BitReader *reader, size_t *size){
+	if(reader->buffer){
+		*size = reader->buffer->size;
+		return reader->buffer->buffer;
+	}
+	*size = reader->size;
+	return reader->data;
+}
+
+// Load 8 bytes, padded with zeros after the end, so that the first bit to
+// read is the highest (most significant first) or lowest (lsbFirst) bit
+static uint64_t bits_load(const uint8_t *data, size_t size, size_t offset, int lsbFirst){
+	uint64_t x = 0;
+	if(offset + 8 <= size){
+		memcpy(&x, data + offset, 8);
+	}else if(offset < size){
+		memcpy(&x, data + offset, size - offset);
+	}
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	return lsbFirst ? x : __builtin_bswap64(x);
+#else
+	return lsbFirst ? __builtin_bswap64(x) : x;
+#endif
+}
+
+// Get n bits at bit position pos, without bounds checks
+static uint64_t bits_peek(const uint8_t *data, size_t size, size_t pos, int n, int lsbFirst){
+	if(n == 0) return 0;
+	if(n > 56){
+		/* Does not fit in one load with the shift, split in two */
+		uint64_t first = bits_peek(data, size, pos, 32, lsbFirst);
+		uint64_t second = bits_peek(data, size, pos + 32, n - 32, lsbFirst);
+		return lsbFirst ? (first | second << 32) : (first << (n - 32) | second);
+	}
+	uint64_t x = bits_load(data, size, pos / 8, lsbFirst);
+	int shift = pos % 8;
+	if(lsbFirst){
+		return (x >> shift) & ((UINT64_C(1) << n) - 1);
+	}else{
+		return (x << shift) >> (64 - n);
+	}
+}
+
+static uint64_t reader_bits(lua_State *L, BitReader *reader, int n){
+	size_t size;
+	const uint8_t *data = reader_data(reader, &size);
+	if(reader->pos > size * 8 || (size_t)n > size * 8 - reader->pos) luaL_error(L, "not enough data");
+	uint64_t value = bits_peek(data, size, reader->pos, n, reader->lsbFirst);
+	reader->pos += n;
+	return value;
+}
+
+static uint64_t reader_ue(lua_State *L, BitReader *reader){
+	size_t size;
+	const uint8_t *data = reader_data(reader, &size);
+	size_t available = (reader->pos < size * 8) ? size * 8 - reader->pos : 0;
+	int n = (available < BITS_UE_ZEROS + 1) ? (int)available : BITS_UE_ZEROS + 1;
+	
+	/* Count the zeros before the first 1 */
+	uint64_t window = bits_peek(data, size, reader->pos, n, reader->lsbFirst);
+	if(window == 0) luaL_error(L, (n == BITS_UE_ZEROS + 1) ? "Exp-Golomb code too long" : "not enough data");
+	int zeros = reader->lsbFirst ? __builtin_ctzll(window) : n - (64 - __builtin_clzll(window));
+	reader->pos += zeros + 1;
+	return ((UINT64_C(1) << zeros) | reader_bits(L, reader, zeros)) - 1;
+}
+
+static uint64_t reader_varint(lua_State *L, BitReader *reader){
+	uint64_t value = 0;
+	for(int shift = 0; shift < 64; shift += 7){
+		uint64_t byte = reader_bits(L, reader, 8);
+		value |= (byte & 0x7f) << shift;
+		if(!(byte & 0x80)) return value;
+	}
+	return luaL_error(L, "varint too long");
+}
+
+static lua_Integer reader_field(lua_State *L, BitReader *reader, int field){
+	switch(field){
+		case BITS_UE: return reader_ue(L, reader);
+		case BITS_SE: {
+			uint64_t k = reader_ue(L, reader);
+			return (k & 1) ? (lua_Integer)((k + 1) / 2) : -(lua_Integer)(k / 2);
+		}
+		case BITS_VARINT: return reader_varint(L, reader);
+		case BITS_SVARINT: {
+			uint64_t v = reader_varint(L, reader);
+			return (lua_Integer)((v >> 1) ^ -(v & 1));
+		}
+		default: break;
+	}
+	if(field > 0) return reader_bits(L, reader, field);
+	
+	/* Sign-extend */
+	int n = -field;
+	uint64_t value = reader_bits(L, reader, n);
+	if(n < 64 && (value >> (n - 1))) value |= ~UINT64_C(0) << n;
+	return (lua_Integer)value;
+}
+
+static void writer_bits(lua_State *L, BitWriter *writer, uint64_t value, int n){
+	if(n == 0) return;
+	if(n > 56){
+		if(writer->lsbFirst){
+			writer_bits(L, writer, value & 0xffffffff, 32);
+			writer_bits(L, writer, value >> 32, n - 32);
+		}else{
+			writer_bits(L, writer, value >> 32, n - 32);
+			writer_bits(L, writer, value & 0xffffffff, 32);
+		}
+		return;
+	}
+	value &= (UINT64_C(1) << n) - 1;
+	if(writer->lsbFirst){
+		writer->acc |= value << writer->count;
+	}else{
+		writer->acc = writer->acc << n | value;
+	}
+	writer->count += n;
+	
+	/* Move whole bytes to the buffer */
+	int bytes = writer->count / 8;
+	if(bytes == 0) return;
+	uint8_t *p = buffer_grow(L, writer->buffer, bytes);
+	for(int i = 0; i < bytes; i++){
+		if(writer->lsbFirst){
+			p[i] = writer->acc;
+			writer->acc >>= 8;
+		}else{
+			p[i] = writer->acc >> (writer->count - 8*(i+1));
+		}
+	}
+	writer->count -= 8*bytes;
+}
+
+static void writer_ue(lua_State *L, BitWriter *writer, uint64_t value){
+	if(value > BITS_UE_MAX) luaL_error(L, "value too large for an Exp-Golomb code");
+	uint64_t v = value + 1;
+	int zeros = 63 - __builtin_clzll(v);
+	
+	/* The marker bit comes first in both bit orders, then the rest of v */
+	writer_bits(L, writer, 0, zeros);
+	writer_bits(L, writer, 1, 1);
+	writer_bits(L, writer, v, zeros);
+}
+
+static void writer_varint(lua_State *L, BitWriter *writer, uint64_t value){
+	while(value >= 0x80){
+		writer_bits(L, writer, (value & 0x7f) | 0x80, 8);
+		value >>= 7;
+	}
+	writer_bits(L, writer, value, 8);
+}
+
+static void writer_field(lua_State *L, BitWriter *writer, int field, lua_Integer value){
+	switch(field){
+		case BITS_UE:
+			if(value < 0) luaL_error(L, "Exp-Golomb UE value must be non-negative");
+			writer_ue(L, writer, value);
+			return;
+		case BITS_SE:
+			if(value > BITS_SE_MAX || value < -BITS_SE_MAX) luaL_error(L, "value too large for an Exp-Golomb code");
+			writer_ue(L, writer, (value > 0) ? 2*(uint64_t)value - 1 : -2*(uint64_t)value);
+			return;
+		case BITS_VARINT: writer_varint(L, writer, value); return;
+		case BITS_SVARINT: writer_varint(L, writer, ((uint64_t)value << 1) ^ (uint64_t)(value >> 63)); return;
+		default: writer_bits(L, writer, value, (field > 0) ? field : -field);
+	}
+}
+
+// Write the bits that do not form a whole byte yet, padded with zeros
+static void writer_pad(lua_State *L, BitWriter *writer){
+	if(writer->count > 0) writer_bits(L, writer, 0, 8 - writer->count);
+}
+
+/* Lua API definitions */
+
+// Get a field width, or throw an error
+static int bits_checkwidth(lua_State *L, int idx){
+	lua_Integer n = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, n >= 0 && n <= 64, idx, "width must be between 0 and 64");
+	return n;
+}
+
+// Get the field at index i of the table at idx, or throw an error
+static int bits_checkfield(lua_State *L, int idx, lua_Integer i){
+	static const char *const names[] = {"ue", "se", "varint", "svarint", NULL};
+	static const int codes[] = {BITS_UE, BITS_SE, BITS_VARINT, BITS_SVARINT};
+	int field = 0;
+	int type = lua_rawgeti(L, idx, i);
+	if(type == LUA_TNUMBER){
+		lua_Integer n = lua_tointeger(L, -1);
+		if(n != 0 && n >= -64 && n <= 64) field = n;
+	}else if(type == LUA_TSTRING){
+		const char *name = lua_tostring(L, -1);
+		for(int j = 0; names[j]; j++){
+			if(strcmp(name, names[j]) == 0) field = codes[j];
+		}
+	}
+	lua_pop(L, 1);
+	if(field == 0) luaL_error(L, "invalid field %d", (int)i);
+	return field;
+}
+
+/***
+ * Create a reader of bits.
+ * Also available as a method on `Buffer`s.
+ * @function bitReader
+ * @tparam Buffer|string data
+ * @tparam[opt=false] boolean lsbFirst whether to start at the lowest bit of each byte
+ * @treturn BitReader
+ */
+int bits_bitReader(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	int lsbFirst = lua_toboolean(L, 2);
+	BitReader *reader = lua_newuserdata(L, sizeof(BitReader));
+	reader->buffer = (lua_type(L, 1) == LUA_TSTRING) ? NULL : lua_touserdata(L, 1);
+	reader->data = data;
+	reader->size = size;
+	reader->pos = 0;
+	reader->lsbFirst = lsbFirst;
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2); // keep the data alive
+	luaL_setmetatable(L, "BitReader");
+	return 1;
+}
+
+/***
+ * Create a writer of bits.
+ * Also available as a method on `Buffer`s.
+ * @function bitWriter
+ * @tparam[opt] Buffer buffer growable buffer to append to, a new one when not given
+ * @tparam[optchain=false] boolean lsbFirst whether to start at the lowest bit of each byte
+ * @treturn BitWriter
+ */
+int bits_bitWriter(lua_State *L){
+	lua_settop(L, 2);
+	if(lua_isnil(L, 1)){
+		buffer_newgrowable(L, 64);
+		lua_replace(L, 1);
+	}
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	luaL_argcheck(L, buffer->kind == BUFFER_GROWABLE, 1, "buffer is not growable");
+	BitWriter *writer = lua_newuserdata(L, sizeof(BitWriter));
+	writer->buffer = buffer;
+	writer->acc = 0;
+	writer->count = 0;
+	writer->lsbFirst = lua_toboolean(L, 2);
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2); // keep the buffer alive
+	luaL_setmetatable(L, "BitWriter");
+	return 1;
+}
+
+/// @type BitReader
+
+// Read count (at idx) fields of one kind
+static int reader_readcount(lua_State *L, int field, int idx){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	lua_Integer count = luaL_optinteger(L, idx, 1);
+	luaL_argcheck(L, count >= 0 && count <= INT_MAX, idx, "invalid count");
+	luaL_checkstack(L, count, "too many values");
+	for(lua_Integer i = 0; i < count; i++){
+		lua_pushinteger(L, reader_field(L, reader, field));
+	}
+	return count;
+}
+
+/***
+ * Read unsigned fields.
+ * @function read
+ * @tparam number n the number of bits of each field, at most 64
+ * @tparam[opt=1] number count the number of fields
+ * @treturn number... the values
+ */
+int reader_read(lua_State *L){
+	int n = bits_checkwidth(L, 2);
+	if(n == 0){
+		luaL_checkudata(L, 1, "BitReader");
+		lua_pushinteger(L, 0);
+		return 1;
+	}
+	return reader_readcount(L, n, 3);
+}
+
+/***
+ * Read two's complement signed fields.
+ * @function readSigned
+ * @tparam number n the number of bits of each field, between 1 and 64
+ * @tparam[opt=1] number count the number of fields
+ * @treturn number... the values
+ */
+int reader_readSigned(lua_State *L){
+	int n = bits_checkwidth(L, 2);
+	luaL_argcheck(L, n > 0, 2, "width must be between 1 and 64");
+	return reader_readcount(L, -n, 3);
+}
+
+/***
+ * Read unsigned Exp-Golomb codes.
+ * @function readUE
+ * @tparam[opt=1] number count
+ * @treturn number... the values
+ */
+int reader_readUE(lua_State *L){
+	return reader_readcount(L, BITS_UE, 2);
+}
+
+/***
+ * Read signed Exp-Golomb codes.
+ * @function readSE
+ * @tparam[opt=1] number count
+ * @treturn number... the values
+ */
+int reader_readSE(lua_State *L){
+	return reader_readcount(L, BITS_SE, 2);
+}
+
+/***
+ * Read unsigned LEB128 varints, of 8 bits each (not necessarily aligned to bytes).
+ * @function readVarint
+ * @tparam[opt=1] number count
+ * @treturn number... the values
+ */
+int reader_readVarint(lua_State *L){
+	return reader_readcount(L, BITS_VARINT, 2);
+}
+
+/***
+ * Read zigzag-encoded signed LEB128 varints.
+ * @function readSVarint
+ * @tparam[opt=1] number count
+ * @treturn number... the values
+ */
+int reader_readSVarint(lua_State *L){
+	return reader_readcount(L, BITS_SVARINT, 2);
+}
+
+/***
+ * Read a list of fields.
+ * Fields are a positive number of bits for unsigned values, a negative number
+ * for signed values, or `"ue"`, `"se"`, `"varint"` or `"svarint"`.
+ * @function readFields
+ * @tparam table fields
+ * @tparam[opt] table into table to put the values in, instead of returning them
+ * @treturn[1] number... the values
+ * @treturn[2] table into
+ */
+int reader_readFields(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	luaL_checktype(L, 2, LUA_TTABLE);
+	lua_Integer n = luaL_len(L, 2);
+	if(!lua_isnoneornil(L, 3)){
+		luaL_checktype(L, 3, LUA_TTABLE);
+		for(lua_Integer i = 1; i <= n; i++){
+			lua_pushinteger(L, reader_field(L, reader, bits_checkfield(L, 2, i)));
+			lua_rawseti(L, 3, i);
+		}
+		lua_settop(L, 3);
+		return 1;
+	}
+	luaL_argcheck(L, n <= INT_MAX, 2, "too many fields");
+	luaL_checkstack(L, n, "too many values");
+	for(lua_Integer i = 1; i <= n; i++){
+		lua_pushinteger(L, reader_field(L, reader, bits_checkfield(L, 2, i)));
+	}
+	return n;
+}
+
+/***
+ * Get an unsigned field, without moving past it.
+ * @function peek
+ * @tparam number n the number of bits, at most 64
+ * @treturn number
+ */
+int reader_peek(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	int n = bits_checkwidth(L, 2);
+	size_t pos = reader->pos;
+	lua_pushinteger(L, reader_bits(L, reader, n));
+	reader->pos = pos;
+	return 1;
+}
+
+/***
+ * Move past a number of bits.
+ * @function skip
+ * @tparam number n the number of bits, can be negative
+ * @treturn BitReader self
+ */
+int reader_skip(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	lua_Integer n = luaL_checkinteger(L, 2);
+	size_t size;
+	reader_data(reader, &size);
+	size_t remaining = (reader->pos < size*8) ? size*8 - reader->pos : 0;
+	luaL_argcheck(L, (n >= 0) ? (size_t)n <= remaining : (size_t)-n <= reader->pos, 2, "out of bounds");
+	reader->pos += n;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Move to the next multiple of a number of bits, if not already there.
+ * @function align
+ * @tparam[opt=8] number n
+ * @treturn BitReader self
+ */
+int reader_align(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	lua_Integer n = luaL_optinteger(L, 2, 8);
+	luaL_argcheck(L, n > 0, 2, "must be positive");
+	reader->pos += (n - reader->pos % n) % n;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get the position.
+ * @function tell
+ * @treturn number the position in bits
+ */
+int reader_tell(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	lua_pushinteger(L, reader->pos);
+	return 1;
+}
+
+/***
+ * Set the position.
+ * @function seek
+ * @tparam number pos the position in bits
+ * @treturn BitReader self
+ */
+int reader_seek(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	lua_Integer pos = luaL_checkinteger(L, 2);
+	size_t size;
+	reader_data(reader, &size);
+	luaL_argcheck(L, pos >= 0 && (size_t)pos <= size*8, 2, "out of bounds");
+	reader->pos = pos;
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get the number of bits after the position.
+ * @function remaining
+ * @treturn number
+ */
+int reader_remaining(lua_State *L){
+	BitReader *reader = luaL_checkudata(L, 1, "BitReader");
+	size_t size;
+	reader_data(reader, &size);
+	lua_pushinteger(L, (reader->pos < size*8) ? size*8 - reader->pos : 0);
+	return 1;
+}
+
+/// @type BitWriter
+
+// Write the values from idx to the top of the stack as one kind of field
+static int writer_writevalues(lua_State *L, int field, int idx){
+	BitWriter *writer = luaL_checkudata(L, 1, "BitWriter");
+	int top = lua_gettop(L);
+	for(int i = idx; i <= top; i++){
+		writer_field(L, writer, field, luaL_checkinteger(L, i));
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Write fields.
+ * Negative values are written in two's complement.
+ * @function write
+ * @tparam number n the number of bits of each field, at most 64
+ * @tparam number ... the values
+ * @treturn BitWriter self
+ */
+int writer_write(lua_State *L){
+	int n = bits_checkwidth(L, 2);
+	if(n == 0){
+		luaL_checkudata(L, 1, "BitWriter");
+		lua_settop(L, 1);
+		return 1;
+	}
+	return writer_writevalues(L, n, 3);
+}
+
+/***
+ * Write unsigned Exp-Golomb codes.
+ * Like in H.264, codes have at most 32 leading zeros, so values are at most
+ * 2^33 - 2.
+ * @function writeUE
+ * @tparam number ... the values, not negative
+ * @treturn BitWriter self
+ */
+int writer_writeUE(lua_State *L){
+	return writer_writevalues(L, BITS_UE, 2);
+}
+
+/***
+ * Write signed Exp-Golomb codes.
+ * Values are at most 2^32 - 1 in magnitude, see `writeUE`.
+ * @function writeSE
+ * @tparam number ... the values
+ * @treturn BitWriter self
+ */
+int writer_writeSE(lua_State *L){
+	return writer_writevalues(L, BITS_SE, 2);
+}
+
+/***
+ * Write unsigned LEB128 varints.
+ * @function writeVarint
+ * @tparam number ... the values
+ * @treturn BitWriter self
+ */
+int writer_writeVarint(lua_State *L){
+	return writer_writevalues(L, BITS_VARINT, 2);
+}
+
+/***
+ * Write zigzag-encoded signed LEB128 varints.
+ * @function writeSVarint
+ * @tparam number ... the values
+ * @treturn BitWriter self
+ */
+int writer_writeSVarint(lua_State *L){
+	return writer_writevalues(L, BITS_SVARINT, 2);
+}
+
+/***
+ * Write a list of fields, like `BitReader:readFields`.
+ * @function writeFields
+ * @tparam table fields
+ * @tparam table values
+ * @treturn BitWriter self
+ */
+int writer_writeFields(lua_State *L){
+	BitWriter *writer = luaL_checkudata(L, 1, "BitWriter");
+	luaL_checktype(L, 2, LUA_TTABLE);
+	luaL_checktype(L, 3, LUA_TTABLE);
+	lua_Integer n = luaL_len(L, 2);
+	for(lua_Integer i = 1; i <= n; i++){
+		int field = bits_checkfield(L, 2, i);
+		lua_rawgeti(L, 3, i);
+		int isnum;
+		lua_Integer value = lua_tointegerx(L, -1, &isnum);
+		if(!isnum) luaL_error(L, "value %d is not an integer", (int)i);
+		lua_pop(L, 1);
+		writer_field(L, writer, field, value);
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Fill up the last byte with zeros.
+ * @function align
+ * @treturn BitWriter self
+ */
+int writer_align(lua_State *L){
+	BitWriter *writer = luaL_checkudata(L, 1, "BitWriter");
+	writer_pad(L, writer);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Fill up the last byte with zeros, and get the buffer.
+ * Bits that do not form a whole byte are only in the buffer after this, or
+ * after `align`.
+ * @function flush
+ * @treturn Buffer
+ */
+int writer_flush(lua_State *L){
+	BitWriter *writer = luaL_checkudata(L, 1, "BitWriter");
+	writer_pad(L, writer);
+	lua_getuservalue(L, 1);
+	return 1;
+}
+
+/***
+ * Get the position.
+ * @function tell
+ * @treturn number the position in bits, from the start of the buffer
+ */
+int writer_tell(lua_State *L){
+	BitWriter *writer = luaL_checkudata(L, 1, "BitWriter");
+	lua_pushinteger(L, writer->buffer->size * 8 + writer->count);
+	return 1;
+}
+
+static const struct luaL_Reg reader_f[] = {
+	{"read", reader_read},
+	{"readSigned", reader_readSigned},
+	{"readUE", reader_readUE},
+	{"readSE", reader_readSE},
+	{"readVarint", reader_readVarint},
+	{"readSVarint", reader_readSVarint},
+	{"readFields", reader_readFields},
+	{"peek", reader_peek},
+	{"skip", reader_skip},
+	{"align", reader_align},
+	{"tell", reader_tell},
+	{"seek", reader_seek},
+	{"remaining", reader_remaining},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg writer_f[] = {
+	{"write", writer_write},
+	{"writeUE", writer_writeUE},
+	{"writeSE", writer_writeSE},
+	{"writeVarint", writer_writeVarint},
+	{"writeSVarint", writer_writeSVarint},
+	{"writeFields", writer_writeFields},
+	{"align", writer_align},
+	{"flush", writer_flush},
+	{"tell", writer_tell},
+	{NULL, NULL}
+};
+
+void bits_register(lua_State *L){
+	if(luaL_newmetatable(L, "BitReader")){ // stack: {metatable, ...}
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, reader_f, 0);
+		lua_setfield(L, -2, "__index");
+	}
+	lua_pop(L, 1); // stack: {...}
+	
+	if(luaL_newmetatable(L, "BitWriter")){ // stack: {metatable, ...}
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, writer_f, 0);
+		lua_setfield(L, -2, "__index");
+	}
+	lua_pop(L, 1); // stack: {...}
+}
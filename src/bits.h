@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+
+/* C library definitions */
+
+typedef struct BitReader {
+	Buffer *buffer;      // the source, or NULL for a string
+	const uint8_t *data; // of the string
+	size_t size;         // of the string
+	size_t pos;          // in bits
+	int lsbFirst;        // whether bits are read from the lowest bit of each byte
+} BitReader;
+
+typedef struct BitWriter {
+	Buffer *buffer;      // growable buffer to append to
+	uint64_t acc;        // bits that do not form a whole byte yet
+	int count;           // number of bits in acc, less than 8 between writes
+	int lsbFirst;        // whether bits are written from the lowest bit of each byte
+} BitWriter;
+
+// Create the BitReader and BitWriter metatables
+void bits_register(lua_State *L);
+
+/* Lua API definitions */
+
+int bits_bitReader(lua_State *L);
+int bits_bitWriter(lua_State *L);
+
+int reader_read(lua_State *L);
+int reader_readSigned(lua_State *L);
+int reader_readUE(lua_State *L);
+int reader_readSE(lua_State *L);
+int reader_readVarint(lua_State *L);
+int reader_readSVarint(lua_State *L);
+int reader_readFields(lua_State *L);
+int reader_peek(lua_State *L);
+int reader_skip(lua_State *L);
+int reader_align(lua_State *L);
+int reader_tell(lua_State *L);
+int reader_seek(lua_State *L);
+int reader_remaining(lua_State *L);
+
+int writer_write(lua_State *L);
+int writer_writeUE(lua_State *L);
+int writer_writeSE(lua_State *L);
+int writer_writeVarint(lua_State *L);
+int writer_writeSVarint(lua_State *L);
+int writer_writeFields(lua_State *L);
+int writer_align(lua_State *L);
+int writer_flush(lua_State *L);
+int writer_tell(lua_State *L);
@@ -0,0 +1,181 @@
+#include <string.h> // for memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define BYTES_X86 1
+	#include <immintrin.h> // for SSE2 and AVX2 intrinsics
+#else
+	#define BYTES_X86 0
+#endif
+
+#include "bytes.h"
+
+/* C library definitions */
+
+/* Scalar versions, also used for the tails of the vector versions */
+
+static void xor_scalar(uint8_t *dst, const uint8_t *src, size_t n){
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		uint64_t a, b;
+		memcpy(&a, dst + i, 8);
+		memcpy(&b, src + i, 8);
+		a ^= b;
+		memcpy(dst + i, &a, 8);
+	}
+	for(; i < n; i++) dst[i] ^= src[i];
+}
+
+// Count the bits of a 64-bit word without the popcnt instruction
+static size_t popcount64(uint64_t x){
+	x = x - ((x >> 1) & 0x5555555555555555);
+	x = (x & 0x3333333333333333) + ((x >> 2) & 0x3333333333333333);
+	x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0f;
+	return (x * 0x0101010101010101) >> 56;
+}
+
+static size_t popcount_scalar(const uint8_t *data, size_t n){
+	size_t count = 0;
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		uint64_t x;
+		memcpy(&x, data + i, 8);
+		count += popcount64(x);
+	}
+	for(; i < n; i++) count += popcount64(data[i]);
+	return count;
+}
+
+static size_t mismatch_scalar(const uint8_t *a, const uint8_t *b, size_t n){
+	size_t i = 0;
+	for(; i + 8 <= n; i += 8){
+		uint64_t x, y;
+		memcpy(&x, a + i, 8);
+		memcpy(&y, b + i, 8);
+		if(x != y) break;
+	}
+	for(; i < n; i++){
+		if(a[i] != b[i]) return i;
+	}
+	return n;
+}
+
+#if BYTES_X86
+
+/* SSE2 versions */
+
+__attribute__((target("sse2")))
+static void xor_sse2(uint8_t *dst, const uint8_t *src, size_t n){
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16){
+		__m128i a = _mm_loadu_si128((const __m128i*)(dst + i));
+		__m128i b = _mm_loadu_si128((const __m128i*)(src + i));
+		_mm_storeu_si128((__m128i*)(dst + i), _mm_xor_si128(a, b));
+	}
+	xor_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static size_t popcount_sse2(const uint8_t *data, size_t n){
+	const __m128i m1 = _mm_set1_epi8(0x55);
+	const __m128i m2 = _mm_set1_epi8(0x33);
+	const __m128i m4 = _mm_set1_epi8(0x0f);
+	__m128i total = _mm_setzero_si128();
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16){
+		// Count bits per byte, then add the bytes with sad
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+		x = _mm_sub_epi8(x, _mm_and_si128(_mm_srli_epi16(x, 1), m1));
+		x = _mm_add_epi8(_mm_and_si128(x, m2), _mm_and_si128(_mm_srli_epi16(x, 2), m2));
+		x = _mm_and_si128(_mm_add_epi8(x, _mm_srli_epi16(x, 4)), m4);
+		total = _mm_add_epi64(total, _mm_sad_epu8(x, _mm_setzero_si128()));
+	}
+	uint64_t sums[2];
+	_mm_storeu_si128((__m128i*)sums, total);
+	return sums[0] + sums[1] + popcount_scalar(data + i, n - i);
+}
+
+__attribute__((target("sse2")))
+static size_t mismatch_sse2(const uint8_t *a, const uint8_t *b, size_t n){
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16){
+		__m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+		__m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+		unsigned int equal = _mm_movemask_epi8(_mm_cmpeq_epi8(x, y));
+		if(equal != 0xffff) return i + __builtin_ctz(~equal);
+	}
+	return i + mismatch_scalar(a + i, b + i, n - i);
+}
+
+/* AVX2 versions */
+
+__attribute__((target("avx2")))
+static void xor_avx2(uint8_t *dst, const uint8_t *src, size_t n){
+	size_t i = 0;
+	for(; i + 32 <= n; i += 32){
+		__m256i a = _mm256_loadu_si256((const __m256i*)(dst + i));
+		__m256i b = _mm256_loadu_si256((const __m256i*)(src + i));
+		_mm256_storeu_si256((__m256i*)(dst + i), _mm256_xor_si256(a, b));
+	}
+	xor_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t popcount_avx2(const uint8_t *data, size_t n){
+	// Look up the bit count of each nibble
+	const __m256i table = _mm256_setr_epi8(
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+		0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+	const __m256i low = _mm256_set1_epi8(0x0f);
+	__m256i total = _mm256_setzero_si256();
+	size_t i = 0;
+	for(; i + 32 <= n; i += 32){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+		__m256i counts = _mm256_add_epi8(
+			_mm256_shuffle_epi8(table, _mm256_and_si256(x, low)),
+			_mm256_shuffle_epi8(table, _mm256_and_si256(_mm256_srli_epi16(x, 4), low)));
+		total = _mm256_add_epi64(total, _mm256_sad_epu8(counts, _mm256_setzero_si256()));
+	}
+	uint64_t sums[4];
+	_mm256_storeu_si256((__m256i*)sums, total);
+	return sums[0] + sums[1] + sums[2] + sums[3] + popcount_scalar(data + i, n - i);
+}
+
+__attribute__((target("avx2")))
+static size_t mismatch_avx2(const uint8_t *a, const uint8_t *b, size_t n){
+	size_t i = 0;
+	for(; i + 32 <= n; i += 32){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(a + i));
+		__m256i y = _mm256_loadu_si256((const __m256i*)(b + i));
+		unsigned int equal = _mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y));
+		if(equal != 0xffffffff) return i + __builtin_ctz(~equal);
+	}
+	return i + mismatch_scalar(a + i, b + i, n - i);
+}
+
+#endif
+
+void (*bytes_xor)(uint8_t*, const uint8_t*, size_t) = xor_scalar;
+size_t (*bytes_popcount)(const uint8_t*, size_t) = popcount_scalar;
+size_t (*bytes_mismatch)(const uint8_t*, const uint8_t*, size_t) = mismatch_scalar;
+static const char *isa = "scalar";
+
+void bytes_init(void){
+#if BYTES_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		bytes_xor = xor_avx2;
+		bytes_popcount = popcount_avx2;
+		bytes_mismatch = mismatch_avx2;
+		isa = "avx2";
+	}else if(__builtin_cpu_supports("sse2")){
+		bytes_xor = xor_sse2;
+		bytes_popcount = popcount_sse2;
+		bytes_mismatch = mismatch_sse2;
+		isa = "sse2";
+	}
+#endif
+}
+
+const char *bytes_isa(void){
+	return isa;
+}
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t
+
+/* C library definitions */
+
+// Byte kernels, picked at runtime for the best instruction set the CPU supports
+// (AVX2, SSE2 or plain C). Call bytes_init before using them.
+
+// dst[i] ^= src[i] for n bytes
+extern void (*bytes_xor)(uint8_t *dst, const uint8_t *src, size_t n);
+
+// Number of set bits in n bytes
+extern size_t (*bytes_popcount)(const uint8_t *data, size_t n);
+
+// Index of the first byte that differs between a and b, or n when they are equal
+extern size_t (*bytes_mismatch)(const uint8_t *a, const uint8_t *b, size_t n);
+
+// Select the kernels for this CPU, can be called multiple times
+void bytes_init(void);
+
+// Name of the selected instruction set: "avx2", "sse2" or "scalar"
+const char *bytes_isa(void);
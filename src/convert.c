@@ -0,0 +1,322 @@
+/***
+ * Bulk conversion of element types and byte order.
+ * 
+ * `convert` copies an array into a new array of another type: widening bytes
+ * to larger integers, narrowing them back (which keeps the low bits, like a C
+ * cast), or converting between integers and floats with an optional scale.
+ * `byteswap` reverses the bytes of every element in place, to switch between
+ * little and big endian. Both handle the whole array in one call, with vector
+ * instructions when the elements are next to each other.
+ * 
+ * @submodule TypedArray
+ * @usage
+ * -- Big endian 16-bit samples to floats between -1 and 1
+ * local samples = Buffer.of(data):as("int16"):convert("float32", 1/32768, true)
+ * -- Network byte order to native, in place
+ * header:byteswap(4, 0, 16)
+ */
+
+#include <string.h> // for memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define CONVERT_X86 1
+	#include <immintrin.h> // for SSSE3 and AVX2 intrinsics
+#else
+	#define CONVERT_X86 0
+#endif
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "TypedArray.h"
+#include "convert.h"
+
+/* C library definitions */
+
+/* Byte swapping, the scalar version is also used for the tails of the vector versions */
+
+#define SWAP_LOOP(T, bswap) \
+	for(size_t i = 0; i < n; i++){ \
+		T x; \
+		memcpy(&x, data + i*sizeof(T), sizeof(T)); \
+		x = bswap(x); \
+		memcpy(data + i*sizeof(T), &x, sizeof(T)); \
+	}
+
+static void swap_scalar(uint8_t *data, size_t n, size_t width){
+	switch(width){
+		case 2: SWAP_LOOP(uint16_t, __builtin_bswap16) break;
+		case 4: SWAP_LOOP(uint32_t, __builtin_bswap32) break;
+		case 8: SWAP_LOOP(uint64_t, __builtin_bswap64) break;
+	}
+}
+
+#if CONVERT_X86
+
+// Shuffle control that reverses every width bytes of 16
+static void swap_mask(uint8_t mask[16], size_t width){
+	for(size_t i = 0; i < 16; i++){
+		mask[i] = i - i % width + (width - 1 - i % width);
+	}
+}
+
+__attribute__((target("ssse3")))
+static void swap_ssse3(uint8_t *data, size_t n, size_t width){
+	uint8_t bytes[16];
+	swap_mask(bytes, width);
+	const __m128i mask = _mm_loadu_si128((const __m128i*)bytes);
+	size_t size = n * width;
+	size_t i = 0;
+	for(; i + 16 <= size; i += 16){
+		__m128i x = _mm_loadu_si128((const __m128i*)(data + i));
+		_mm_storeu_si128((__m128i*)(data + i), _mm_shuffle_epi8(x, mask));
+	}
+	swap_scalar(data + i, (size - i) / width, width);
+}
+
+__attribute__((target("avx2")))
+static void swap_avx2(uint8_t *data, size_t n, size_t width){
+	uint8_t bytes[16];
+	swap_mask(bytes, width);
+	const __m256i mask = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i*)bytes));
+	size_t size = n * width;
+	size_t i = 0;
+	for(; i + 32 <= size; i += 32){
+		__m256i x = _mm256_loadu_si256((const __m256i*)(data + i));
+		_mm256_storeu_si256((__m256i*)(data + i), _mm256_shuffle_epi8(x, mask));
+	}
+	swap_scalar(data + i, (size - i) / width, width);
+}
+
+#endif
+
+static void (*swap_bulk)(uint8_t*, size_t, size_t) = swap_scalar;
+
+void convert_swapbytes(uint8_t *data, size_t n, size_t width){
+	if(width > 1) swap_bulk(data, n, width);
+}
+
+/* Element conversion */
+
+typedef void (*ConvertKernel)(uint8_t *dst, size_t ds, const uint8_t *src, size_t ss, size_t n, double scale);
+
+// Floats are converted to integers in blocks of this many elements, so that
+// blocks which fit in 32 bits can use the vector conversion instructions
+#define CONVERT_BLOCK 256
+
+// Elements are copied with memcpy because they need not be aligned
+#define CONVERT_MAP(D, S, d, s, m, expr) \
+	for(size_t i = 0; i < (m); i++){ \
+		S v; \
+		memcpy(&v, (s) + i*ss, sizeof(S)); \
+		D w = (expr); \
+		memcpy((d) + i*ds, &w, sizeof(D)); \
+	}
+
+static lua_Integer convert_tointeger(double value){
+	lua_Integer integer;
+	if(!lua_numbertointeger(value, &integer)) integer = 0;
+	return integer;
+}
+
+// The body of a kernel, by whether the destination and the source are INT or FLOAT
+#define CONVERT_INT_INT(D, S) CONVERT_MAP(D, S, dst, src, n, (D)v)
+#define CONVERT_FLOAT_INT(D, S) { \
+		D k = (D)scale; \
+		CONVERT_MAP(D, S, dst, src, n, (D)v * k) \
+	}
+#define CONVERT_FLOAT_FLOAT(D, S) CONVERT_MAP(D, S, dst, src, n, (D)((double)v * scale))
+#define CONVERT_INT_FLOAT(D, S) \
+	for(size_t start = 0; start < n; start += CONVERT_BLOCK){ \
+		size_t m = (n - start < CONVERT_BLOCK) ? n - start : CONVERT_BLOCK; \
+		uint8_t *d = dst + start*ds; \
+		const uint8_t *s = src + start*ss; \
+		int fits = 1; \
+		for(size_t i = 0; i < m; i++){ \
+			S v; \
+			memcpy(&v, s + i*ss, sizeof(S)); \
+			double x = (double)v * scale; \
+			fits &= (x > -2147483649.0) & (x < 2147483648.0); /* false for NaN */ \
+		} \
+		if(fits){ \
+			CONVERT_MAP(D, S, d, s, m, (D)(int32_t)((double)v * scale)) \
+		}else{ \
+			CONVERT_MAP(D, S, d, s, m, (D)convert_tointeger((double)v * scale)) \
+		} \
+	}
+
+// Kernel converting elements of type S (named sn, of kind SK) to type D.
+// The body is always inlined into a version for contiguous arrays, where the
+// strides are constants and the compiler can vectorise the loops
+#define CONVERT_PAIR(dn, D, DK, sn, S, SK) \
+	static inline __attribute__((always_inline)) void body_##dn##_##sn(uint8_t *dst, size_t ds, \
+			const uint8_t *src, size_t ss, size_t n, double scale){ \
+		CONVERT_##DK##_##SK(D, S) \
+	} \
+	static void run_##dn##_##sn(uint8_t *dst, size_t ds, const uint8_t *src, size_t ss, size_t n, double scale){ \
+		if(ds == sizeof(D) && ss == sizeof(S)){ \
+			body_##dn##_##sn(dst, sizeof(D), src, sizeof(S), n, scale); \
+		}else{ \
+			body_##dn##_##sn(dst, ds, src, ss, n, scale); \
+		} \
+	}
+
+// The same for AVX2, only for contiguous arrays
+#define CONVERT_PAIR_AVX2(dn, D, DK, sn, S, SK) \
+	__attribute__((target("avx2"))) \
+	static void run_##dn##_##sn##_avx2(uint8_t *dst, size_t ds, const uint8_t *src, size_t ss, size_t n, double scale){ \
+		if(ds == sizeof(D) && ss == sizeof(S)){ \
+			body_##dn##_##sn(dst, sizeof(D), src, sizeof(S), n, scale); \
+		}else{ \
+			run_##dn##_##sn(dst, ds, src, ss, n, scale); \
+		} \
+	}
+
+#define CONVERT_ENTRY(dn, D, DK, sn, S, SK) run_##dn##_##sn,
+#define CONVERT_ENTRY_AVX2(dn, D, DK, sn, S, SK) run_##dn##_##sn##_avx2,
+
+// Every source type for destination type D, in the order of TypedArrayType
+#define CONVERT_SOURCES(X, dn, D, DK) \
+	X(dn, D, DK, int8, int8_t, INT) \
+	X(dn, D, DK, uint8, uint8_t, INT) \
+	X(dn, D, DK, int16, int16_t, INT) \
+	X(dn, D, DK, uint16, uint16_t, INT) \
+	X(dn, D, DK, int32, int32_t, INT) \
+	X(dn, D, DK, uint32, uint32_t, INT) \
+	X(dn, D, DK, int64, int64_t, INT) \
+	X(dn, D, DK, uint64, uint64_t, INT) \
+	X(dn, D, DK, float32, float, FLOAT) \
+	X(dn, D, DK, float64, double, FLOAT)
+
+// Every pair of types, by destination and then source
+#define CONVERT_PAIRS(X) \
+	CONVERT_SOURCES(X, int8, int8_t, INT) \
+	CONVERT_SOURCES(X, uint8, uint8_t, INT) \
+	CONVERT_SOURCES(X, int16, int16_t, INT) \
+	CONVERT_SOURCES(X, uint16, uint16_t, INT) \
+	CONVERT_SOURCES(X, int32, int32_t, INT) \
+	CONVERT_SOURCES(X, uint32, uint32_t, INT) \
+	CONVERT_SOURCES(X, int64, int64_t, INT) \
+	CONVERT_SOURCES(X, uint64, uint64_t, INT) \
+	CONVERT_SOURCES(X, float32, float, FLOAT) \
+	CONVERT_SOURCES(X, float64, double, FLOAT)
+
+#define CONVERT_TYPES 10
+
+CONVERT_PAIRS(CONVERT_PAIR)
+
+static const ConvertKernel kernels_scalar[CONVERT_TYPES * CONVERT_TYPES] = {
+	CONVERT_PAIRS(CONVERT_ENTRY)
+};
+
+#if CONVERT_X86
+CONVERT_PAIRS(CONVERT_PAIR_AVX2)
+
+static const ConvertKernel kernels_avx2[CONVERT_TYPES * CONVERT_TYPES] = {
+	CONVERT_PAIRS(CONVERT_ENTRY_AVX2)
+};
+#endif
+
+static const ConvertKernel *kernels = kernels_scalar;
+
+void convert_elements(uint8_t *dst, size_t dstStride, TypedArrayType to,
+		const uint8_t *src, size_t srcStride, TypedArrayType from,
+		size_t n, double scale, int swap){
+	ConvertKernel kernel = kernels[to*CONVERT_TYPES + from];
+	size_t size = typedarray_size(from);
+	if(swap && size > 1){
+		/* Swap a copy of the source, one part at a time */
+		uint8_t part[4096];
+		size_t count = sizeof(part) / size;
+		for(size_t start = 0; start < n; start += count){
+			size_t m = (n - start < count) ? n - start : count;
+			if(srcStride == size){
+				memcpy(part, src + start*size, m*size);
+			}else{
+				for(size_t i = 0; i < m; i++) memcpy(part + i*size, src + (start + i)*srcStride, size);
+			}
+			convert_swapbytes(part, m, size);
+			kernel(dst + start*dstStride, dstStride, part, size, m, scale);
+		}
+		return;
+	}
+	if(to == from && (scale == 1 || !typedarray_isfloat(to)) && dstStride == size && srcStride == size){
+		memcpy(dst, src, n*size);
+		return;
+	}
+	kernel(dst, dstStride, src, srcStride, n, scale);
+}
+
+void convert_init(void){
+#if CONVERT_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("avx2")){
+		swap_bulk = swap_avx2;
+		kernels = kernels_avx2;
+	}else if(__builtin_cpu_supports("ssse3")){
+		swap_bulk = swap_ssse3;
+	}
+#endif
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a new array with the elements of this one converted to another type.
+ * Integers wrap around like a C cast, so converting to a smaller type keeps
+ * the low bits. Floats are rounded towards 0 when converted to integers, and
+ * become 0 when they do not fit in 64 bits, like when setting elements.
+ * @function convert
+ * @tparam string type
+ * @tparam[opt=1] number scale factor for conversions to or from floats
+ * @tparam[optchain=false] boolean swap whether the elements of this array are
+ * in the other byte order, and need to be swapped before converting
+ * @treturn TypedArray with its own `Buffer`
+ * @usage local pixels = Buffer.of(data):as("uint8"):convert("uint32")
+ */
+int convert_convert(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	TypedArrayType type = luaL_checkoption(L, 2, NULL, typedarray_types);
+	double scale = luaL_optnumber(L, 3, 1);
+	int swap = lua_toboolean(L, 4);
+	TypedArray *result = typedarray_new(L, type, array->length);
+	convert_elements(result->data, result->stride, type, array->data, array->stride, array->type,
+		array->length, scale, swap);
+	return 1;
+}
+
+/***
+ * Reverse the bytes of every element in place, switching between little and big endian.
+ * Also available on `Buffer`s as `buffer:byteswap(width, from, length)`, which
+ * swaps every `width` (1, 2, 4 or 8) bytes of `length` bytes (by default the
+ * whole elements in the rest of the buffer) starting at byte `from` (0 by default).
+ * @function byteswap
+ * @treturn TypedArray|Buffer self
+ */
+int convert_byteswap(lua_State *L){
+	TypedArray *array = luaL_testudata(L, 1, "TypedArray");
+	if(array != NULL){
+		size_t size = typedarray_size(array->type);
+		if(typedarray_contiguous(array)){
+			convert_swapbytes(array->data, array->length, size);
+		}else{
+			for(size_t i = 0; i < array->length; i++) convert_swapbytes(typedarray_at(array, i), 1, size);
+		}
+		lua_settop(L, 1);
+		return 1;
+	}
+	
+	Buffer *buffer = luaL_checkudata(L, 1, "Buffer");
+	lua_Integer width = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, width == 1 || width == 2 || width == 4 || width == 8, 2, "width must be 1, 2, 4 or 8");
+	lua_Integer from = luaL_optinteger(L, 3, 0);
+	luaL_argcheck(L, from >= 0 && (size_t)from <= buffer->size, 3, "out of bounds");
+	lua_Integer length = luaL_optinteger(L, 4, (buffer->size - from) / width * width);
+	luaL_argcheck(L, length >= 0 && buffer_within_range(buffer, from, length), 4, "out of bounds");
+	luaL_argcheck(L, length % width == 0, 4, "length must be a multiple of width");
+	convert_swapbytes(buffer->buffer + from, length / width, width);
+	lua_settop(L, 1);
+	return 1;
+}
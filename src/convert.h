@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "TypedArray.h"
+
+/* C library definitions */
+
+// Reverse the bytes of n contiguous elements of width bytes (1, 2, 4 or 8), in place
+void convert_swapbytes(uint8_t *data, size_t n, size_t width);
+
+// Convert n elements of type from at src to type to at dst, the arrays do not overlap.
+// Integers wrap around like a C cast, and floats are rounded towards 0 when
+// converted to integers (and become 0 when they do not fit in 64 bits), like
+// TypedArray elements. Conversions between integers and floats multiply by
+// scale, and swap reverses the bytes of the source elements first
+void convert_elements(uint8_t *dst, size_t dstStride, TypedArrayType to,
+	const uint8_t *src, size_t srcStride, TypedArrayType from,
+	size_t n, double scale, int swap);
+
+// Select the kernels for this CPU, can be called multiple times
+void convert_init(void);
+
+/* Lua API definitions */
+
+int convert_convert(lua_State *L);
+int convert_byteswap(lua_State *L);
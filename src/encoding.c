@@ -0,0 +1,421 @@
+/***
+ * Text encodings of `Buffer`s and strings.
+ * 
+ * `toBase64` and `fromBase64` convert between bytes and base64, with any two
+ * characters for 62 and 63 (`"+/"` by default, `"-_"` for URL-safe base64).
+ * `toHex` and `fromHex` do the same for hexadecimal. They use SSSE3 when the
+ * CPU has it. The `base64` library uses these when they are available.
+ * 
+ * @submodule Buffer
+ * @usage
+ * local encoded = Buffer.toBase64(data, "-_", false) -- URL-safe, no padding
+ * local decoded = assert(Buffer.fromBase64(encoded, "-_"))
+ */
+
+#include <string.h> // for memcpy, memset
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define ENCODING_X86 1
+	#include <immintrin.h> // for SSSE3 intrinsics
+#else
+	#define ENCODING_X86 0
+#endif
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "encoding.h"
+
+/* C library definitions */
+
+static const char base64_alphabet[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789";
+
+#define BASE64_INVALID 0xff
+#define BASE64_SKIP 0xfe // newlines
+#define BASE64_PAD 0xfd
+
+/* Bulk versions, which process whole vectors and return how much they did.
+	The scalar code below does the rest */
+
+static size_t base64_encode_none(const uint8_t *src, size_t n, char *out, const char chars[2]){
+	return 0;
+}
+
+static size_t base64_decode_none(const char *src, size_t n, uint8_t *out, const char chars[2]){
+	return 0;
+}
+
+static size_t hex_encode_none(const uint8_t *src, size_t n, char *out, int upper){
+	return 0;
+}
+
+static size_t hex_decode_none(const char *src, size_t n, uint8_t *out){
+	return 0;
+}
+
+#if ENCODING_X86
+
+/* SSSE3 versions, see http://0x80.pl/notesen/2016-01-12-sse-base64-encoding.html
+	and http://0x80.pl/notesen/2016-01-17-sse-base64-decoding.html */
+
+// Encode 12 bytes at a time, reads 16
+__attribute__((target("ssse3")))
+static size_t base64_encode_ssse3(const uint8_t *src, size_t n, char *out, const char chars[2]){
+	/* Offsets to add to each 6-bit value, indexed by its range */
+	const __m128i offsets = _mm_setr_epi8('a' - 26, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		'0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52, '0' - 52,
+		(char)(chars[0] - 62), (char)(chars[1] - 63), 'A', 0, 0);
+	size_t i = 0;
+	for(; i + 16 <= n; i += 12, out += 16){
+		/* Spread 3 bytes over 4, then move the 6-bit values into place */
+		__m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+		in = _mm_shuffle_epi8(in, _mm_set_epi8(10, 11, 9, 10, 7, 8, 6, 7, 4, 5, 3, 4, 1, 2, 0, 1));
+		__m128i hi = _mm_mulhi_epu16(_mm_and_si128(in, _mm_set1_epi32(0x0fc0fc00)), _mm_set1_epi32(0x04000040));
+		__m128i lo = _mm_mullo_epi16(_mm_and_si128(in, _mm_set1_epi32(0x003f03f0)), _mm_set1_epi32(0x01000010));
+		__m128i values = _mm_or_si128(hi, lo);
+		
+		/* 0..51 -> 0 or 13, 52..63 -> 1..12 */
+		__m128i range = _mm_subs_epu8(values, _mm_set1_epi8(51));
+		__m128i upper = _mm_cmpgt_epi8(_mm_set1_epi8(26), values);
+		range = _mm_or_si128(range, _mm_and_si128(upper, _mm_set1_epi8(13)));
+		__m128i ascii = _mm_add_epi8(values, _mm_shuffle_epi8(offsets, range));
+		_mm_storeu_si128((__m128i*)out, ascii);
+	}
+	return i;
+}
+
+__attribute__((target("ssse3")))
+static __m128i in_range(__m128i x, char min, char max){
+	return _mm_and_si128(_mm_cmpgt_epi8(x, _mm_set1_epi8(min - 1)), _mm_cmpgt_epi8(_mm_set1_epi8(max + 1), x));
+}
+
+// Decode 16 characters at a time, writes 16 bytes of which 12 are used.
+// Stops before a vector with characters outside of the alphabet
+__attribute__((target("ssse3")))
+static size_t base64_decode_ssse3(const char *src, size_t n, uint8_t *out, const char chars[2]){
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16, out += 12){
+		__m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i upper = in_range(in, 'A', 'Z');
+		__m128i lower = in_range(in, 'a', 'z');
+		__m128i digit = in_range(in, '0', '9');
+		__m128i c62 = _mm_cmpeq_epi8(in, _mm_set1_epi8(chars[0]));
+		__m128i c63 = _mm_cmpeq_epi8(in, _mm_set1_epi8(chars[1]));
+		__m128i valid = _mm_or_si128(_mm_or_si128(upper, lower), _mm_or_si128(_mm_or_si128(digit, c62), c63));
+		if(_mm_movemask_epi8(valid) != 0xffff) break;
+		
+		__m128i values = _mm_or_si128(
+			_mm_or_si128(
+				_mm_and_si128(upper, _mm_sub_epi8(in, _mm_set1_epi8('A'))),
+				_mm_and_si128(lower, _mm_sub_epi8(in, _mm_set1_epi8('a' - 26)))),
+			_mm_or_si128(
+				_mm_and_si128(digit, _mm_add_epi8(in, _mm_set1_epi8(52 - '0'))),
+				_mm_or_si128(_mm_and_si128(c62, _mm_set1_epi8(62)), _mm_and_si128(c63, _mm_set1_epi8(63)))));
+		
+		/* Join 4 6-bit values into 3 bytes, in big endian order */
+		__m128i merged = _mm_maddubs_epi16(values, _mm_set1_epi32(0x01400140));
+		merged = _mm_madd_epi16(merged, _mm_set1_epi32(0x00011000));
+		merged = _mm_shuffle_epi8(merged, _mm_setr_epi8(2, 1, 0, 6, 5, 4, 10, 9, 8, 14, 13, 12, -1, -1, -1, -1));
+		_mm_storeu_si128((__m128i*)out, merged);
+	}
+	return i;
+}
+
+// Encode 16 bytes at a time
+__attribute__((target("ssse3")))
+static size_t hex_encode_ssse3(const uint8_t *src, size_t n, char *out, int upper){
+	const __m128i digits = upper
+		? _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'A', 'B', 'C', 'D', 'E', 'F')
+		: _mm_setr_epi8('0', '1', '2', '3', '4', '5', '6', '7', '8', '9', 'a', 'b', 'c', 'd', 'e', 'f');
+	const __m128i mask = _mm_set1_epi8(0x0f);
+	size_t i = 0;
+	for(; i + 16 <= n; i += 16, out += 32){
+		__m128i in = _mm_loadu_si128((const __m128i*)(src + i));
+		__m128i hi = _mm_shuffle_epi8(digits, _mm_and_si128(_mm_srli_epi16(in, 4), mask));
+		__m128i lo = _mm_shuffle_epi8(digits, _mm_and_si128(in, mask));
+		_mm_storeu_si128((__m128i*)out, _mm_unpacklo_epi8(hi, lo));
+		_mm_storeu_si128((__m128i*)(out + 16), _mm_unpackhi_epi8(hi, lo));
+	}
+	return i;
+}
+
+// Get the values of 16 hexadecimal digits, or set valid to 0
+__attribute__((target("ssse3")))
+static __m128i hex_values(__m128i in, int *valid){
+	/* Unsigned x <= max is min(x, max) == x */
+	__m128i digit = _mm_sub_epi8(in, _mm_set1_epi8('0'));
+	__m128i is_digit = _mm_cmpeq_epi8(_mm_min_epu8(digit, _mm_set1_epi8(9)), digit);
+	__m128i letter = _mm_sub_epi8(_mm_or_si128(in, _mm_set1_epi8(0x20)), _mm_set1_epi8('a'));
+	__m128i is_letter = _mm_cmpeq_epi8(_mm_min_epu8(letter, _mm_set1_epi8(5)), letter);
+	if(_mm_movemask_epi8(_mm_or_si128(is_digit, is_letter)) != 0xffff) *valid = 0;
+	return _mm_or_si128(_mm_and_si128(is_digit, digit),
+		_mm_and_si128(is_letter, _mm_add_epi8(letter, _mm_set1_epi8(10))));
+}
+
+// Decode 32 digits at a time, stops before a vector with invalid digits
+__attribute__((target("ssse3")))
+static size_t hex_decode_ssse3(const char *src, size_t n, uint8_t *out){
+	size_t i = 0;
+	for(; i + 32 <= n; i += 32, out += 16){
+		int valid = 1;
+		__m128i a = hex_values(_mm_loadu_si128((const __m128i*)(src + i)), &valid);
+		__m128i b = hex_values(_mm_loadu_si128((const __m128i*)(src + i + 16)), &valid);
+		if(!valid) break;
+		
+		/* Join pairs of digits into bytes */
+		a = _mm_maddubs_epi16(a, _mm_set1_epi16(0x0110));
+		b = _mm_maddubs_epi16(b, _mm_set1_epi16(0x0110));
+		_mm_storeu_si128((__m128i*)out, _mm_packus_epi16(a, b));
+	}
+	return i;
+}
+
+#endif
+
+static size_t (*base64_encode_bulk)(const uint8_t*, size_t, char*, const char*) = base64_encode_none;
+static size_t (*base64_decode_bulk)(const char*, size_t, uint8_t*, const char*) = base64_decode_none;
+static size_t (*hex_encode_bulk)(const uint8_t*, size_t, char*, int) = hex_encode_none;
+static size_t (*hex_decode_bulk)(const char*, size_t, uint8_t*) = hex_decode_none;
+
+size_t base64_encode(const uint8_t *src, size_t n, char *out, const char chars[2], char pad){
+	char table[64];
+	memcpy(table, base64_alphabet, 62);
+	table[62] = chars[0];
+	table[63] = chars[1];
+	
+	size_t i = base64_encode_bulk(src, n, out, chars);
+	char *op = out + i / 3 * 4;
+	for(; i + 3 <= n; i += 3, op += 4){
+		uint32_t v = src[i] << 16 | src[i+1] << 8 | src[i+2];
+		op[0] = table[v >> 18];
+		op[1] = table[(v >> 12) & 63];
+		op[2] = table[(v >> 6) & 63];
+		op[3] = table[v & 63];
+	}
+	
+	/* Last 1 or 2 bytes */
+	if(i < n){
+		uint32_t v = src[i] << 16 | (i + 1 < n ? src[i+1] << 8 : 0);
+		*op++ = table[v >> 18];
+		*op++ = table[(v >> 12) & 63];
+		if(i + 1 < n) *op++ = table[(v >> 6) & 63];
+		else if(pad) *op++ = pad;
+		if(pad) *op++ = pad;
+	}
+	return op - out;
+}
+
+ptrdiff_t base64_decode(const char *src, size_t n, uint8_t *out, const char chars[2], char pad, int strict, int strictPadding){
+	uint8_t table[256];
+	memset(table, BASE64_INVALID, sizeof(table));
+	for(int i = 0; i < 62; i++) table[(uint8_t)base64_alphabet[i]] = i;
+	table['\r'] = BASE64_SKIP;
+	table['\n'] = BASE64_SKIP;
+	if(pad) table[(uint8_t)pad] = BASE64_PAD;
+	table[(uint8_t)chars[0]] = 62;
+	table[(uint8_t)chars[1]] = 63;
+	
+	uint8_t *op = out;
+	uint32_t acc = 0;
+	int count = 0; // number of characters in acc
+	int padded = 0; // number of padding characters
+	size_t i = 0;
+	while(i < n){
+		/* Use the vector version again once a group of 4 is complete */
+		if(count == 0 && !padded){
+			size_t done = base64_decode_bulk(src + i, n - i, op, chars);
+			i += done;
+			op += done / 4 * 3;
+			if(i >= n) break;
+		}
+		
+		uint8_t v = table[(uint8_t)src[i++]];
+		if(v < 64){
+			if(padded) return -1; // data after the padding
+			acc = acc << 6 | v;
+			if(++count == 4){
+				op[0] = acc >> 16;
+				op[1] = acc >> 8;
+				op[2] = acc;
+				op += 3;
+				acc = 0;
+				count = 0;
+			}
+		}else if(v == BASE64_PAD){
+			padded++;
+		}else if(v == BASE64_INVALID && strict){
+			return -1;
+		}
+	}
+	
+	/* A partial group at the end, which may have had padding */
+	if(count == 1) return -1;
+	if(strictPadding && pad && (count + padded) % 4 != 0) return -1;
+	if(count == 2){
+		*op++ = acc >> 4;
+	}else if(count == 3){
+		*op++ = acc >> 10;
+		*op++ = acc >> 2;
+	}
+	return op - out;
+}
+
+void hex_encode(const uint8_t *src, size_t n, char *out, int upper){
+	const char *digits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	size_t i = hex_encode_bulk(src, n, out, upper);
+	for(; i < n; i++){
+		out[2*i] = digits[src[i] >> 4];
+		out[2*i + 1] = digits[src[i] & 0x0f];
+	}
+}
+
+static int hex_value(uint8_t c){
+	if((uint8_t)(c - '0') < 10) return c - '0';
+	c |= 0x20; // lower case
+	if((uint8_t)(c - 'a') < 6) return c - 'a' + 10;
+	return -1;
+}
+
+ptrdiff_t hex_decode(const char *src, size_t n, uint8_t *out){
+	if(n % 2 != 0) return -1;
+	size_t i = hex_decode_bulk(src, n, out);
+	for(; i < n; i += 2){
+		int hi = hex_value(src[i]);
+		int lo = hex_value(src[i+1]);
+		if(hi < 0 || lo < 0) return -1;
+		out[i/2] = hi << 4 | lo;
+	}
+	return n / 2;
+}
+
+void encoding_init(void){
+#if ENCODING_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("ssse3")){
+		base64_encode_bulk = base64_encode_ssse3;
+		base64_decode_bulk = base64_decode_ssse3;
+		hex_encode_bulk = hex_encode_ssse3;
+		hex_decode_bulk = hex_decode_ssse3;
+	}
+#endif
+}
+
+/* Lua API definitions */
+
+// Get the characters for 62 and 63
+static void encoding_checkchars(lua_State *L, int idx, char chars[2]){
+	size_t length;
+	const char *str = luaL_optlstring(L, idx, "+/", &length);
+	luaL_argcheck(L, length == 2, idx, "expected 2 characters");
+	chars[0] = str[0];
+	chars[1] = str[1];
+}
+
+// Get the padding character, or 0 for false
+static char encoding_checkpad(lua_State *L, int idx){
+	if(lua_isnoneornil(L, idx)) return '=';
+	if(lua_isboolean(L, idx) && !lua_toboolean(L, idx)) return 0;
+	size_t length;
+	const char *str = luaL_checklstring(L, idx, &length);
+	luaL_argcheck(L, length == 1, idx, "expected 1 character");
+	return str[0];
+}
+
+/***
+ * Encode data as base64.
+ * Also available as a method on `Buffer`s.
+ * @function toBase64
+ * @tparam Buffer|string data
+ * @tparam[opt="+/"] string chars the characters for 62 and 63
+ * @tparam[optchain="="] string|false padding the padding character, or `false` for none
+ * @treturn string
+ */
+int encoding_toBase64(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	char chars[2];
+	encoding_checkchars(L, 2, chars);
+	char pad = encoding_checkpad(L, 3);
+	luaL_Buffer result;
+	char *out = luaL_buffinitsize(L, &result, BASE64_LENGTH(size));
+	luaL_pushresultsize(&result, base64_encode(data, size, out, chars, pad));
+	return 1;
+}
+
+/***
+ * Decode base64 data.
+ * Newlines are skipped, and padding at the end is optional unless
+ * `strictPadding` is set.
+ * @function fromBase64
+ * @tparam Buffer|string str
+ * @tparam[opt="+/"] string chars the characters for 62 and 63
+ * @tparam[optchain="="] string|false padding the padding character, or `false` for none
+ * @tparam[optchain=true] boolean strict whether to fail on characters outside
+ * of the alphabet, instead of skipping them
+ * @tparam[optchain=false] boolean strictPadding whether to fail when the last
+ * group is not padded to 4 characters
+ * @treturn[1] Buffer
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ */
+int encoding_fromBase64(lua_State *L){
+	size_t size;
+	const char *str = (const char*)buffer_checkbytes(L, 1, &size);
+	char chars[2];
+	encoding_checkchars(L, 2, chars);
+	char pad = encoding_checkpad(L, 3);
+	int strict = lua_isnoneornil(L, 4) || lua_toboolean(L, 4);
+	int strictPadding = lua_toboolean(L, 5);
+	Buffer *buffer = buffer_newgrowable(L, size / 4 * 3 + 16);
+	ptrdiff_t result = base64_decode(str, size, buffer->buffer, chars, pad, strict, strictPadding);
+	if(result < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid base64");
+		return 2;
+	}
+	buffer->size = result;
+	return 1;
+}
+
+/***
+ * Encode data as hexadecimal.
+ * Also available as a method on `Buffer`s.
+ * @function toHex
+ * @tparam Buffer|string data
+ * @tparam[opt=false] boolean upper whether to use upper case digits
+ * @treturn string
+ */
+int encoding_toHex(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	int upper = lua_toboolean(L, 2);
+	luaL_Buffer result;
+	char *out = luaL_buffinitsize(L, &result, size * 2);
+	hex_encode(data, size, out, upper);
+	luaL_pushresultsize(&result, size * 2);
+	return 1;
+}
+
+/***
+ * Decode hexadecimal data.
+ * @function fromHex
+ * @tparam Buffer|string str upper or lower case digits, without spaces
+ * @treturn[1] Buffer
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ */
+int encoding_fromHex(lua_State *L){
+	size_t size;
+	const char *str = (const char*)buffer_checkbytes(L, 1, &size);
+	Buffer *buffer = buffer_newgrowable(L, size / 2);
+	ptrdiff_t result = hex_decode(str, size, buffer->buffer);
+	if(result < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, "invalid hex");
+		return 2;
+	}
+	buffer->size = result;
+	return 1;
+}
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+// Length of the base64 encoding of n bytes, with padding
+#define BASE64_LENGTH(n) (((n) + 2) / 3 * 4)
+
+// Encode n bytes as base64 into out, which needs room for BASE64_LENGTH(n)
+// characters. chars are the characters for 62 and 63, pad is the padding
+// character or 0 for none. Returns the number of characters written
+size_t base64_encode(const uint8_t *src, size_t n, char *out, const char chars[2], char pad);
+
+// Decode n characters of base64 into out, which needs room for n/4*3 + 16
+// bytes. Skips newlines, and other characters outside of the alphabet when
+// not strict. With strictPadding, a last group without its padding is invalid.
+// Returns the number of bytes written, or -1 on invalid input
+ptrdiff_t base64_decode(const char *src, size_t n, uint8_t *out, const char chars[2], char pad, int strict, int strictPadding);
+
+// Encode n bytes as 2n hexadecimal digits into out
+void hex_encode(const uint8_t *src, size_t n, char *out, int upper);
+
+// Decode n hexadecimal digits into n/2 bytes at out.
+// Returns the number of bytes written, or -1 on invalid input
+ptrdiff_t hex_decode(const char *src, size_t n, uint8_t *out);
+
+// Select the kernels for this CPU, can be called multiple times
+void encoding_init(void);
+
+/* Lua API definitions */
+
+int encoding_toBase64(lua_State *L);
+int encoding_fromBase64(lua_State *L);
+int encoding_toHex(lua_State *L);
+int encoding_fromHex(lua_State *L);
@@ -133,9 +133,8 @@ void event_dispatch_event(lua_State *L){
 	lua_pop(L, 2); // stack: {...}
 }
 
-// Poll for events
-void event_poll(lua_State *L){
-	/* Poll for timers */
+// Poll for timers
+void event_poll_timers(lua_State *L){
 	uint32_t tick = SDL_GetTicks();
 	lua_getfield(L, LUA_REGISTRYINDEX, "event_timers"); // stack: {timers, ...}
 	int n = table_getn(L, -1);
@@ -167,6 +166,12 @@ void event_poll(lua_State *L){
 		lua_pop(L, 1); // stack: {timers, ...}
 	}
 	lua_pop(L, 1); // stack: {...}
+}
+
+// Poll for events
+void event_poll(lua_State *L){
+	/* Poll for timers */
+	event_poll_timers(L);
 	
 	/* Poll for SDL events */
 	SDL_Event e;
@@ -237,14 +242,17 @@ void event_poll(lua_State *L){
 	}
 }
 
-// Handle events and dispatch them to Lua
-int event_loop(lua_State *L){
-	uint32_t loop_start = SDL_GetTicks();
-	
+// Poll for events and dispatch them to Lua once, without waiting
+// Only polls for timers when poll_sdl is 0
+int event_dispatch(lua_State *L, int poll_sdl){
 	int quit = 1;
 	if(lua_getfield(L, LUA_REGISTRYINDEX, "event_queue") == LUA_TTABLE){ // stack: {queue}
-		/* Poll for SDL events */
-		event_poll(L);
+		/* Poll for SDL events and timers */
+		if(poll_sdl){
+			event_poll(L);
+		}else{
+			event_poll_timers(L);
+		}
 		
 		/* Handle Lua events */
 		for(int i = 1; i <= table_getn(L, -1); i++){
@@ -256,6 +264,14 @@ int event_loop(lua_State *L){
 		quit = 0;
 	}
 	lua_pop(L, 1); // stack: {}
+	return quit;
+}
+
+// Handle events and dispatch them to Lua
+int event_loop(lua_State *L){
+	uint32_t loop_start = SDL_GetTicks();
+	
+	int quit = event_dispatch(L, 1);
 	
 	/* Prevent too high cpu usage (SDL_Delay), and let other threads (if any)
 	put events in the queue (unlock_mutex, sched_yield) */
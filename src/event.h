@@ -37,9 +37,17 @@ void event_dispatch_callback(lua_State *L, Callback *callback, int i);
 // Dispatch event to Lua callbacks
 void event_dispatch_event(lua_State *L);
 
+// Poll for timers
+void event_poll_timers(lua_State *L);
+
 // Poll for events
 void event_poll(lua_State *L);
 
+// Poll for events and dispatch them to Lua once, without waiting
+// Only polls for timers when poll_sdl is 0
+// Returns 1 when there is no event queue
+int event_dispatch(lua_State *L, int poll_sdl);
+
 // Handle events and dispatch them to Lua
 int event_loop(lua_State *L);
 
@@ -13,6 +13,7 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include "Buffer.h"
 #include "fs.h"
 
 /* C library definitions */
@@ -43,6 +44,17 @@ FS_File *fs_getfile(lua_State *L){
 	return file;
 }
 
+// Get the Buffer at idx, and the bytes from the offset at idx+1 to be read or written
+uint8_t *fs_checkbuffer(lua_State *L, int idx, size_t *n){
+	Buffer *buffer = luaL_checkudata(L, idx, "Buffer");
+	lua_Integer offset = luaL_optinteger(L, idx + 1, 0);
+	luaL_argcheck(L, offset >= 0 && (size_t)offset <= buffer->size, idx + 1, "offset out of bounds");
+	lua_Integer size = luaL_optinteger(L, idx + 2, buffer->size - offset);
+	luaL_argcheck(L, size >= 0 && (size_t)size <= buffer->size - offset, idx + 2, "size out of bounds");
+	*n = size;
+	return buffer->buffer + offset;
+}
+
 /* Lua API definitions */
 
 int fs_mount_l(lua_State *L){
@@ -99,15 +111,34 @@ int fs_lines(lua_State *L){
 
 int fs_read(lua_State *L){
 	FS_File *file = fs_getfile(L);
-	int n = luaL_checkinteger(L, 2);
-	char *buffer = malloc(n * sizeof(char));
-	int n_read = file->fs->read(file->fd, buffer, n);
-	if(n_read > 0){
-		lua_pushlstring(L, buffer, n_read);
-	}else{
+	lua_Integer n = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, n >= 0, 2, "must be >= 0");
+	
+	/* Read straight into the string buffer */
+	luaL_Buffer b;
+	char *buffer = luaL_buffinitsize(L, &b, n);
+	size_t n_read = file->fs->read(file->fd, buffer, n);
+	luaL_pushresultsize(&b, n_read);
+	if(n_read == 0 && n > 0){
+		lua_pop(L, 1);
 		lua_pushnil(L);
 	}
-	free(buffer);
+	return 1;
+}
+
+/***
+ * Read bytes straight into a `Buffer`, without copying them.
+ * @function readInto
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset index in the buffer
+ * @tparam[optchain] number n the maximum number of bytes, up to the end of the buffer by default
+ * @treturn number the number of bytes read, 0 at the end of the file
+ */
+int fs_readInto(lua_State *L){
+	FS_File *file = fs_getfile(L);
+	size_t n;
+	uint8_t *dst = fs_checkbuffer(L, 2, &n);
+	lua_pushinteger(L, file->fs->read(file->fd, (char*)dst, n));
 	return 1;
 }
 
@@ -140,8 +171,38 @@ int fs_setvbuf(lua_State *L){
 	return luaL_fileresult(L, res == 0, NULL);
 }
 
+// Adapted from g_write in Lua's liolib.c
 int fs_write(lua_State *L){
-	return 0;
+	FS_File *file = fs_getfile(L);
+	int nargs = lua_gettop(L);
+	int status = 1;
+	for(int arg = 2; arg <= nargs; arg++){
+		size_t len;
+		const char *s = luaL_checklstring(L, arg, &len);
+		status = status && (file->fs->write(file->fd, s, len) == len);
+	}
+	if(!status) return luaL_fileresult(L, status, NULL);
+	lua_settop(L, 1); // return file
+	return 1;
+}
+
+/***
+ * Write bytes straight from a `Buffer`, without copying them.
+ * @function writeFrom
+ * @tparam Buffer buffer
+ * @tparam[opt=0] number offset index in the buffer
+ * @tparam[optchain] number n the number of bytes, up to the end of the buffer by default
+ * @treturn[1] number the number of bytes written
+ * @treturn[2] nil
+ * @treturn[2] string err
+ */
+int fs_writeFrom(lua_State *L){
+	FS_File *file = fs_getfile(L);
+	size_t n;
+	const uint8_t *src = fs_checkbuffer(L, 2, &n);
+	if(file->fs->write(file->fd, (const char*)src, n) != n) return luaL_fileresult(L, 0, NULL);
+	lua_pushinteger(L, n);
+	return 1;
 }
 
 int fs__gc(lua_State *L){
@@ -161,9 +222,11 @@ static const struct luaL_Reg fs_file_f[] = {
 	{"flush", fs_flush},
 	{"lines", fs_lines},
 	{"read", fs_read},
+	{"readInto", fs_readInto},
 	{"seek", fs_seek},
 	{"setvbuf", fs_setvbuf},
 	{"write", fs_write},
+	{"writeFrom", fs_writeFrom},
 	{NULL, NULL}
 };
 
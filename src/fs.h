@@ -18,12 +18,12 @@ typedef struct FS {
 	
 	int (*close)(void *file);
 	int (*flush)(void *file);
-	size_t (*read)(void *file, char *buffer, int n);
+	size_t (*read)(void *file, char *buffer, size_t n);
 	char (*getc)(void *file);
 	int (*seek)(void *file, long offset, int whence);
 	long (*tell)(void *file);
 	int (*setvbuf)(void *file, int mode, size_t size);
-	size_t (*write)(void *file, const char *content);
+	size_t (*write)(void *file, const char *data, size_t n);
 } FS;
 
 /* Lua API definitions */
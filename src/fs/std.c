@@ -31,7 +31,7 @@ static int fs_std_flush(void *file){
 	return fflush(file);
 }
 
-static size_t fs_std_read(void *file, char *buffer, int n){
+static size_t fs_std_read(void *file, char *buffer, size_t n){
 	return fread(buffer, sizeof(char), n, file);
 }
 
@@ -51,8 +51,8 @@ static int fs_std_setvbuf(void *file, int mode, size_t size){
 	return setvbuf(file, NULL, mode, size);
 }
 
-static size_t fs_std_write(void *file, const char *content){
-	return fwrite(content, sizeof(char), strlen(content), file);
+static size_t fs_std_write(void *file, const char *data, size_t n){
+	return fwrite(data, sizeof(char), n, file);
 }
 
 FS fs_std = {
@@ -0,0 +1,501 @@
+/***
+ * Checksums and hashes of `Buffer`s and strings.
+ * 
+ * `crc32c` is the CRC-32C (Castagnoli) checksum, computed with the SSE4.2
+ * `crc32` instruction when the CPU has it. `xxh32` and `xxh64` are the xxHash
+ * non-cryptographic hashes. All return integers; 64-bit hashes can be negative,
+ * use `string.format("%016x", h)` to print them.
+ * 
+ * @submodule Buffer
+ * @usage
+ * local h = Buffer.hasher("xxh64")
+ * for chunk in file:lines(4096) do h:update(chunk) end
+ * print(string.format("%016x", h:digest()))
+ */
+
+#include <string.h> // for memcpy
+
+#if defined(__x86_64__) || defined(__i386__)
+	#define HASH_X86 1
+	#include <immintrin.h> // for _mm_crc32_u8 etc
+#else
+	#define HASH_X86 0
+#endif
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "hash.h"
+
+/* C library definitions */
+
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+	#define HASH_LE32(x) (x)
+	#define HASH_LE64(x) (x)
+#else
+	#define HASH_LE32(x) __builtin_bswap32(x)
+	#define HASH_LE64(x) __builtin_bswap64(x)
+#endif
+
+static uint32_t load32(const uint8_t *p){
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return HASH_LE32(x);
+}
+
+static uint64_t load64(const uint8_t *p){
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+	return HASH_LE64(x);
+}
+
+static uint32_t rotl32(uint32_t x, int r){
+	return (x << r) | (x >> (32 - r));
+}
+
+static uint64_t rotl64(uint64_t x, int r){
+	return (x << r) | (x >> (64 - r));
+}
+
+/* CRC32C */
+
+#define CRC32C_POLY 0x82f63b78 // reversed Castagnoli polynomial
+
+// Slicing-by-8 tables, for CPUs without the crc32 instruction
+static uint32_t crc32c_table[8][256];
+
+static void crc32c_init_table(void){
+	for(uint32_t i = 0; i < 256; i++){
+		uint32_t crc = i;
+		for(int bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (CRC32C_POLY & -(crc & 1));
+		crc32c_table[0][i] = crc;
+	}
+	for(uint32_t i = 0; i < 256; i++){
+		for(int t = 1; t < 8; t++){
+			uint32_t prev = crc32c_table[t-1][i];
+			crc32c_table[t][i] = (prev >> 8) ^ crc32c_table[0][prev & 0xff];
+		}
+	}
+}
+
+static uint32_t crc32c_scalar(uint32_t crc, const uint8_t *p, size_t n){
+	crc = ~crc;
+	for(; n >= 8; p += 8, n -= 8){
+		uint32_t lo = load32(p) ^ crc;
+		uint32_t hi = load32(p + 4);
+		crc = crc32c_table[7][lo & 0xff] ^ crc32c_table[6][(lo >> 8) & 0xff]
+			^ crc32c_table[5][(lo >> 16) & 0xff] ^ crc32c_table[4][lo >> 24]
+			^ crc32c_table[3][hi & 0xff] ^ crc32c_table[2][(hi >> 8) & 0xff]
+			^ crc32c_table[1][(hi >> 16) & 0xff] ^ crc32c_table[0][hi >> 24];
+	}
+	for(; n > 0; p++, n--) crc = (crc >> 8) ^ crc32c_table[0][(crc ^ *p) & 0xff];
+	return ~crc;
+}
+
+#if HASH_X86
+__attribute__((target("sse4.2")))
+static uint32_t crc32c_sse42(uint32_t crc, const uint8_t *p, size_t n){
+	crc = ~crc;
+#if defined(__x86_64__)
+	uint64_t crc64 = crc;
+	for(; n >= 8; p += 8, n -= 8){
+		uint64_t x;
+		memcpy(&x, p, sizeof(x));
+		crc64 = _mm_crc32_u64(crc64, x);
+	}
+	crc = (uint32_t)crc64;
+#endif
+	for(; n >= 4; p += 4, n -= 4){
+		uint32_t x;
+		memcpy(&x, p, sizeof(x));
+		crc = _mm_crc32_u32(crc, x);
+	}
+	for(; n > 0; p++, n--) crc = _mm_crc32_u8(crc, *p);
+	return ~crc;
+}
+#endif
+
+uint32_t (*crc32c_update)(uint32_t, const uint8_t*, size_t) = crc32c_scalar;
+
+/* xxHash32, see https://github.com/Cyan4973/xxHash/blob/dev/doc/xxhash_spec.md */
+
+#define XXH_PRIME32_1 0x9e3779b1U
+#define XXH_PRIME32_2 0x85ebca77U
+#define XXH_PRIME32_3 0xc2b2ae3dU
+#define XXH_PRIME32_4 0x27d4eb2fU
+#define XXH_PRIME32_5 0x165667b1U
+
+static uint32_t xxh32_round(uint32_t acc, uint32_t input){
+	acc += input * XXH_PRIME32_2;
+	return rotl32(acc, 13) * XXH_PRIME32_1;
+}
+
+void xxh32_reset(XXH32State *state, uint32_t seed){
+	state->total = 0;
+	state->seed = seed;
+	state->v[0] = seed + XXH_PRIME32_1 + XXH_PRIME32_2;
+	state->v[1] = seed + XXH_PRIME32_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME32_1;
+	state->memsize = 0;
+}
+
+// Process 16-byte stripes, returns the number of bytes processed
+static size_t xxh32_stripes(uint32_t v[4], const uint8_t *p, size_t n){
+	size_t done = 0;
+	for(; done + 16 <= n; done += 16){
+		v[0] = xxh32_round(v[0], load32(p + done));
+		v[1] = xxh32_round(v[1], load32(p + done + 4));
+		v[2] = xxh32_round(v[2], load32(p + done + 8));
+		v[3] = xxh32_round(v[3], load32(p + done + 12));
+	}
+	return done;
+}
+
+void xxh32_update(XXH32State *state, const uint8_t *data, size_t n){
+	state->total += n;
+	
+	/* Fill up the partial stripe from a previous update first */
+	if(state->memsize > 0){
+		size_t fill = 16 - state->memsize;
+		if(n < fill){
+			memcpy(state->mem + state->memsize, data, n);
+			state->memsize += n;
+			return;
+		}
+		memcpy(state->mem + state->memsize, data, fill);
+		xxh32_stripes(state->v, state->mem, 16);
+		data += fill;
+		n -= fill;
+		state->memsize = 0;
+	}
+	
+	size_t done = xxh32_stripes(state->v, data, n);
+	memcpy(state->mem, data + done, n - done);
+	state->memsize = n - done;
+}
+
+uint32_t xxh32_digest(const XXH32State *state){
+	uint32_t h;
+	if(state->total >= 16){
+		const uint32_t *v = state->v;
+		h = rotl32(v[0], 1) + rotl32(v[1], 7) + rotl32(v[2], 12) + rotl32(v[3], 18);
+	}else{
+		h = state->seed + XXH_PRIME32_5;
+	}
+	h += (uint32_t)state->total;
+	
+	/* Process the remaining bytes */
+	const uint8_t *p = state->mem;
+	size_t n = state->memsize;
+	for(; n >= 4; p += 4, n -= 4){
+		h += load32(p) * XXH_PRIME32_3;
+		h = rotl32(h, 17) * XXH_PRIME32_4;
+	}
+	for(; n > 0; p++, n--){
+		h += *p * XXH_PRIME32_5;
+		h = rotl32(h, 11) * XXH_PRIME32_1;
+	}
+	
+	/* Avalanche */
+	h ^= h >> 15;
+	h *= XXH_PRIME32_2;
+	h ^= h >> 13;
+	h *= XXH_PRIME32_3;
+	h ^= h >> 16;
+	return h;
+}
+
+uint32_t xxh32(const uint8_t *data, size_t n, uint32_t seed){
+	XXH32State state;
+	xxh32_reset(&state, seed);
+	xxh32_update(&state, data, n);
+	return xxh32_digest(&state);
+}
+
+/* xxHash64 */
+
+#define XXH_PRIME64_1 0x9e3779b185ebca87ULL
+#define XXH_PRIME64_2 0xc2b2ae3d27d4eb4fULL
+#define XXH_PRIME64_3 0x165667b19e3779f9ULL
+#define XXH_PRIME64_4 0x85ebca77c2b2ae63ULL
+#define XXH_PRIME64_5 0x27d4eb2f165667c5ULL
+
+static uint64_t xxh64_round(uint64_t acc, uint64_t input){
+	acc += input * XXH_PRIME64_2;
+	return rotl64(acc, 31) * XXH_PRIME64_1;
+}
+
+static uint64_t xxh64_merge(uint64_t acc, uint64_t v){
+	acc ^= xxh64_round(0, v);
+	return acc * XXH_PRIME64_1 + XXH_PRIME64_4;
+}
+
+void xxh64_reset(XXH64State *state, uint64_t seed){
+	state->total = 0;
+	state->seed = seed;
+	state->v[0] = seed + XXH_PRIME64_1 + XXH_PRIME64_2;
+	state->v[1] = seed + XXH_PRIME64_2;
+	state->v[2] = seed;
+	state->v[3] = seed - XXH_PRIME64_1;
+	state->memsize = 0;
+}
+
+// Process 32-byte stripes, returns the number of bytes processed
+static size_t xxh64_stripes(uint64_t v[4], const uint8_t *p, size_t n){
+	size_t done = 0;
+	for(; done + 32 <= n; done += 32){
+		v[0] = xxh64_round(v[0], load64(p + done));
+		v[1] = xxh64_round(v[1], load64(p + done + 8));
+		v[2] = xxh64_round(v[2], load64(p + done + 16));
+		v[3] = xxh64_round(v[3], load64(p + done + 24));
+	}
+	return done;
+}
+
+void xxh64_update(XXH64State *state, const uint8_t *data, size_t n){
+	state->total += n;
+	
+	/* Fill up the partial stripe from a previous update first */
+	if(state->memsize > 0){
+		size_t fill = 32 - state->memsize;
+		if(n < fill){
+			memcpy(state->mem + state->memsize, data, n);
+			state->memsize += n;
+			return;
+		}
+		memcpy(state->mem + state->memsize, data, fill);
+		xxh64_stripes(state->v, state->mem, 32);
+		data += fill;
+		n -= fill;
+		state->memsize = 0;
+	}
+	
+	size_t done = xxh64_stripes(state->v, data, n);
+	memcpy(state->mem, data + done, n - done);
+	state->memsize = n - done;
+}
+
+uint64_t xxh64_digest(const XXH64State *state){
+	uint64_t h;
+	if(state->total >= 32){
+		const uint64_t *v = state->v;
+		h = rotl64(v[0], 1) + rotl64(v[1], 7) + rotl64(v[2], 12) + rotl64(v[3], 18);
+		for(int i = 0; i < 4; i++) h = xxh64_merge(h, v[i]);
+	}else{
+		h = state->seed + XXH_PRIME64_5;
+	}
+	h += state->total;
+	
+	/* Process the remaining bytes */
+	const uint8_t *p = state->mem;
+	size_t n = state->memsize;
+	for(; n >= 8; p += 8, n -= 8){
+		h ^= xxh64_round(0, load64(p));
+		h = rotl64(h, 27) * XXH_PRIME64_1 + XXH_PRIME64_4;
+	}
+	if(n >= 4){
+		h ^= (uint64_t)load32(p) * XXH_PRIME64_1;
+		h = rotl64(h, 23) * XXH_PRIME64_2 + XXH_PRIME64_3;
+		p += 4;
+		n -= 4;
+	}
+	for(; n > 0; p++, n--){
+		h ^= *p * XXH_PRIME64_5;
+		h = rotl64(h, 11) * XXH_PRIME64_1;
+	}
+	
+	/* Avalanche */
+	h ^= h >> 33;
+	h *= XXH_PRIME64_2;
+	h ^= h >> 29;
+	h *= XXH_PRIME64_3;
+	h ^= h >> 32;
+	return h;
+}
+
+uint64_t xxh64(const uint8_t *data, size_t n, uint64_t seed){
+	XXH64State state;
+	xxh64_reset(&state, seed);
+	xxh64_update(&state, data, n);
+	return xxh64_digest(&state);
+}
+
+void hash_init(void){
+	if(crc32c_table[0][1] == 0) crc32c_init_table();
+#if HASH_X86
+	__builtin_cpu_init();
+	if(__builtin_cpu_supports("sse4.2")) crc32c_update = crc32c_sse42;
+#endif
+}
+
+/* Lua API definitions */
+
+typedef enum HashAlgorithm {
+	HASH_CRC32C,
+	HASH_XXH32,
+	HASH_XXH64,
+} HashAlgorithm;
+
+static const char *const hash_algorithms[] = {"crc32c", "xxh32", "xxh64", NULL};
+
+typedef struct Hasher {
+	HashAlgorithm algorithm;
+	uint32_t crc;
+	XXH32State xxh32;
+	XXH64State xxh64;
+} Hasher;
+
+/***
+ * Get the CRC-32C checksum.
+ * Also available as a method on `Buffer`s.
+ * @function crc32c
+ * @tparam Buffer|string data
+ * @tparam[opt=0] number crc the checksum of the previous data, to continue from
+ * @treturn number a 32-bit checksum
+ * @usage assert(Buffer.crc32c("456789", Buffer.crc32c("123")) == Buffer.crc32c("123456789"))
+ */
+int hash_crc32c(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	uint32_t crc = (uint32_t)luaL_optinteger(L, 2, 0);
+	lua_pushinteger(L, crc32c_update(crc, data, size));
+	return 1;
+}
+
+/***
+ * Get the xxHash32 hash.
+ * Also available as a method on `Buffer`s.
+ * @function xxh32
+ * @tparam Buffer|string data
+ * @tparam[opt=0] number seed
+ * @treturn number a 32-bit hash
+ */
+int hash_xxh32(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	uint32_t seed = (uint32_t)luaL_optinteger(L, 2, 0);
+	lua_pushinteger(L, xxh32(data, size, seed));
+	return 1;
+}
+
+/***
+ * Get the xxHash64 hash.
+ * Also available as a method on `Buffer`s.
+ * @function xxh64
+ * @tparam Buffer|string data
+ * @tparam[opt=0] number seed
+ * @treturn number a 64-bit hash
+ */
+int hash_xxh64(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	uint64_t seed = (uint64_t)luaL_optinteger(L, 2, 0);
+	lua_pushinteger(L, (lua_Integer)xxh64(data, size, seed));
+	return 1;
+}
+
+/***
+ * Create a hasher, to hash data that arrives in parts.
+ * @function hasher
+ * @tparam string algorithm `"crc32c"`, `"xxh32"` or `"xxh64"`
+ * @tparam[opt=0] number seed the seed for xxHash, or the initial crc for crc32c
+ * @treturn Hasher
+ */
+int hash_hasher(lua_State *L){
+	HashAlgorithm algorithm = luaL_checkoption(L, 1, NULL, hash_algorithms);
+	uint64_t seed = (uint64_t)luaL_optinteger(L, 2, 0);
+	Hasher *hasher = lua_newuserdata(L, sizeof(Hasher));
+	hasher->algorithm = algorithm;
+	hasher->crc = (uint32_t)seed;
+	xxh32_reset(&hasher->xxh32, (uint32_t)seed);
+	xxh64_reset(&hasher->xxh64, seed);
+	luaL_setmetatable(L, "Hasher");
+	return 1;
+}
+
+/// @type Hasher
+
+/***
+ * Add data to the hash.
+ * @function update
+ * @tparam Buffer|string data
+ * @treturn Hasher self
+ */
+int hasher_update(lua_State *L){
+	Hasher *hasher = luaL_checkudata(L, 1, "Hasher");
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 2, &size);
+	switch(hasher->algorithm){
+		case HASH_CRC32C: hasher->crc = crc32c_update(hasher->crc, data, size); break;
+		case HASH_XXH32: xxh32_update(&hasher->xxh32, data, size); break;
+		case HASH_XXH64: xxh64_update(&hasher->xxh64, data, size); break;
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get the hash of all data so far.
+ * This does not change the hasher, more data can be added afterwards.
+ * @function digest
+ * @treturn number
+ */
+int hasher_digest(lua_State *L){
+	Hasher *hasher = luaL_checkudata(L, 1, "Hasher");
+	switch(hasher->algorithm){
+		case HASH_CRC32C: lua_pushinteger(L, hasher->crc); break;
+		case HASH_XXH32: lua_pushinteger(L, xxh32_digest(&hasher->xxh32)); break;
+		case HASH_XXH64: lua_pushinteger(L, (lua_Integer)xxh64_digest(&hasher->xxh64)); break;
+	}
+	return 1;
+}
+
+/***
+ * Start over, as if the hasher was just created.
+ * @function reset
+ * @tparam[opt=0] number seed
+ * @treturn Hasher self
+ */
+int hasher_reset(lua_State *L){
+	Hasher *hasher = luaL_checkudata(L, 1, "Hasher");
+	uint64_t seed = (uint64_t)luaL_optinteger(L, 2, 0);
+	hasher->crc = (uint32_t)seed;
+	xxh32_reset(&hasher->xxh32, (uint32_t)seed);
+	xxh64_reset(&hasher->xxh64, seed);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * __tostring metamethod.
+ * @function __tostring
+ * @treturn string
+ */
+int hasher__tostring(lua_State *L){
+	Hasher *hasher = luaL_checkudata(L, 1, "Hasher");
+	lua_pushfstring(L, "Hasher(%s)", hash_algorithms[hasher->algorithm]);
+	return 1;
+}
+
+static const struct luaL_Reg hasher_f[] = {
+	{"update", hasher_update},
+	{"digest", hasher_digest},
+	{"reset", hasher_reset},
+	{NULL, NULL}
+};
+
+void hash_register(lua_State *L){
+	if(!luaL_newmetatable(L, "Hasher")){ // stack: {metatable, ...}
+		lua_pop(L, 1);
+		return; // already registered
+	}
+	lua_pushcfunction(L, hasher__tostring);
+	lua_setfield(L, -2, "__tostring");
+	lua_newtable(L); // stack: {methods, metatable, ...}
+	luaL_setfuncs(L, hasher_f, 0);
+	lua_setfield(L, -2, "__index");
+	lua_pop(L, 1); // stack: {...}
+}
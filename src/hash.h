@@ -0,0 +1,61 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+// CRC32C (Castagnoli) of n bytes, continuing from crc (0 to start)
+// Uses the SSE4.2 crc32 instruction when available, call hash_init first
+extern uint32_t (*crc32c_update)(uint32_t crc, const uint8_t *data, size_t n);
+
+// Streaming xxHash32 state, used by the lz4 frame format
+typedef struct XXH32State {
+	uint64_t total;  // number of bytes hashed
+	uint32_t v[4];   // accumulators
+	uint32_t seed;
+	uint8_t mem[16]; // bytes that do not yet fill a stripe
+	size_t memsize;
+} XXH32State;
+
+void xxh32_reset(XXH32State *state, uint32_t seed);
+void xxh32_update(XXH32State *state, const uint8_t *data, size_t n);
+uint32_t xxh32_digest(const XXH32State *state);
+uint32_t xxh32(const uint8_t *data, size_t n, uint32_t seed);
+
+// Streaming xxHash64 state
+typedef struct XXH64State {
+	uint64_t total;  // number of bytes hashed
+	uint64_t v[4];   // accumulators
+	uint64_t seed;
+	uint8_t mem[32]; // bytes that do not yet fill a stripe
+	size_t memsize;
+} XXH64State;
+
+void xxh64_reset(XXH64State *state, uint64_t seed);
+void xxh64_update(XXH64State *state, const uint8_t *data, size_t n);
+uint64_t xxh64_digest(const XXH64State *state);
+uint64_t xxh64(const uint8_t *data, size_t n, uint64_t seed);
+
+// Select the kernels for this CPU, can be called multiple times
+void hash_init(void);
+
+// Create the Hasher metatable
+void hash_register(lua_State *L);
+
+/* Lua API definitions */
+
+int hash_crc32c(lua_State *L);
+int hash_xxh32(lua_State *L);
+int hash_xxh64(lua_State *L);
+int hash_hasher(lua_State *L);
+int hasher_update(lua_State *L);
+int hasher_digest(lua_State *L);
+int hasher_reset(lua_State *L);
+
+/* Lua metamethods */
+
+int hasher__tostring(lua_State *L);
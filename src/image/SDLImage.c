@@ -3,6 +3,8 @@
  * @module image.SDLImage
  */
 
+#include <string.h> // for strncmp, strlen
+
 #include <SDL2/SDL.h>
 
 #include <lua.h>
@@ -11,6 +13,7 @@
 
 #include "../util.h"
 #include "../font.h"
+#include "../Buffer.h"
 #include "SDLImage.h"
 
 #define SDLImage_BITDEPTH    32
@@ -258,6 +261,84 @@ int SDLImage_getPixel(lua_State *L){
 	return 3;
 }
 
+// Release the reference to a surface that a Buffer view holds
+static int SDLImage_surface__gc(lua_State *L){
+	SDL_Surface **surface = lua_touserdata(L, 1);
+	SDL_FreeSurface(*surface);
+	return 0;
+}
+
+/***
+ * Get a `Buffer` view of the pixels, to read and write them directly.
+ * Each row of pixels starts `getPitch` bytes after the previous one, and each
+ * pixel is a native-endian uint32 in the format given by `getFormat`, which is
+ * 0x00RRGGBB. The view keeps the pixels alive. Once the image is resized, it
+ * still refers to the old pixels, which are no longer drawn, so get a new one.
+ * Loads the `Buffer` module.
+ * @function buffer
+ * @treturn Buffer
+ * @usage
+ * local pixels = image:buffer():as("uint32")
+ * local stride = image:getPitch() // 4
+ * pixels[y * stride + x] = 0xff8000 -- orange
+ */
+int SDLImage_buffer(lua_State *L){
+	SDLImage *image = luaL_checkudata(L, 1, "SDLImage");
+	
+	/* Make sure the Buffer metatable exists */
+	lua_getglobal(L, "require");
+	lua_pushstring(L, "Buffer");
+	lua_call(L, 1, 0);
+	
+	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer)); // stack: {Buffer, SDLImage}
+	buffer->size = (size_t)image->surface->pitch * image->surface->h;
+	buffer->buffer = image->surface->pixels;
+	buffer->capacity = buffer->size;
+	buffer->kind = BUFFER_VIEW;
+	buffer->owner = NULL;
+	buffer->views = 0;
+	
+	/* Hold a reference to the surface, so the pixels outlive a resize */
+	SDL_Surface **surface = lua_newuserdata(L, sizeof(SDL_Surface*)); // stack: {surface, Buffer, SDLImage}
+	*surface = image->surface;
+	image->surface->refcount++;
+	if(luaL_newmetatable(L, "SDLImage.surface")){
+		lua_pushcfunction(L, SDLImage_surface__gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_setmetatable(L, -2);
+	lua_setuservalue(L, -2); // stack: {Buffer, SDLImage}
+	luaL_setmetatable(L, "Buffer");
+	return 1;
+}
+
+/***
+ * Get the number of bytes from the start of a row of pixels to the next.
+ * @function getPitch
+ * @treturn int pitch
+ */
+int SDLImage_getPitch(lua_State *L){
+	SDLImage *image = luaL_checkudata(L, 1, "SDLImage");
+	lua_pushinteger(L, image->surface->pitch);
+	
+	return 1;
+}
+
+/***
+ * Get the pixel format, as an SDL pixel format name without prefix.
+ * @function getFormat
+ * @treturn string format, such as "RGB888"
+ */
+int SDLImage_getFormat(lua_State *L){
+	SDLImage *image = luaL_checkudata(L, 1, "SDLImage");
+	const char *name = SDL_GetPixelFormatName(image->surface->format->format);
+	const char *prefix = "SDL_PIXELFORMAT_";
+	if(strncmp(name, prefix, strlen(prefix)) == 0) name += strlen(prefix);
+	lua_pushstring(L, name);
+	
+	return 1;
+}
+
 /***
  * Load a font.
  * @function loadFont
@@ -400,6 +481,9 @@ static const struct luaL_Reg SDLImage_f[] = {
 	{"char", SDLImage_char},
 	{"write", SDLImage_write},
 	{"getPixel", SDLImage_getPixel},
+	{"buffer", SDLImage_buffer},
+	{"getPitch", SDLImage_getPitch},
+	{"getFormat", SDLImage_getFormat},
 	{"loadFont", SDLImage_loadFont},
 	{"resize", SDLImage_resize},
 	{"present", SDLImage_present},
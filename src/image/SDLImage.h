@@ -52,6 +52,15 @@ int SDLImage_write(lua_State *L);
 // Gets the pixel colour on the given coordinates
 int SDLImage_getPixel(lua_State *L);
 
+// Returns a Buffer view of the pixels
+int SDLImage_buffer(lua_State *L);
+
+// Returns the number of bytes per row of pixels
+int SDLImage_getPitch(lua_State *L);
+
+// Returns the pixel format name
+int SDLImage_getFormat(lua_State *L);
+
 // Loads a font
 int SDLImage_loadFont(lua_State *L);
 
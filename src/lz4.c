@@ -0,0 +1,712 @@
+/***
+ * LZ4 compression of `Buffer`s and strings.
+ * 
+ * `compress` and `decompress` work on single LZ4 blocks, which do not store
+ * their size. `compressFrame` and `decompressFrame` use the LZ4 frame format,
+ * which is compatible with the `lz4` command line tool. A `Compressor` and
+ * `Decompressor` do the same for data that arrives in parts.
+ * 
+ * All functions return a growable `Buffer`. They take an optional growable
+ * `Buffer` to append to instead, which must not be (a view of) the input.
+ * Buffers belong to the Lua state that created them, so `into` has to come
+ * from the same thread. None of the functions use global state, so separate
+ * threads can compress at once.
+ * 
+ * @submodule Buffer
+ * @usage
+ * local packed = Buffer.compressFrame(data)
+ * assert(Buffer.decompressFrame(packed):compare(data) == 0)
+ */
+
+#include <stdlib.h> // for malloc, realloc, free
+#include <string.h> // for memcpy, memmove, memset
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "hash.h"
+#include "lz4.h"
+
+/* C library definitions */
+
+#define LZ4_MIN_MATCH 4
+#define LZ4_LAST_LITERALS 5 // the last 5 bytes of a block are always literals
+#define LZ4_MF_LIMIT 12     // the last match starts at least 12 bytes before the end
+#define LZ4_MAX_OFFSET 65535
+
+/* Frame format, see https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md */
+#define LZ4_MAGIC 0x184d2204
+#define LZ4_SKIPPABLE_MAGIC 0x184d2a50 // the lowest 4 bits can be anything
+#define LZ4_VERSION 0x40
+#define LZ4_BLOCK_INDEPENDENT 0x20
+#define LZ4_BLOCK_CHECKSUM 0x10
+#define LZ4_CONTENT_SIZE 0x08
+#define LZ4_CONTENT_CHECKSUM 0x04
+#define LZ4_DICT_ID 0x01
+#define LZ4_UNCOMPRESSED 0x80000000 // block size flag
+#define LZ4_BLOCK_SIZE 65536        // of the blocks this compressor writes
+#define LZ4_WINDOW 65536            // history that linked blocks can refer to
+
+static uint32_t load32(const uint8_t *p){
+	uint32_t x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static uint64_t load64(const uint8_t *p){
+	uint64_t x;
+	memcpy(&x, p, sizeof(x));
+	return x;
+}
+
+static uint32_t load32le(const uint8_t *p){
+	return p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24;
+}
+
+static void store32le(uint8_t *p, uint32_t x){
+	p[0] = x;
+	p[1] = x >> 8;
+	p[2] = x >> 16;
+	p[3] = x >> 24;
+}
+
+static uint32_t lz4_hash(uint32_t sequence){
+	return (sequence * 2654435761U) >> (32 - LZ4_HASH_LOG);
+}
+
+// Number of equal bytes at p and match, not going past limit
+static size_t lz4_count(const uint8_t *p, const uint8_t *match, const uint8_t *limit){
+	const uint8_t *start = p;
+	while(p + 8 <= limit){
+		uint64_t diff = load64(p) ^ load64(match);
+		if(diff != 0){
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+			return p - start + (__builtin_ctzll(diff) >> 3);
+#else
+			return p - start + (__builtin_clzll(diff) >> 3);
+#endif
+		}
+		p += 8;
+		match += 8;
+	}
+	while(p < limit && *p == *match){
+		p++;
+		match++;
+	}
+	return p - start;
+}
+
+// Write the rest of a length that did not fit in the token
+static uint8_t *lz4_write_length(uint8_t *op, size_t length){
+	for(; length >= 255; length -= 255) *op++ = 255;
+	*op++ = length;
+	return op;
+}
+
+// Write a token and literals, the token gets the match length added later
+static uint8_t *lz4_write_literals(uint8_t *op, uint8_t **token, const uint8_t *literals, size_t n){
+	*token = op++;
+	**token = (n < 15 ? n : 15) << 4;
+	if(n >= 15) op = lz4_write_length(op, n - 15);
+	memcpy(op, literals, n);
+	return op + n;
+}
+
+size_t lz4_compress_block(const uint8_t *src, size_t n, uint8_t *dst, uint32_t table[LZ4_HASH_SIZE]){
+	uint8_t *op = dst;
+	uint8_t *token;
+	size_t anchor = 0; // start of the literals that are not written yet
+	
+	if(n >= LZ4_MF_LIMIT + 1){
+		memset(table, 0, LZ4_HASH_SIZE * sizeof(*table));
+		const uint8_t *match_limit = src + n - LZ4_LAST_LITERALS;
+		size_t ip = 0;
+		while(ip + LZ4_MF_LIMIT <= n){
+			uint32_t sequence = load32(src + ip);
+			uint32_t h = lz4_hash(sequence);
+			size_t ref = table[h];
+			table[h] = ip;
+			if(ref >= ip || ip - ref > LZ4_MAX_OFFSET || load32(src + ref) != sequence){
+				/* Skip ahead faster the longer nothing matches */
+				ip += 1 + ((ip - anchor) >> 6);
+				continue;
+			}
+			
+			/* Extend the match backwards into the literals */
+			while(ip > anchor && ref > 0 && src[ip-1] == src[ref-1]){
+				ip--;
+				ref--;
+			}
+			size_t length = LZ4_MIN_MATCH
+				+ lz4_count(src + ip + LZ4_MIN_MATCH, src + ref + LZ4_MIN_MATCH, match_limit);
+			
+			op = lz4_write_literals(op, &token, src + anchor, ip - anchor);
+			*op++ = ip - ref;
+			*op++ = (ip - ref) >> 8;
+			size_t extra = length - LZ4_MIN_MATCH;
+			*token |= (extra < 15 ? extra : 15);
+			if(extra >= 15) op = lz4_write_length(op, extra - 15);
+			
+			ip += length;
+			anchor = ip;
+			
+			/* Remember a position inside the match, repeats are likely */
+			table[lz4_hash(load32(src + ip - 2))] = ip - 2;
+		}
+	}
+	
+	/* The last sequence only has literals */
+	op = lz4_write_literals(op, &token, src + anchor, n - anchor);
+	return op - dst;
+}
+
+// Read the rest of a length that did not fit in the token
+static int lz4_read_length(const uint8_t **ip, const uint8_t *iend, size_t *length){
+	uint8_t byte;
+	do {
+		if(*ip >= iend) return 0;
+		byte = *(*ip)++;
+		*length += byte;
+	} while(byte == 255);
+	return 1;
+}
+
+ptrdiff_t lz4_decompress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, const uint8_t *prefix){
+	const uint8_t *ip = src;
+	const uint8_t *iend = src + n;
+	uint8_t *op = dst;
+	uint8_t *oend = dst + cap;
+	
+	while(ip < iend){
+		uint8_t token = *ip++;
+		
+		/* Literals, short runs are copied with a fixed size when there is room */
+		size_t length = token >> 4;
+		if(length == 15 && !lz4_read_length(&ip, iend, &length)) return -1;
+		if(length > (size_t)(iend - ip) || length > (size_t)(oend - op)) return -1;
+		if(length <= 16 && iend - ip >= 16 && oend - op >= 16){
+			memcpy(op, ip, 16);
+		}else{
+			memcpy(op, ip, length);
+		}
+		ip += length;
+		op += length;
+		if(ip == iend) break; // the last sequence has no match
+		
+		/* Match */
+		if(iend - ip < 2) return -1;
+		size_t offset = ip[0] | ip[1] << 8;
+		ip += 2;
+		if(offset == 0 || offset > (size_t)(op - prefix)) return -1;
+		length = token & 15;
+		if(length == 15 && !lz4_read_length(&ip, iend, &length)) return -1;
+		length += LZ4_MIN_MATCH;
+		if(length > (size_t)(oend - op)) return -1;
+		const uint8_t *match = op - offset;
+		if(offset >= 8 && (size_t)(oend - op) >= length + 8){
+			/* Copy 8 bytes at a time, each part only reads bytes written before */
+			uint8_t *end = op + length;
+			for(; op < end; op += 8, match += 8) memcpy(op, match, 8);
+			op = end;
+		}else{
+			/* Overlapping copy, repeats the last offset bytes */
+			while(length-- > 0) *op++ = *match++;
+		}
+	}
+	return op - dst;
+}
+
+typedef struct Compressor {
+	int started;          // whether the frame header is written
+	size_t filled;        // number of bytes in block
+	XXH32State checksum;  // of all data in this frame
+	uint32_t table[LZ4_HASH_SIZE];
+	uint8_t block[LZ4_BLOCK_SIZE];
+} Compressor;
+
+typedef enum DecompressorStage {
+	DECOMPRESSOR_HEADER, // expecting a frame header
+	DECOMPRESSOR_BLOCK,  // expecting a block or the end mark
+} DecompressorStage;
+
+typedef struct Decompressor {
+	DecompressorStage stage;
+	const char *error;    // set once the input turned out to be corrupt
+	uint8_t flags;        // of the current frame
+	size_t block_max;     // of the current frame
+	size_t frames;        // number of complete frames
+	XXH32State checksum;  // of the decompressed data of the current frame
+	uint8_t *window;      // LZ4_WINDOW bytes of history, then room for a block
+	size_t window_pos;    // where the next block goes in window
+	size_t window_size;
+	uint8_t *pending;     // input that does not form a whole header or block yet
+	size_t pending_size;
+	size_t pending_capacity;
+} Decompressor;
+
+// The growable buffer at idx to append to, or a new one.
+// Pushes the buffer onto the stack
+static Buffer *lz4_output(lua_State *L, int idx, int data_idx, size_t capacity){
+	if(lua_isnoneornil(L, idx)){
+		return buffer_newgrowable(L, capacity);
+	}
+	Buffer *out = luaL_checkudata(L, idx, "Buffer");
+	luaL_argcheck(L, out->kind == BUFFER_GROWABLE, idx, "buffer is not growable");
+	// Growing out would move the input from under the compressor
+	Buffer *data = luaL_testudata(L, data_idx, "Buffer");
+	luaL_argcheck(L, data == NULL || (data != out && data->owner != out), idx, "cannot write into the input");
+	lua_pushvalue(L, idx);
+	return out;
+}
+
+// Compress one block and append it to out, uncompressed when that is smaller
+static void lz4_write_block(lua_State *L, Buffer *out, const uint8_t *src, size_t n, uint32_t *table){
+	uint8_t *p = buffer_grow(L, out, 4 + LZ4_BOUND(n));
+	size_t size = lz4_compress_block(src, n, p + 4, table);
+	if(size >= n){
+		store32le(p, n | LZ4_UNCOMPRESSED);
+		memcpy(p + 4, src, n);
+		size = n;
+	}else{
+		store32le(p, size);
+	}
+	out->size -= LZ4_BOUND(n) - size;
+}
+
+static void compressor_write(lua_State *L, Compressor *compressor, Buffer *out, const uint8_t *data, size_t n){
+	if(!compressor->started){
+		uint8_t *p = buffer_grow(L, out, 7);
+		store32le(p, LZ4_MAGIC);
+		p[4] = LZ4_VERSION | LZ4_BLOCK_INDEPENDENT | LZ4_CONTENT_CHECKSUM;
+		p[5] = 4 << 4; // 64KiB blocks
+		p[6] = (xxh32(p + 4, 2, 0) >> 8) & 0xff;
+		compressor->started = 1;
+	}
+	xxh32_update(&compressor->checksum, data, n);
+	
+	while(n > 0){
+		/* Compress whole blocks in place, without copying them */
+		if(compressor->filled == 0 && n >= LZ4_BLOCK_SIZE){
+			lz4_write_block(L, out, data, LZ4_BLOCK_SIZE, compressor->table);
+			data += LZ4_BLOCK_SIZE;
+			n -= LZ4_BLOCK_SIZE;
+			continue;
+		}
+		size_t part = LZ4_BLOCK_SIZE - compressor->filled;
+		if(part > n) part = n;
+		memcpy(compressor->block + compressor->filled, data, part);
+		compressor->filled += part;
+		data += part;
+		n -= part;
+		if(compressor->filled == LZ4_BLOCK_SIZE){
+			lz4_write_block(L, out, compressor->block, LZ4_BLOCK_SIZE, compressor->table);
+			compressor->filled = 0;
+		}
+	}
+}
+
+// Write the last block and the end of the frame, and start over
+static void compressor_end(lua_State *L, Compressor *compressor, Buffer *out){
+	compressor_write(L, compressor, out, (const uint8_t*)"", 0); // writes the header if needed
+	if(compressor->filled > 0){
+		lz4_write_block(L, out, compressor->block, compressor->filled, compressor->table);
+	}
+	uint8_t *p = buffer_grow(L, out, 8);
+	store32le(p, 0); // end mark
+	store32le(p + 4, xxh32_digest(&compressor->checksum));
+	
+	compressor->started = 0;
+	compressor->filled = 0;
+	xxh32_reset(&compressor->checksum, 0);
+}
+
+static Compressor *compressor_new(lua_State *L){
+	Compressor *compressor = lua_newuserdata(L, sizeof(Compressor));
+	compressor->started = 0;
+	compressor->filled = 0;
+	xxh32_reset(&compressor->checksum, 0);
+	luaL_setmetatable(L, "Compressor");
+	return compressor;
+}
+
+// Decompress as many whole headers and blocks from in as possible,
+// sets used to the number of bytes read. Returns an error message or NULL
+static const char *decompressor_parse(lua_State *L, Decompressor *d, const uint8_t *in, size_t n, size_t *used, Buffer *out){
+	size_t pos = 0;
+	for(;;){
+		const uint8_t *p = in + pos;
+		size_t available = n - pos;
+		*used = pos;
+		
+		if(d->stage == DECOMPRESSOR_HEADER){
+			if(available < 7) return NULL;
+			uint32_t magic = load32le(p);
+			if((magic & 0xfffffff0) == LZ4_SKIPPABLE_MAGIC){
+				if(available < 8) return NULL;
+				size_t skip = 8 + (size_t)load32le(p + 4);
+				if(available < skip) return NULL;
+				pos += skip;
+				continue;
+			}
+			if(magic != LZ4_MAGIC) return "not an lz4 frame";
+			
+			uint8_t flags = p[4];
+			if((flags & 0xc0) != LZ4_VERSION) return "unsupported lz4 version";
+			if(flags & LZ4_DICT_ID) return "lz4 dictionaries are not supported";
+			size_t header = (flags & LZ4_CONTENT_SIZE) ? 15 : 7;
+			if(available < header) return NULL;
+			if(((xxh32(p + 4, header - 5, 0) >> 8) & 0xff) != p[header-1]) return "lz4 header checksum mismatch";
+			int block_id = (p[5] >> 4) & 7;
+			if(block_id < 4) return "invalid lz4 block size";
+			
+			d->flags = flags;
+			d->block_max = (size_t)1 << (2*block_id + 8); // 64KiB, 256KiB, 1MiB or 4MiB
+			if(d->window_size < LZ4_WINDOW + d->block_max){
+				uint8_t *window = realloc(d->window, LZ4_WINDOW + d->block_max);
+				if(window == NULL) luaL_error(L, "not enough memory");
+				d->window = window;
+				d->window_size = LZ4_WINDOW + d->block_max;
+			}
+			d->window_pos = 0;
+			xxh32_reset(&d->checksum, 0);
+			d->stage = DECOMPRESSOR_BLOCK;
+			pos += header;
+		
+		}else{
+			if(available < 4) return NULL;
+			uint32_t size = load32le(p);
+			
+			/* End mark, possibly followed by the content checksum */
+			if(size == 0){
+				size_t length = (d->flags & LZ4_CONTENT_CHECKSUM) ? 8 : 4;
+				if(available < length) return NULL;
+				if((d->flags & LZ4_CONTENT_CHECKSUM) && load32le(p + 4) != xxh32_digest(&d->checksum)){
+					return "lz4 content checksum mismatch";
+				}
+				d->stage = DECOMPRESSOR_HEADER;
+				d->frames++;
+				pos += length;
+				continue;
+			}
+			
+			int compressed = !(size & LZ4_UNCOMPRESSED);
+			size &= ~LZ4_UNCOMPRESSED;
+			if(size > d->block_max) return "invalid lz4 block size";
+			size_t length = 4 + size + ((d->flags & LZ4_BLOCK_CHECKSUM) ? 4 : 0);
+			if(available < length) return NULL;
+			const uint8_t *block = p + 4;
+			if((d->flags & LZ4_BLOCK_CHECKSUM) && load32le(block + size) != xxh32(block, size, 0)){
+				return "lz4 block checksum mismatch";
+			}
+			
+			/* Linked blocks can refer back to the previous 64KiB */
+			uint8_t *dst = d->window + d->window_pos;
+			ptrdiff_t result = size;
+			if(compressed){
+				const uint8_t *prefix = (d->flags & LZ4_BLOCK_INDEPENDENT) ? dst : d->window;
+				result = lz4_decompress_block(block, size, dst, d->block_max, prefix);
+				if(result < 0) return "corrupt lz4 block";
+			}else{
+				memcpy(dst, block, size);
+			}
+			memcpy(buffer_grow(L, out, result), dst, result);
+			if(d->flags & LZ4_CONTENT_CHECKSUM) xxh32_update(&d->checksum, dst, result);
+			
+			if(!(d->flags & LZ4_BLOCK_INDEPENDENT)){
+				d->window_pos += result;
+				if(d->window_pos > LZ4_WINDOW){
+					memmove(d->window, d->window + d->window_pos - LZ4_WINDOW, LZ4_WINDOW);
+					d->window_pos = LZ4_WINDOW;
+				}
+			}
+			pos += length;
+		}
+	}
+}
+
+// Keep input for when the rest of it arrives
+static void decompressor_stash(lua_State *L, Decompressor *d, const uint8_t *data, size_t n){
+	if(n == 0) return;
+	if(d->pending_size + n > d->pending_capacity){
+		size_t capacity = (d->pending_size + n) * 2;
+		uint8_t *pending = realloc(d->pending, capacity);
+		if(pending == NULL) luaL_error(L, "not enough memory");
+		d->pending = pending;
+		d->pending_capacity = capacity;
+	}
+	memcpy(d->pending + d->pending_size, data, n);
+	d->pending_size += n;
+}
+
+// Decompress data, returns an error message or NULL
+static const char *decompressor_write(lua_State *L, Decompressor *d, Buffer *out, const uint8_t *data, size_t n){
+	if(d->error) return d->error;
+	size_t used;
+	if(d->pending_size == 0){
+		/* Nothing left over from before, read straight from data */
+		d->error = decompressor_parse(L, d, data, n, &used, out);
+		if(!d->error) decompressor_stash(L, d, data + used, n - used);
+	}else{
+		decompressor_stash(L, d, data, n);
+		d->error = decompressor_parse(L, d, d->pending, d->pending_size, &used, out);
+		memmove(d->pending, d->pending + used, d->pending_size - used);
+		d->pending_size -= used;
+	}
+	return d->error;
+}
+
+// Whether all input formed whole frames, returns an error message or NULL
+static const char *decompressor_end(Decompressor *d){
+	if(d->error) return d->error;
+	if(d->frames == 0 || d->stage != DECOMPRESSOR_HEADER || d->pending_size > 0){
+		return "truncated lz4 frame";
+	}
+	return NULL;
+}
+
+static Decompressor *decompressor_new(lua_State *L){
+	Decompressor *d = lua_newuserdata(L, sizeof(Decompressor));
+	memset(d, 0, sizeof(Decompressor));
+	d->stage = DECOMPRESSOR_HEADER;
+	luaL_setmetatable(L, "Decompressor");
+	return d;
+}
+
+/* Lua API definitions */
+
+/***
+ * Compress data into a single LZ4 block.
+ * The block does not store its size, keep it for `decompress`.
+ * Also available as a method on `Buffer`s.
+ * @function compress
+ * @tparam Buffer|string data
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn Buffer the compressed data, or `into`
+ */
+int lz4_compress(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	luaL_argcheck(L, size <= LZ4_MAX_INPUT, 1, "too large, use compressFrame");
+	Buffer *out = lz4_output(L, 2, 1, LZ4_BOUND(size));
+	uint32_t table[LZ4_HASH_SIZE];
+	uint8_t *p = buffer_grow(L, out, LZ4_BOUND(size));
+	out->size -= LZ4_BOUND(size) - lz4_compress_block(data, size, p, table);
+	return 1;
+}
+
+/***
+ * Decompress a single LZ4 block.
+ * Also available as a method on `Buffer`s.
+ * @function decompress
+ * @tparam Buffer|string data
+ * @tparam number size the decompressed size, or an upper bound of it
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn[1] Buffer the decompressed data, or `into`
+ * @treturn[2] nil
+ * @treturn[2] string error message, when the data is corrupt
+ */
+int lz4_decompress(lua_State *L){
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	lua_Integer max = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, max >= 0, 2, "size must be non-negative");
+	Buffer *out = lz4_output(L, 3, 1, max);
+	uint8_t *p = buffer_grow(L, out, max);
+	ptrdiff_t result = lz4_decompress_block(data, size, p, max, p);
+	out->size -= max - (result < 0 ? 0 : result);
+	if(result < 0){
+		lua_pushnil(L);
+		lua_pushstring(L, "corrupt lz4 block");
+		return 2;
+	}
+	return 1;
+}
+
+/***
+ * Compress data into an LZ4 frame.
+ * Also available as a method on `Buffer`s.
+ * @function compressFrame
+ * @tparam Buffer|string data
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn Buffer the compressed data, or `into`
+ */
+int lz4_compressFrame(lua_State *L){
+	lua_settop(L, 2);
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	Compressor *compressor = compressor_new(L);
+	Buffer *out = lz4_output(L, 2, 1, LZ4_BOUND(size) + size / LZ4_BLOCK_SIZE * 4 + 19);
+	compressor_write(L, compressor, out, data, size);
+	compressor_end(L, compressor, out);
+	return 1;
+}
+
+/***
+ * Decompress one or more concatenated LZ4 frames.
+ * Also available as a method on `Buffer`s.
+ * @function decompressFrame
+ * @tparam Buffer|string data
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn[1] Buffer the decompressed data, or `into`
+ * @treturn[2] nil
+ * @treturn[2] string error message, when the data is corrupt or incomplete
+ */
+int lz4_decompressFrame(lua_State *L){
+	lua_settop(L, 2);
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 1, &size);
+	Decompressor *d = decompressor_new(L);
+	Buffer *out = lz4_output(L, 2, 1, size * 2);
+	const char *error = decompressor_write(L, d, out, data, size);
+	if(!error) error = decompressor_end(d);
+	if(error){
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+	return 1;
+}
+
+/***
+ * Create a compressor, to compress data that arrives in parts into an LZ4
+ * frame.
+ * @function compressor
+ * @treturn Compressor
+ */
+int lz4_compressor(lua_State *L){
+	compressor_new(L);
+	return 1;
+}
+
+/***
+ * Create a decompressor, to decompress LZ4 frames that arrive in parts.
+ * @function decompressor
+ * @treturn Decompressor
+ */
+int lz4_decompressor(lua_State *L){
+	decompressor_new(L);
+	return 1;
+}
+
+/// @type Compressor
+
+/***
+ * Add data to the frame.
+ * The data is compressed in blocks of 64KiB, the returned buffer is empty
+ * until a block is full.
+ * @function update
+ * @tparam Buffer|string data
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn Buffer the compressed data so far, or `into`
+ */
+int compressor_update(lua_State *L){
+	Compressor *compressor = luaL_checkudata(L, 1, "Compressor");
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 2, &size);
+	Buffer *out = lz4_output(L, 3, 2, 0);
+	compressor_write(L, compressor, out, data, size);
+	return 1;
+}
+
+/***
+ * End the frame.
+ * The compressor can be used for a new frame afterwards.
+ * @function finish
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn Buffer the rest of the compressed data, or `into`
+ */
+int compressor_finish(lua_State *L){
+	Compressor *compressor = luaL_checkudata(L, 1, "Compressor");
+	Buffer *out = lz4_output(L, 2, 1, 0);
+	compressor_end(L, compressor, out);
+	return 1;
+}
+
+/// @type Decompressor
+
+/***
+ * Add compressed data.
+ * @function update
+ * @tparam Buffer|string data
+ * @tparam[opt] Buffer into growable buffer to append to
+ * @treturn[1] Buffer the data decompressed so far, or `into`
+ * @treturn[2] nil
+ * @treturn[2] string error message, when the data is corrupt
+ */
+int decompressor_update(lua_State *L){
+	Decompressor *d = luaL_checkudata(L, 1, "Decompressor");
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 2, &size);
+	Buffer *out = lz4_output(L, 3, 2, 0);
+	const char *error = decompressor_write(L, d, out, data, size);
+	if(error){
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+	return 1;
+}
+
+/***
+ * Check that all data formed whole frames.
+ * @function finish
+ * @treturn[1] boolean true
+ * @treturn[2] nil
+ * @treturn[2] string error message
+ */
+int decompressor_finish(lua_State *L){
+	Decompressor *d = luaL_checkudata(L, 1, "Decompressor");
+	const char *error = decompressor_end(d);
+	if(error){
+		lua_pushnil(L);
+		lua_pushstring(L, error);
+		return 2;
+	}
+	lua_pushboolean(L, 1);
+	return 1;
+}
+
+/***
+ * __gc metamethod.
+ * @function __gc
+ */
+int decompressor__gc(lua_State *L){
+	Decompressor *d = luaL_checkudata(L, 1, "Decompressor");
+	free(d->window);
+	free(d->pending);
+	d->window = NULL;
+	d->pending = NULL;
+	return 0;
+}
+
+static const struct luaL_Reg compressor_f[] = {
+	{"update", compressor_update},
+	{"finish", compressor_finish},
+	{NULL, NULL}
+};
+
+static const struct luaL_Reg decompressor_f[] = {
+	{"update", decompressor_update},
+	{"finish", decompressor_finish},
+	{NULL, NULL}
+};
+
+void lz4_register(lua_State *L){
+	if(luaL_newmetatable(L, "Compressor")){ // stack: {metatable, ...}
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, compressor_f, 0);
+		lua_setfield(L, -2, "__index");
+	}
+	lua_pop(L, 1); // stack: {...}
+	
+	if(luaL_newmetatable(L, "Decompressor")){ // stack: {metatable, ...}
+		lua_pushcfunction(L, decompressor__gc);
+		lua_setfield(L, -2, "__gc");
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, decompressor_f, 0);
+		lua_setfield(L, -2, "__index");
+	}
+	lua_pop(L, 1); // stack: {...}
+}
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+// Maximum size of compressed data for n input bytes
+#define LZ4_BOUND(n) ((n) + (n)/255 + 16)
+
+// Largest input for a single block
+#define LZ4_MAX_INPUT 0x7e000000
+
+#define LZ4_HASH_LOG 12
+#define LZ4_HASH_SIZE (1 << LZ4_HASH_LOG)
+
+// Compress n bytes from src into dst, which must have room for LZ4_BOUND(n)
+// bytes. table is scratch space. Returns the compressed size
+size_t lz4_compress_block(const uint8_t *src, size_t n, uint8_t *dst, uint32_t table[LZ4_HASH_SIZE]);
+
+// Decompress n bytes from src into at most cap bytes at dst.
+// Matches can reach back to prefix (at most dst), for linked blocks.
+// Returns the decompressed size, or -1 when the data is corrupt
+ptrdiff_t lz4_decompress_block(const uint8_t *src, size_t n, uint8_t *dst, size_t cap, const uint8_t *prefix);
+
+// Create the Compressor and Decompressor metatables
+void lz4_register(lua_State *L);
+
+/* Lua API definitions */
+
+int lz4_compress(lua_State *L);
+int lz4_decompress(lua_State *L);
+int lz4_compressFrame(lua_State *L);
+int lz4_decompressFrame(lua_State *L);
+int lz4_compressor(lua_State *L);
+int lz4_decompressor(lua_State *L);
+int compressor_update(lua_State *L);
+int compressor_finish(lua_State *L);
+int decompressor_update(lua_State *L);
+int decompressor_finish(lua_State *L);
+
+/* Lua metamethods */
+
+int decompressor__gc(lua_State *L);
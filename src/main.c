@@ -89,7 +89,7 @@ void parse_cmdline_args(int argc, char *argv[], char **file, int *lua_arg_start,
 	}
 	
 	if(stop){
-		lua_close(L);
+		mb_close(L);
 		exit(EXIT_SUCCESS);
 	}
 }
@@ -109,6 +109,6 @@ int main(int argc, char *argv[]){
 	}
 	mb_main(L, file, argc-lua_arg_start);
 	
-	lua_close(L);
+	mb_close(L);
 	return 0;
 }
\ No newline at end of file
@@ -0,0 +1,313 @@
+/***
+ * A `RingBuffer` is a circular queue of bytes, for streaming data from a
+ * producer to a consumer.
+ * 
+ * Bytes are written at one end and read from the other, as strings or into
+ * `Buffer`s. `readable` and `writable` give `Buffer` views of the bytes in the
+ * ring, in at most two parts because of the wraparound, so data can also be
+ * handled without copying.
+ * 
+ * Unless it overwrites, a ring can be shared by two safethreads without locks:
+ * one thread writes (`write`, `writable` and `commit`) while the other reads
+ * (`read`, `peek`, `skip` and `readable`). Like a `Buffer`, the ring has to
+ * be kept alive by the thread that created it.
+ * 
+ * @classmod RingBuffer
+ * @see Buffer
+ * @usage
+ * local ring = Buffer.ring(4096)
+ * ring:write("hello ")
+ * ring:write(Buffer.of("world"))
+ * print(#ring, ring:read(5)) --> 11	hello
+ */
+
+#include <string.h> // for memcpy
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "ring.h"
+
+/* C library definitions */
+
+// The writer publishes head and the reader publishes tail, each with a release
+// store that makes its bytes (or free space) visible to the other thread
+#define ring_load(p) __atomic_load_n((p), __ATOMIC_ACQUIRE)
+#define ring_store(p, v) __atomic_store_n((p), (v), __ATOMIC_RELEASE)
+
+size_t ring_available(RingBuffer *ring){
+	size_t tail = ring_load(&ring->tail);
+	return ring_load(&ring->head) - tail;
+}
+
+size_t ring_room(RingBuffer *ring){
+	size_t head = ring_load(&ring->head);
+	return ring->capacity - (head - ring_load(&ring->tail));
+}
+
+void ring_put(RingBuffer *ring, const uint8_t *src, size_t n){
+	size_t head = ring_load(&ring->head);
+	if(ring->overwrite){
+		/* Keep the last bytes, and drop the oldest ones to make room */
+		if(n > ring->capacity){
+			src += n - ring->capacity;
+			n = ring->capacity;
+		}
+		size_t tail = ring_load(&ring->tail);
+		if(head - tail + n > ring->capacity) ring_store(&ring->tail, head + n - ring->capacity);
+	}
+	size_t pos = head & (ring->capacity - 1);
+	size_t first = (n < ring->capacity - pos) ? n : ring->capacity - pos;
+	memcpy(ring->data + pos, src, first);
+	memcpy(ring->data, src + first, n - first);
+	ring_store(&ring->head, head + n);
+}
+
+void ring_get(RingBuffer *ring, uint8_t *dst, size_t n){
+	size_t pos = ring_load(&ring->tail) & (ring->capacity - 1);
+	size_t first = (n < ring->capacity - pos) ? n : ring->capacity - pos;
+	memcpy(dst, ring->data + pos, first);
+	memcpy(dst + first, ring->data, n - first);
+}
+
+// Push a Buffer view of n bytes at data, which keeps the ring at index 1 alive
+static void ring_pushview(lua_State *L, uint8_t *data, size_t n){
+	Buffer *buffer = lua_newuserdata(L, sizeof(Buffer));
+	buffer->size = n;
+	buffer->buffer = data;
+	buffer->capacity = n;
+	buffer->kind = BUFFER_VIEW;
+	buffer->owner = NULL;
+	buffer->views = 0;
+	lua_pushvalue(L, 1);
+	lua_setuservalue(L, -2);
+	luaL_setmetatable(L, "Buffer");
+}
+
+// Push up to two views of n bytes starting at position pos, returns how many
+static int ring_pushviews(lua_State *L, RingBuffer *ring, size_t pos, size_t n){
+	pos &= ring->capacity - 1;
+	size_t first = (n < ring->capacity - pos) ? n : ring->capacity - pos;
+	int views = 0;
+	if(first > 0){
+		ring_pushview(L, ring->data + pos, first);
+		views++;
+	}
+	if(n > first){
+		ring_pushview(L, ring->data, n - first);
+		views++;
+	}
+	return views;
+}
+
+// Get up to n (at index 2) bytes as a string, or append them to a Buffer (at index 3)
+static int ring_take(lua_State *L, int consume){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	size_t available = ring_available(ring);
+	lua_Integer max = luaL_optinteger(L, 2, available);
+	luaL_argcheck(L, max >= 0, 2, "must be >= 0");
+	size_t n = ((size_t)max < available) ? (size_t)max : available;
+	
+	if(!lua_isnoneornil(L, 3)){
+		Buffer *into = luaL_checkudata(L, 3, "Buffer");
+		luaL_argcheck(L, into->kind == BUFFER_GROWABLE, 3, "buffer is not growable");
+		ring_get(ring, buffer_grow(L, into, n), n);
+		lua_pushinteger(L, n);
+	}else{
+		luaL_Buffer b;
+		char *dst = luaL_buffinitsize(L, &b, n);
+		ring_get(ring, (uint8_t*)dst, n);
+		luaL_pushresultsize(&b, n);
+	}
+	if(consume) ring_store(&ring->tail, ring_load(&ring->tail) + n);
+	return 1;
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a new `RingBuffer`.
+ * Part of the `Buffer` module.
+ * @function Buffer.ring
+ * @tparam number capacity in bytes, rounded up to a power of two
+ * @tparam[opt=false] boolean overwrite whether writes that do not fit drop the
+ * oldest bytes, instead of failing. Such a ring can not be shared between threads
+ * @treturn RingBuffer
+ */
+int ring_ring(lua_State *L){
+	lua_Integer capacity = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, capacity > 0 && capacity <= ((lua_Integer)1 << 40), 1, "capacity must be between 1 and 2^40");
+	size_t size = 1;
+	while(size < (size_t)capacity) size <<= 1;
+	int overwrite = lua_toboolean(L, 2);
+	
+	RingBuffer *ring = lua_newuserdata(L, sizeof(RingBuffer) + size);
+	ring->capacity = size;
+	ring->overwrite = overwrite;
+	ring->head = 0;
+	ring->tail = 0;
+	luaL_setmetatable(L, "RingBuffer");
+	return 1;
+}
+
+/***
+ * Write bytes.
+ * @function write
+ * @tparam Buffer|string data
+ * @tparam[opt=false] boolean partial whether to write as much as fits, instead
+ * of nothing when not all of the data fits
+ * @treturn number the number of bytes written
+ */
+int ring_write(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 2, &size);
+	size_t n = size;
+	if(!ring->overwrite){
+		size_t room = ring_room(ring);
+		if(n > room) n = lua_toboolean(L, 3) ? room : 0;
+	}
+	ring_put(ring, data, n);
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+/***
+ * Read bytes.
+ * @function read
+ * @tparam[opt] number n the maximum number of bytes, all of them by default
+ * @tparam[optchain] Buffer into growable buffer to append the bytes to
+ * @treturn[1] string the bytes, empty when there are none
+ * @treturn[2] number the number of bytes appended to into
+ */
+int ring_read(lua_State *L){
+	return ring_take(L, 1);
+}
+
+/***
+ * Get bytes without reading them, so the next read gets them again.
+ * @function peek
+ * @tparam[opt] number n the maximum number of bytes, all of them by default
+ * @tparam[optchain] Buffer into growable buffer to append the bytes to
+ * @treturn[1] string the bytes
+ * @treturn[2] number the number of bytes appended to into
+ */
+int ring_peek(lua_State *L){
+	return ring_take(L, 0);
+}
+
+/***
+ * Read bytes without getting them.
+ * @function skip
+ * @tparam number n the maximum number of bytes
+ * @treturn number the number of bytes skipped
+ */
+int ring_skip(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	lua_Integer max = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, max >= 0, 2, "must be >= 0");
+	size_t available = ring_available(ring);
+	size_t n = ((size_t)max < available) ? (size_t)max : available;
+	ring_store(&ring->tail, ring_load(&ring->tail) + n);
+	lua_pushinteger(L, n);
+	return 1;
+}
+
+/***
+ * Get views of the bytes that can be read, without reading them.
+ * Call `skip` after handling them. The views are only valid until then.
+ * @function readable
+ * @treturn Buffer... zero, one or two views, in order
+ */
+int ring_readable(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	size_t available = ring_available(ring);
+	return ring_pushviews(L, ring, ring->tail, available);
+}
+
+/***
+ * Get views of the free space, to write bytes into directly.
+ * Call `commit` with the number of bytes written, which makes them readable.
+ * @function writable
+ * @treturn Buffer... zero, one or two views, in order
+ */
+int ring_writable(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	size_t room = ring_room(ring);
+	return ring_pushviews(L, ring, ring->head, room);
+}
+
+/***
+ * Make bytes written into the views from `writable` readable.
+ * @function commit
+ * @tparam number n the number of bytes
+ */
+int ring_commit(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	lua_Integer n = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, n >= 0 && (size_t)n <= ring_room(ring), 2, "more than the free space");
+	ring_store(&ring->head, ring_load(&ring->head) + n);
+	return 0;
+}
+
+/***
+ * Get the number of bytes that can be written.
+ * @function space
+ * @treturn number
+ */
+int ring_space(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	lua_pushinteger(L, ring_room(ring));
+	return 1;
+}
+
+/***
+ * Get the capacity.
+ * @function capacity
+ * @treturn number
+ */
+int ring_capacity(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	lua_pushinteger(L, ring->capacity);
+	return 1;
+}
+
+/* Lua metamethods */
+
+/***
+ * __len metamethod, returns the number of bytes that can be read.
+ * @function __len
+ * @treturn number
+ */
+int ring__length(lua_State *L){
+	RingBuffer *ring = luaL_checkudata(L, 1, "RingBuffer");
+	lua_pushinteger(L, ring_available(ring));
+	return 1;
+}
+
+static const struct luaL_Reg ring_f[] = {
+	{"write", ring_write},
+	{"read", ring_read},
+	{"peek", ring_peek},
+	{"skip", ring_skip},
+	{"readable", ring_readable},
+	{"writable", ring_writable},
+	{"commit", ring_commit},
+	{"space", ring_space},
+	{"capacity", ring_capacity},
+	{"length", ring__length},
+	{NULL, NULL}
+};
+
+void ring_register(lua_State *L){
+	if(luaL_newmetatable(L, "RingBuffer")){ // stack: {metatable, ...}
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, ring_f, 0);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, ring__length);
+		lua_setfield(L, -2, "__len");
+	}
+	lua_pop(L, 1); // stack: {...}
+}
@@ -0,0 +1,51 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+typedef struct RingBuffer {
+	size_t capacity;   // power of two
+	int overwrite;     // whether writes drop the oldest bytes when full
+	size_t head;       // number of bytes written, only changed by the writer
+	char padding[64];  // keep head and tail in different cache lines
+	size_t tail;       // number of bytes read, only changed by the reader
+	uint8_t data[];
+} RingBuffer;
+
+// Number of bytes that can be read
+size_t ring_available(RingBuffer *ring);
+
+// Number of bytes that can be written without overwriting
+size_t ring_room(RingBuffer *ring);
+
+// Copy n bytes into the ring, which must have room for them unless overwriting
+void ring_put(RingBuffer *ring, const uint8_t *src, size_t n);
+
+// Copy n bytes out of the ring, which must be available, without reading them
+void ring_get(RingBuffer *ring, uint8_t *dst, size_t n);
+
+// Create the RingBuffer metatable
+void ring_register(lua_State *L);
+
+/* Lua API definitions */
+
+int ring_ring(lua_State *L);
+
+int ring_write(lua_State *L);
+int ring_read(lua_State *L);
+int ring_peek(lua_State *L);
+int ring_skip(lua_State *L);
+int ring_readable(lua_State *L);
+int ring_writable(lua_State *L);
+int ring_commit(lua_State *L);
+int ring_space(lua_State *L);
+int ring_capacity(lua_State *L);
+
+/* Lua metamethods */
+
+int ring__length(lua_State *L);
@@ -4,8 +4,12 @@
  * @module safethread
  */
 
-#include <time.h> // for nanosleep
-#include <string.h> // for strcmp
+#define _GNU_SOURCE // for pthread_setaffinity_np and SCHED_BATCH
+
+#include <time.h> // for nanosleep, clock_gettime
+#include <stdlib.h> // for malloc, free
+#include <string.h> // for strcmp, strerror, memset
+#include <sched.h> // for SCHED_OTHER etc
 
 #if !defined(_WIN32) && !defined(__WIN32__)
 	#define _REENTRANT // needed for pthread_kill
@@ -19,13 +23,74 @@
 
 #include "MoonBox.h"
 #include "safethread.h"
+#include "actor.h"
 #include "event.h"
 
 /* C library definitions */
 
 // Forward declarations
-static int move_value(lua_State*, lua_State*);
-static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto);
+static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto, size_t *bytes);
+
+// All threads that have not been garbage collected, for safethread.stats
+static Thread *threads = NULL;
+static char threads_lock = 0;
+
+static void lock_threads(void){
+	while(__atomic_test_and_set(&threads_lock, __ATOMIC_ACQUIRE)) sched_yield();
+}
+
+static void unlock_threads(void){
+	__atomic_clear(&threads_lock, __ATOMIC_RELEASE);
+}
+
+static void add_thread(Thread *t){
+	lock_threads();
+	t->prev = NULL;
+	t->next = threads;
+	if(threads != NULL) threads->prev = t;
+	threads = t;
+	unlock_threads();
+}
+
+static void remove_thread(Thread *t){
+	lock_threads();
+	if(t->prev != NULL) t->prev->next = t->next;
+	else if(threads == t) threads = t->next;
+	if(t->next != NULL) t->next->prev = t->prev;
+	t->prev = t->next = NULL;
+	unlock_threads();
+}
+
+// Monotonic time in nanoseconds
+static uint64_t time_ns(void){
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Add to a counter that other threads may update at the same time
+#define stats_add(field, n) __atomic_fetch_add(&(field), (n), __ATOMIC_RELAXED)
+
+static void init_stats(ThreadStats *stats){
+	memset(stats, 0, sizeof(ThreadStats));
+	stats->created = time_ns();
+}
+
+// Lock a thread, and wait until it is idle when idle is 1
+// Counts the time spent waiting in the thread's stats
+static void lock_thread(Thread *t, int idle){
+	uint64_t start = time_ns();
+	uint32_t waiting = __atomic_add_fetch(&t->stats.waiting, 1, __ATOMIC_RELAXED);
+	uint32_t max = __atomic_load_n(&t->stats.max_waiting, __ATOMIC_RELAXED);
+	while(waiting > max && !__atomic_compare_exchange_n(&t->stats.max_waiting,
+		&max, waiting, 1, __ATOMIC_RELAXED, __ATOMIC_RELAXED));
+	
+	lock_mutex(t->mutex);
+	while(idle && t->state != THREAD_IDLE) wait_cond(t->cond, t->mutex);
+	
+	__atomic_sub_fetch(&t->stats.waiting, 1, __ATOMIC_RELAXED);
+	stats_add(t->stats.lock_wait, time_ns() - start);
+}
 
 static int try_cached_copy(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto){
 	lua_pushvalue(from, idx);
@@ -46,7 +111,7 @@ static void store_cache(lua_State *from, lua_State *to, int idx, int copiedfrom,
 	lua_settable(from, copiedfrom);
 }
 
-static void copy_table(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto){
+static void copy_table(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto, size_t *bytes){
 	/* Check if the table has already been copied (recursive table) */
 	if(try_cached_copy(from, to, idx, copiedfrom, copiedto)) return;
 	
@@ -58,8 +123,8 @@ static void copy_table(lua_State *from, lua_State *to, int idx, int copiedfrom,
 	/* Traverse table */
 	lua_pushnil(from);
 	while(lua_next(from, idx) != 0){
-		if(copy_value_(from, to, -2, copiedfrom, copiedto)){
-			if(copy_value_(from, to, -1, copiedfrom, copiedto)){
+		if(copy_value_(from, to, -2, copiedfrom, copiedto, bytes)){
+			if(copy_value_(from, to, -1, copiedfrom, copiedto, bytes)){
 				lua_settable(to, -3);
 			}else{
 				lua_pop(to, 1);
@@ -74,7 +139,7 @@ static int writer(lua_State *L, const void *data, size_t size, void *buffer){
 	return 0; // 0 means no errors
 }
 
-static int copy_function(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto){
+static int copy_function(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto, size_t *bytes){
 	/* Get original function name and number of upvalues */
 	lua_Debug info;
 	lua_pushvalue(from, idx);
@@ -101,6 +166,7 @@ static int copy_function(lua_State *from, lua_State *to, int idx, int copiedfrom
 	size_t len;
 	const char *data = lua_tolstring(from, -1, &len);
 	lua_pop(from, 2);
+	*bytes += len;
 	
 	/* Load buffer back to function */
 	int status = luaL_loadbuffer(to, data, len, info.name);
@@ -116,7 +182,7 @@ static int copy_function(lua_State *from, lua_State *to, int idx, int copiedfrom
 		if(SHOULD_USE_THREAD_ENV && strcmp(name, "_ENV") == 0){
 			lua_rawgeti(to, LUA_REGISTRYINDEX, LUA_RIDX_GLOBALS);
 		}else{
-			if(!copy_value_(from, to, -1, copiedfrom, copiedto)) return 0;
+			if(!copy_value_(from, to, -1, copiedfrom, copiedto, bytes)) return 0;
 		}
 		lua_pop(from, 1);
 		if(!lua_setupvalue(to, -2, i)) lua_pop(to, 1);
@@ -149,7 +215,7 @@ static int try_registed_metatable(lua_State *from, lua_State *to){
 	return 1;
 }
 
-static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto){
+static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom, int copiedto, size_t *bytes){
 	idx = lua_absindex(from, idx);
 	int type = lua_type(from, idx);
 	switch(type){
@@ -160,8 +226,10 @@ static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom,
 			lua_pushboolean(to, lua_toboolean(from, idx)); break;
 		case LUA_TLIGHTUSERDATA:
 		case LUA_TUSERDATA:
+			*bytes += sizeof(void*);
 			lua_pushlightuserdata(to, lua_touserdata(from, idx)); break;
 		case LUA_TNUMBER:
+			*bytes += sizeof(lua_Integer);
 			if(lua_isinteger(from, idx)){
 				lua_pushinteger(to, lua_tointeger(from, idx)); break;
 			}else{
@@ -170,12 +238,13 @@ static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom,
 		case LUA_TSTRING: {
 			size_t len;
 			const char *str = lua_tolstring(from, idx, &len);
+			*bytes += len;
 			lua_pushlstring(to, str, len); break;
 		}
 		case LUA_TTABLE:
-			copy_table(from, to, idx, copiedfrom, copiedto); break;
+			copy_table(from, to, idx, copiedfrom, copiedto, bytes); break;
 		case LUA_TFUNCTION:
-			if(!copy_function(from, to, idx, copiedfrom, copiedto)) return 0;
+			if(!copy_function(from, to, idx, copiedfrom, copiedto, bytes)) return 0;
 			break;
 		case LUA_TTHREAD:
 		default:
@@ -186,7 +255,7 @@ static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom,
 		but silently fail when that does not work */
 	if((type == LUA_TTABLE || type == LUA_TUSERDATA) && lua_getmetatable(from, idx)){
 		if(!try_registed_metatable(from, to)
-				&& copy_value_(from, to, -1, copiedfrom, copiedto)){
+				&& copy_value_(from, to, -1, copiedfrom, copiedto, bytes)){
 			lua_setmetatable(to, -2);
 		}
 		lua_pop(from, 1);
@@ -194,35 +263,35 @@ static int copy_value_(lua_State *from, lua_State *to, int idx, int copiedfrom,
 	return 1;
 }
 
-static int copy_value(lua_State *from, lua_State *to, int idx){
+// Copy a value, and add the number of bytes copied to bytes
+static int copy_value(lua_State *from, lua_State *to, int idx, size_t *bytes){
 	idx = lua_absindex(from, idx);
 	// Create tables to store already copied values
 	lua_newtable(from);
 	lua_newtable(to);
-	int success = copy_value_(from, to, idx, lua_gettop(from), lua_gettop(to));
+	int success = copy_value_(from, to, idx, lua_gettop(from), lua_gettop(to), bytes);
 	// Remove the tables again
 	lua_pop(from, 1);
 	lua_replace(to, -2);
 	return success;
 }
 
-static int move_value(lua_State *from, lua_State *to){
-	int success = copy_value(from, to, -1);
-	lua_pop(from, 1);
-	return success;
-}
-
-static void copy_values(lua_State *from, lua_State *to, int n){
+// Copy values, and count the time and bytes in stats
+static void copy_values(lua_State *from, lua_State *to, int n, ThreadStats *stats){
+	uint64_t start = time_ns();
+	size_t bytes = 0;
 	int base = lua_absindex(from, lua_gettop(from)-n+1);
 	for(int i = base; i < base+n; i++){
-		if(!copy_value(from, to, i)){
+		if(!copy_value(from, to, i, &bytes)){
 			luaL_argerror(from, i, "unsupported type");
 		}
 	}
+	stats_add(stats->bytes, bytes);
+	stats_add(stats->copy, time_ns() - start);
 }
 
-static void move_values(lua_State *from, lua_State *to, int n){
-	copy_values(from, to, n);
+static void move_values(lua_State *from, lua_State *to, int n, ThreadStats *stats){
+	copy_values(from, to, n, stats);
 	lua_pop(from, n);
 }
 
@@ -233,6 +302,7 @@ DWORD WINAPI safethread_run(LPVOID data){
 void *safethread_run(void *data){
 #endif
 	Thread *t = (Thread*)data;
+	__atomic_store_n(&t->id, self_thread_id(), __ATOMIC_RELEASE);
 	lock_mutex(t->mutex); // Immediately lock mutex
 	
 	if(lua_gettop(t->L) > 1 && lua_pcall(t->L, 0, LUA_MULTRET, 1) != LUA_OK){
@@ -245,25 +315,32 @@ void *safethread_run(void *data){
 	
 	while(t->state != THREAD_DEAD){
 		switch(t->state){
-			case THREAD_ACTIVE:
-				if(lua_pcall(t->L, lua_gettop(t->L) - base - 2, LUA_MULTRET, 1) == LUA_OK && t->cb_id != 0){
-					/* Call callback in original thread */
-					int n_ret = lua_gettop(t->L) - base - 1;
-					lock_mutex(t->cb_t->mutex);
-					while(t->cb_t->state != THREAD_IDLE) wait_cond(t->cb_t->cond, t->cb_t->mutex);
-					lua_rawgeti(t->cb_t->L, LUA_REGISTRYINDEX, t->cb_id);
-					move_values(t->L, t->cb_t->L, n_ret);
-					lua_pcall(t->cb_t->L, n_ret, 0, 1);
+			case THREAD_ACTIVE: {
+				uint64_t start = time_ns();
+				// stack: {(args?), fn, (results of the thread function?), error handler}
+				int status = lua_pcall(t->L, lua_gettop(t->L) - base - 1, LUA_MULTRET, 1);
+				stats_add(t->stats.busy, time_ns() - start);
+				stats_add(t->stats.jobs, 1);
+				if(t->cb_id != 0){
+					/* Call callback in original thread, a failed call only
+					releases it */
+					lock_thread(t->cb_t, 1);
+					if(status == LUA_OK){
+						int n_ret = lua_gettop(t->L) - base;
+						lua_rawgeti(t->cb_t->L, LUA_REGISTRYINDEX, t->cb_id);
+						move_values(t->L, t->cb_t->L, n_ret, &t->stats);
+						lua_pcall(t->cb_t->L, n_ret, 0, 1);
+					}
 					luaL_unref(t->cb_t->L, LUA_REGISTRYINDEX, t->cb_id);
 					unlock_mutex(t->cb_t->mutex);
 					t->cb_id = 0;
 					t->cb_t = NULL;
-				}else{
-					lua_pop(t->L, 2);
 				}
+				lua_settop(t->L, base);
 				t->state = THREAD_IDLE;
 				signal_cond(t->cond);
 				break;
+			}
 			case THREAD_IDLE:
 				event_loop(t->L);
 				break;
@@ -278,6 +355,38 @@ void *safethread_run(void *data){
 	return 0;
 }
 
+void safethread_adopt(lua_State *L, Thread *t){
+	t->L = L;
+	t->state = THREAD_ACTIVE;
+	t->thread = self_thread();
+	t->id = self_thread_id();
+	t->cb_t = NULL;
+	t->cb_id = 0;
+	create_mutex(t->mutex);
+	create_cond(t->cond);
+	lock_mutex(t->mutex);
+	init_stats(&t->stats);
+	add_thread(t);
+	
+	/* Put Thread struct in registry */
+	lua_pushlightuserdata(L, t);
+	lua_setfield(L, LUA_REGISTRYINDEX, "mb_thread");
+}
+
+void safethread_release(Thread *t){
+	remove_thread(t);
+	t->state = THREAD_DEAD;
+	unlock_mutex(t->mutex);
+	destroy_mutex(t->mutex);
+	destroy_cond(t->cond);
+}
+
+// Stops the actor workers when the main state is closed
+static int actor_pool__gc(lua_State *L){
+	actor_shutdown();
+	return 0;
+}
+
 /* Lua API definitions */
 
 /*** Create a new thread.
@@ -298,11 +407,18 @@ int safethread_new(lua_State *L){
 	
 	/* Create mutex and condition variable */
 	t->state = THREAD_INIT;
+	t->id = 0;
 	create_mutex(t->mutex);
 	create_cond(t->cond);
+	init_stats(&t->stats);
+	add_thread(t);
 	
 	/* Push initial function */
-	if(lua_gettop(L) >= 2 && lua_isfunction(L, 1)) copy_value(L, t->L, 1);
+	if(lua_gettop(L) >= 2 && lua_isfunction(L, 1)){
+		size_t bytes = 0;
+		copy_value(L, t->L, 1, &bytes);
+		stats_add(t->stats.bytes, bytes);
+	}
 	
 	/* Create hardware thread and start it */
 	create_thread(t->thread, safethread_run, t);
@@ -335,6 +451,16 @@ int safethread_sleep(lua_State *L){
 	return 0;
 }
 
+/*** Get the time of a monotonic wall clock.
+ * Unlike `os.clock`, the clock is the same in all threads.
+ * @function time
+ * @treturn number seconds since an arbitrary point in time
+ */
+int safethread_time(lua_State *L){
+	lua_pushnumber(L, time_ns() * 1e-9);
+	return 1;
+}
+
 /*** Exit the current thread.
  * Like `os.exit`, but stops only this thread instead of the whole process.
  * @function exit
@@ -359,11 +485,88 @@ int safethread_exit(lua_State *L){
  * @treturn Thread the current thread
  */
 int safethread_self(lua_State *L){
-	lua_getfield(L, LUA_REGISTRYINDEX, "mb_thread");
+	if(lua_getfield(L, LUA_REGISTRYINDEX, "mb_thread") == LUA_TNIL) return 1;
 	luaL_setmetatable(L, "Thread");
 	return 1;
 }
 
+static const char *state_name(ThreadState state){
+	switch(state){
+		case THREAD_INIT: return "init";
+		case THREAD_IDLE: return "idle";
+		case THREAD_ACTIVE: return "active";
+		case THREAD_DEAD: return "dead";
+		default: return "(unknown)";
+	}
+}
+
+// A copy of the stats of a thread, so they can be pushed without holding any lock
+typedef struct StatsSnapshot {
+	THREAD_ID id;
+	ThreadState state;
+	ThreadStats stats;
+} StatsSnapshot;
+
+static void take_snapshot(Thread *t, StatsSnapshot *snapshot){
+	ThreadStats *stats = &t->stats;
+	snapshot->id = t->id;
+	snapshot->state = t->state;
+	snapshot->stats.created = stats->created;
+	snapshot->stats.lock_wait = __atomic_load_n(&stats->lock_wait, __ATOMIC_RELAXED);
+	snapshot->stats.busy = __atomic_load_n(&stats->busy, __ATOMIC_RELAXED);
+	snapshot->stats.copy = __atomic_load_n(&stats->copy, __ATOMIC_RELAXED);
+	snapshot->stats.bytes = __atomic_load_n(&stats->bytes, __ATOMIC_RELAXED);
+	snapshot->stats.jobs = __atomic_load_n(&stats->jobs, __ATOMIC_RELAXED);
+	snapshot->stats.waiting = __atomic_load_n(&stats->waiting, __ATOMIC_RELAXED);
+	snapshot->stats.max_waiting = __atomic_load_n(&stats->max_waiting, __ATOMIC_RELAXED);
+}
+
+static void push_stats(lua_State *L, StatsSnapshot *snapshot){
+	ThreadStats *stats = &snapshot->stats;
+	lua_createtable(L, 0, 10);
+	
+	lua_pushinteger(L, snapshot->id);
+	lua_setfield(L, -2, "id");
+	lua_pushstring(L, state_name(snapshot->state));
+	lua_setfield(L, -2, "status");
+	lua_pushnumber(L, (time_ns() - stats->created) * 1e-9);
+	lua_setfield(L, -2, "uptime");
+	lua_pushnumber(L, stats->lock_wait * 1e-9);
+	lua_setfield(L, -2, "lockWait");
+	lua_pushnumber(L, stats->busy * 1e-9);
+	lua_setfield(L, -2, "busy");
+	lua_pushnumber(L, stats->copy * 1e-9);
+	lua_setfield(L, -2, "copy");
+	lua_pushinteger(L, stats->bytes);
+	lua_setfield(L, -2, "bytes");
+	lua_pushinteger(L, stats->jobs);
+	lua_setfield(L, -2, "jobs");
+	lua_pushinteger(L, stats->waiting);
+	lua_setfield(L, -2, "waiting");
+	lua_pushinteger(L, stats->max_waiting);
+	lua_setfield(L, -2, "maxWaiting");
+}
+
+// Add the number field name of the table on top of the stack to the table at idx
+static void add_total(lua_State *L, int idx, const char *name){
+	lua_getfield(L, idx, name);
+	lua_getfield(L, -2, name);
+	lua_arith(L, LUA_OPADD);
+	lua_setfield(L, idx, name);
+}
+
+/***
+ * Get the performance counters of all threads.
+ * Can also be called as a method on a thread, to get the counters of only that thread.
+ * @function stats
+ * @treturn table a table with a `threads` list containing the `Thread:stats`
+ * of every thread, and the totals of the `lockWait`, `busy`, `copy`, `bytes`,
+ * `jobs` and `waiting` fields over all threads
+ * @usage for _, s in ipairs(safethread.stats().threads) do
+ * 	print(s.id, s.busy / s.uptime)
+ * end
+ */
+
 /// @type Thread
 
 /*** Get a thread's status.
@@ -374,14 +577,7 @@ int safethread_status(lua_State *L){
 	/* Get Lua thread */
 	Thread *t = luaL_checkudata(L, 1, "Thread"); // stack: {t}
 	
-	switch(t->state){
-		case THREAD_INIT: lua_pushstring(L, "init"); break;
-		case THREAD_IDLE: lua_pushstring(L, "idle"); break;
-		case THREAD_ACTIVE: lua_pushstring(L, "active"); break;
-		case THREAD_DEAD: lua_pushstring(L, "dead"); break;
-		default: lua_pushstring(L, "(unknown)"); break;
-	}
-	
+	lua_pushstring(L, state_name(t->state));
 	return 1;
 }
 
@@ -395,8 +591,7 @@ int safethread_wait(lua_State *L){
 	if(t->state == THREAD_DEAD) return 0; // Don't wait for a thread that has already stopped
 	
 	/* Wait for thread to become idle */
-	lock_mutex(t->mutex);
-	while(t->state != THREAD_IDLE) wait_cond(t->cond, t->mutex);
+	lock_thread(t, 1);
 	t->state = THREAD_DEAD;
 	unlock_mutex(t->mutex);
 	
@@ -407,7 +602,7 @@ int safethread_wait(lua_State *L){
 	
 	/* Get return values */
 	int top = lua_gettop(L);
-	move_values(t->L, L, lua_gettop(t->L) - 1);
+	move_values(t->L, L, lua_gettop(t->L) - 1, &t->stats);
 	
 	return lua_gettop(L) - top;
 }
@@ -465,22 +660,24 @@ int safethread_pcall(lua_State *L){
 	
 	luaL_argcheck(L, lua_isfunction(L, 2), 2, "expected function");
 	int n_args = lua_gettop(L)-2;
-	lock_mutex(t->mutex);
-	// Wait until thread is idle
-	while(t->state != THREAD_IDLE) wait_cond(t->cond, t->mutex);
-	move_values(L, t->L, n_args+1);
+	lock_thread(t, 1); // Wait until thread is idle
+	move_values(L, t->L, n_args+1, &t->stats);
 	
 	int base = lua_gettop(t->L) - n_args - 1;
-	if(lua_pcall(t->L, n_args, LUA_MULTRET, 0) != LUA_OK){
+	uint64_t start = time_ns();
+	int status = lua_pcall(t->L, n_args, LUA_MULTRET, 0);
+	stats_add(t->stats.busy, time_ns() - start);
+	stats_add(t->stats.jobs, 1);
+	if(status != LUA_OK){
 		lua_pushboolean(L, 0);
-		move_value(t->L, L); // Error will be on top of thread stack
+		move_values(t->L, L, 1, &t->stats); // Error will be on top of thread stack
 		unlock_mutex(t->mutex);
 		return 2;
 	}
 	
 	lua_pushboolean(L, 1);
 	int n_ret = lua_gettop(t->L) - base;
-	move_values(t->L, L, n_ret);
+	move_values(t->L, L, n_ret, &t->stats);
 	unlock_mutex(t->mutex);
 	return n_ret + 1;
 }
@@ -502,8 +699,7 @@ static int exec_async(lua_State *L){
 	luaL_argcheck(L, lua_isfunction(L, 1) || lua_gettop(L) == 0, 1, "expected function");
 	
 	/* Wait until thread is idle */
-	lock_mutex(t->mutex);
-	while(t->state != THREAD_IDLE) wait_cond(t->cond, t->mutex);
+	lock_thread(t, 1);
 	
 	/* Register callback in registry */
 	t->cb_id = lua_gettop(L) >= 1 ? luaL_ref(L, LUA_REGISTRYINDEX) : 0;
@@ -516,7 +712,7 @@ static int exec_async(lua_State *L){
 	for(int i = 3; i <= n_args + 3; i++){
 		lua_pushvalue(L, lua_upvalueindex(i));
 	}
-	move_values(L, t->L, n_args + 1);
+	move_values(L, t->L, n_args + 1, &t->stats);
 	t->state = THREAD_ACTIVE;
 	unlock_mutex(t->mutex);
 	
@@ -551,15 +747,219 @@ int safethread_pushEvent(lua_State *L){
 	Thread *t = luaL_checkudata(L, 1, "Thread"); // stack: {(args?), fn, t}
 	if(t->state == 0) return 0; // Thread has stopped
 	
-	lock_mutex(t->mutex);
+	lock_thread(t, 0);
 	lua_pushcfunction(t->L, event_push);
 	int n_args = lua_gettop(L)-1;
-	move_values(L, t->L, n_args);
+	move_values(L, t->L, n_args, &t->stats);
 	lua_call(t->L, n_args, 0);
 	unlock_mutex(t->mutex);
 	return 0;
 }
 
+// Push the result of a function returning an error number, like luaL_fileresult
+static int thread_result(lua_State *L, int err){
+	if(err == 0){
+		lua_pushboolean(L, 1);
+		return 1;
+	}
+	lua_pushboolean(L, 0);
+	lua_pushstring(L, strerror(err));
+	return 2;
+}
+
+// Get a Thread that has not stopped, and wait until its OS thread has started
+static Thread *check_running_thread(lua_State *L, int idx){
+	Thread *t = luaL_checkudata(L, idx, "Thread");
+	if(t->state == THREAD_DEAD) luaL_error(L, "thread has stopped");
+	while(__atomic_load_n(&t->id, __ATOMIC_ACQUIRE) == 0) sched_yield();
+	return t;
+}
+
+/***
+ * Set the name of a thread, as shown by debuggers and system monitors.
+ * On Linux, names are cut off at 15 characters.
+ * @function setName
+ * @tparam string name
+ * @treturn boolean success
+ * @treturn string|nil error
+ */
+int safethread_setName(lua_State *L){
+	Thread *t = check_running_thread(L, 1);
+	const char *name = luaL_checkstring(L, 2);
+	char shortname[16];
+	strncpy(shortname, name, sizeof(shortname) - 1);
+	shortname[sizeof(shortname) - 1] = '\0';
+	return thread_result(L, set_thread_name(t->thread, shortname));
+}
+
+/***
+ * Set the CPU cores a thread may run on.
+ * @function setAffinity
+ * @tparam table|number cores a list of core numbers (starting at 0),
+ * or a bitmask where bit n stands for core n
+ * @treturn boolean success
+ * @treturn string|nil error
+ * @usage safethread.self():setAffinity{0} -- pin the main thread to core 0
+ */
+int safethread_setAffinity(lua_State *L){
+	Thread *t = check_running_thread(L, 1);
+	CPUSET set;
+	cpuset_clear(set);
+	if(lua_type(L, 2) == LUA_TNUMBER){
+		lua_Integer mask = luaL_checkinteger(L, 2);
+		for(int cpu = 0; cpu < 64; cpu++){
+			if((mask >> cpu) & 1) cpuset_add(set, cpu);
+		}
+	}else{
+		luaL_checktype(L, 2, LUA_TTABLE);
+		lua_Integer n = luaL_len(L, 2);
+		for(lua_Integer i = 1; i <= n; i++){
+			lua_geti(L, 2, i);
+			lua_Integer cpu = lua_tointeger(L, -1);
+			lua_pop(L, 1);
+			luaL_argcheck(L, cpu >= 0 && cpu < (lua_Integer)(8 * sizeof(set)), 2, "invalid core number");
+			cpuset_add(set, cpu);
+		}
+	}
+	return thread_result(L, set_thread_affinity(t->thread, set));
+}
+
+/***
+ * Get the CPU cores a thread may run on.
+ * @function getAffinity
+ * @treturn[1] table a list of core numbers
+ * @treturn[2] nil
+ * @treturn[2] string error
+ */
+int safethread_getAffinity(lua_State *L){
+	Thread *t = check_running_thread(L, 1);
+	CPUSET set;
+	cpuset_clear(set);
+	int err = get_thread_affinity(t->thread, set);
+	if(err != 0){
+		lua_pushnil(L);
+		lua_pushstring(L, strerror(err));
+		return 2;
+	}
+	lua_newtable(L);
+	int n = 0;
+	for(int cpu = 0; cpu < (int)(8 * sizeof(set)); cpu++){
+		if(cpuset_has(set, cpu)){
+			lua_pushinteger(L, cpu);
+			lua_seti(L, -2, ++n);
+		}
+	}
+	return 1;
+}
+
+/***
+ * Set the priority of a thread, as a nice value.
+ * Like the nice value of processes, this ranges from -20 (highest priority)
+ * to 19 (lowest priority). Raising the priority usually needs extra permissions.
+ * On Windows, this is mapped to the closest thread priority level.
+ * @function setPriority
+ * @tparam number nice
+ * @treturn boolean success
+ * @treturn string|nil error
+ */
+int safethread_setPriority(lua_State *L){
+	Thread *t = check_running_thread(L, 1);
+	int nice = luaL_checkinteger(L, 2);
+	luaL_argcheck(L, nice >= -20 && nice <= 19, 2, "nice value must be from -20 to 19");
+	return thread_result(L, set_thread_nice(t->thread, t->id, nice));
+}
+
+/***
+ * Set the scheduling policy of a thread (Linux only).
+ * The real-time policies `"fifo"` and `"rr"` usually need extra permissions.
+ * @function setScheduler
+ * @tparam string policy one of `"other"` (the default), `"batch"`, `"idle"`,
+ * `"fifo"` or `"rr"`
+ * @tparam[opt=0] number priority the real-time priority, only for `"fifo"` and `"rr"`
+ * @treturn boolean success
+ * @treturn string|nil error
+ */
+int safethread_setScheduler(lua_State *L){
+	static const char *const names[] = {"other", "batch", "idle", "fifo", "rr", NULL};
+#if defined(__linux__)
+	static const int policies[] = {SCHED_OTHER, SCHED_BATCH, SCHED_IDLE, SCHED_FIFO, SCHED_RR};
+#else
+	static const int policies[] = {0, 0, 0, 0, 0};
+#endif
+	Thread *t = check_running_thread(L, 1);
+	int policy = luaL_checkoption(L, 2, NULL, names);
+	int priority = luaL_optinteger(L, 3, 0);
+	return thread_result(L, set_thread_policy(t->thread, policies[policy], priority));
+}
+
+/***
+ * Get the performance counters of a thread.
+ * Times are in seconds. The lock wait time is the time callers spent waiting
+ * until they could use the thread, which includes waiting for the previous
+ * call to finish. The busy time is the time spent running functions called
+ * with `pcall` or `async`.
+ * @function stats
+ * @treturn table a table with the fields `id` (the OS thread id), `status`,
+ * `uptime`, `lockWait`, `busy`, `copy` (time spent copying values between
+ * threads), `bytes` (amount of data copied), `jobs` (number of completed
+ * calls), `waiting` (number of callers currently waiting for the thread)
+ * and `maxWaiting`
+ */
+int safethread_stats(lua_State *L){
+	StatsSnapshot snapshot;
+	if(!lua_isnoneornil(L, 1)){
+		take_snapshot(luaL_checkudata(L, 1, "Thread"), &snapshot);
+		push_stats(L, &snapshot);
+		return 1;
+	}
+	
+	/* Copy the stats of all threads, without creating Lua values while
+	the list is locked */
+	lock_threads();
+	int n = 0;
+	for(Thread *t = threads; t != NULL; t = t->next) n++;
+	StatsSnapshot *snapshots = malloc(n * sizeof(StatsSnapshot));
+	n = 0;
+	for(Thread *t = threads; t != NULL && snapshots != NULL; t = t->next){
+		take_snapshot(t, &snapshots[n++]);
+	}
+	unlock_threads();
+	
+	lua_newtable(L); // stack: {totals}
+	static const char *const fields[] = {"lockWait", "busy", "copy", "bytes", "jobs", "waiting"};
+	for(size_t i = 0; i < sizeof(fields)/sizeof(fields[0]); i++){
+		lua_pushinteger(L, 0);
+		lua_setfield(L, -2, fields[i]);
+	}
+	lua_newtable(L); // stack: {threads, totals}
+	
+	for(int i = 0; i < n; i++){
+		push_stats(L, &snapshots[i]); // stack: {stats, threads, totals}
+		for(size_t j = 0; j < sizeof(fields)/sizeof(fields[0]); j++){
+			add_total(L, -3, fields[j]);
+		}
+		lua_seti(L, -2, i+1); // stack: {threads, totals}
+	}
+	free(snapshots);
+	
+	lua_setfield(L, -2, "threads"); // stack: {totals}
+	return 1;
+}
+
+// Stop the thread like kill, and remove it from the list of threads
+static int safethread__gc(lua_State *L){
+	Thread *t = luaL_checkudata(L, 1, "Thread");
+	remove_thread(t);
+	if(t->L == L){
+		/* The main thread is closing its own state, cancelling it would
+		stop the process halfway through closing */
+		t->state = THREAD_DEAD;
+		destroy_mutex(t->mutex);
+		return 0;
+	}
+	return safethread_kill(L);
+}
+
 int safethread__call(lua_State *L){
 	lua_pushcfunction(L, safethread_new);
 	lua_replace(L, 1);
@@ -570,6 +970,7 @@ int safethread__call(lua_State *L){
 static const struct luaL_Reg safethread_f[] = {
 	{"new", safethread_new},
 	{"sleep", safethread_sleep},
+	{"time", safethread_time},
 	{"exit", safethread_exit},
 	{"self", safethread_self},
 	{"status", safethread_status},
@@ -578,10 +979,21 @@ static const struct luaL_Reg safethread_f[] = {
 	{"pcall", safethread_pcall},
 	{"async", safethread_async},
 	{"pushEvent", safethread_pushEvent},
+	{"stats", safethread_stats},
+	{"setName", safethread_setName},
+	{"setAffinity", safethread_setAffinity},
+	{"getAffinity", safethread_getAffinity},
+	{"setPriority", safethread_setPriority},
+	{"setScheduler", safethread_setScheduler},
+	{"spawn", actor_spawn},
+	{"send", actor_send},
+	{"stop", actor_stop},
+	{"setPoolSize", actor_setPoolSize},
 	{NULL, NULL}
 };
 
 LUAMOD_API int luaopen_safethread(lua_State *L){
+	actor_init();
 	lua_newtable(L); // stack: {table}
 	luaL_setfuncs(L, safethread_f, 0);
 	
@@ -601,7 +1013,7 @@ LUAMOD_API int luaopen_safethread(lua_State *L){
 	lua_setfield(L, -2, "__index"); // stack: {mt, table}
 	
 	// To ensure the threads stop when they go out of scope (e.g. when the program stops)
-	lua_pushcfunction(L, safethread_kill); // stack: {safethread_kill, mt, table}
+	lua_pushcfunction(L, safethread__gc); // stack: {safethread__gc, mt, table}
 	lua_setfield(L, -2, "__gc"); // stack: {mt, table}
 	lua_pop(L, 1); // stack: {table}
 	
@@ -614,11 +1026,22 @@ LUAMOD_API int luaopen_safethread(lua_State *L){
 		t->state = 1; // Active
 		t->L = L;
 		t->thread = self_thread();
+		t->id = self_thread_id();
 		create_mutex(t->mutex);
+		init_stats(&t->stats);
+		add_thread(t);
 		
 		/* Put Thread struct in registry */
 		luaL_setmetatable(L, "Thread");
 		lua_setfield(L, LUA_REGISTRYINDEX, "mb_thread"); // stack: {table}
+		
+		/* Join the actor workers before the library can be unloaded */
+		lua_newuserdata(L, 0); // stack: {pool, table}
+		lua_newtable(L); // stack: {mt, pool, table}
+		lua_pushcfunction(L, actor_pool__gc);
+		lua_setfield(L, -2, "__gc");
+		lua_setmetatable(L, -2); // stack: {pool, table}
+		lua_setfield(L, LUA_REGISTRYINDEX, "mb_actor_pool"); // stack: {table}
 	}
 	
 	return 1;
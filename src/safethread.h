@@ -1,5 +1,7 @@
 #pragma once
 
+#include <stdint.h> // for uint64_t
+
 #include <lua.h>
 
 #include "threads.h"
@@ -20,16 +22,40 @@ typedef enum ThreadState {
 
 typedef struct Thread Thread; // forward-declare
 
+// Performance counters, updated atomically because callers in other
+// threads add to them. Times are in nanoseconds
+typedef struct ThreadStats {
+	uint64_t created;     // time the thread was created
+	uint64_t lock_wait;   // time callers spent waiting for the thread to become idle
+	uint64_t busy;        // time spent executing called functions
+	uint64_t copy;        // time spent copying values into and out of the thread
+	uint64_t bytes;       // number of bytes of values copied
+	uint64_t jobs;        // number of completed pcall and async calls
+	uint32_t waiting;     // number of callers currently waiting for the thread
+	uint32_t max_waiting; // highest number of callers waiting at the same time
+} ThreadStats;
+
 typedef struct Thread {
 	lua_State *L;
 	ThreadState state;
 	THREAD thread;
+	THREAD_ID id; // OS thread id, 0 until the thread has started
 	MUTEX mutex;
 	CONDITION cond;
 	Thread *cb_t;
 	int cb_id;
+	ThreadStats stats;
+	Thread *prev, *next; // list of all threads, for safethread.stats
 } Thread;
 
+// Make t the Thread of the calling OS thread and its state L, for states
+// that are not created by safethread_new. The calling thread holds t->mutex
+// while it runs, like the threads of safethread_new
+void safethread_adopt(lua_State *L, Thread *t);
+
+// Undo safethread_adopt, after the state is closed
+void safethread_release(Thread *t);
+
 /* Lua API definitions */
 
 // Create a new thread
@@ -38,6 +64,9 @@ int safethread_new(lua_State *L);
 // Sleep the current thread for an amount of time
 int safethread_sleep(lua_State *L);
 
+// Get the time of a monotonic clock shared by all threads
+int safethread_time(lua_State *L);
+
 // Exit the current thread
 int safethread_exit(lua_State *L);
 
@@ -62,4 +91,22 @@ int safethread_async(lua_State *L);
 // Push an event on the queue in the thread
 int safethread_pushEvent(lua_State *L);
 
+// Get the performance counters of a thread
+int safethread_stats(lua_State *L);
+
+// Set the name of a thread
+int safethread_setName(lua_State *L);
+
+// Set the CPU cores a thread may run on
+int safethread_setAffinity(lua_State *L);
+
+// Get the CPU cores a thread may run on
+int safethread_getAffinity(lua_State *L);
+
+// Set the nice value of a thread
+int safethread_setPriority(lua_State *L);
+
+// Set the scheduling policy of a thread
+int safethread_setScheduler(lua_State *L);
+
 LUAMOD_API int luaopen_safethread(lua_State *L);
\ No newline at end of file
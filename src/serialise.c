@@ -0,0 +1,239 @@
+#include <stdlib.h> // for malloc, realloc, free
+#include <string.h> // for memcpy
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "serialise.h"
+
+/* C library definitions */
+
+void serialise_init(Serialised *s){
+	s->data = NULL;
+	s->size = 0;
+	s->capacity = 0;
+}
+
+void serialise_free(Serialised *s){
+	free(s->data);
+	serialise_init(s);
+}
+
+static void append(Serialised *s, const void *data, size_t size){
+	if(s->size + size > s->capacity){
+		size_t capacity = s->capacity ? s->capacity : 16;
+		while(s->size + size > capacity) capacity *= 2;
+		s->data = realloc(s->data, capacity);
+		s->capacity = capacity;
+	}
+	memcpy(s->data + s->size, data, size);
+	s->size += size;
+}
+
+static void append_type(Serialised *s, SerialisedType type){
+	char t = type;
+	append(s, &t, 1);
+}
+
+// A serialised key/value pair of a table
+typedef struct SerialisedPair {
+	const char *data;
+	size_t keySize;
+	size_t size;
+} SerialisedPair;
+
+static int compare_pairs(const void *a, const void *b){
+	const SerialisedPair *pa = a, *pb = b;
+	size_t n = (pa->keySize < pb->keySize) ? pa->keySize : pb->keySize;
+	int cmp = memcmp(pa->data, pb->data, n);
+	if(cmp != 0) return cmp;
+	return (pa->keySize > pb->keySize) - (pa->keySize < pb->keySize);
+}
+
+// Sort the n pairs serialised from start by their keys, so that equal tables
+// give the same bytes whatever order lua_next visits their keys in
+static int sort_pairs(Serialised *s, size_t start, size_t *offsets, size_t n){
+	SerialisedPair *pairs = malloc(n * sizeof(SerialisedPair));
+	char *sorted = malloc(s->size - start);
+	if(pairs == NULL || sorted == NULL){
+		free(pairs);
+		free(sorted);
+		return 0;
+	}
+	for(size_t i = 0; i < n; i++){
+		size_t end = (i + 1 < n) ? offsets[2*i + 2] : s->size;
+		pairs[i].data = s->data + offsets[2*i];
+		pairs[i].keySize = offsets[2*i + 1] - offsets[2*i];
+		pairs[i].size = end - offsets[2*i];
+	}
+	qsort(pairs, n, sizeof(SerialisedPair), compare_pairs);
+	
+	char *p = sorted;
+	for(size_t i = 0; i < n; i++){
+		memcpy(p, pairs[i].data, pairs[i].size);
+		p += pairs[i].size;
+	}
+	memcpy(s->data + start, sorted, s->size - start);
+	free(pairs);
+	free(sorted);
+	return 1;
+}
+
+static int serialise_value_(lua_State *L, int idx, Serialised *s, int depth){
+	idx = lua_absindex(L, idx);
+	switch(lua_type(L, idx)){
+		case LUA_TNONE:
+		case LUA_TNIL:
+			append_type(s, SERIALISED_NIL);
+			return 1;
+		case LUA_TBOOLEAN:
+			append_type(s, lua_toboolean(L, idx) ? SERIALISED_TRUE : SERIALISED_FALSE);
+			return 1;
+		case LUA_TNUMBER:
+			if(lua_isinteger(L, idx)){
+				lua_Integer i = lua_tointeger(L, idx);
+				append_type(s, SERIALISED_INTEGER);
+				append(s, &i, sizeof(i));
+			}else{
+				lua_Number n = lua_tonumber(L, idx);
+				append_type(s, SERIALISED_NUMBER);
+				append(s, &n, sizeof(n));
+			}
+			return 1;
+		case LUA_TSTRING: {
+			size_t len;
+			const char *str = lua_tolstring(L, idx, &len);
+			append_type(s, SERIALISED_STRING);
+			append(s, &len, sizeof(len));
+			append(s, str, len);
+			return 1;
+		}
+		case LUA_TLIGHTUSERDATA:
+		case LUA_TUSERDATA: {
+			// Same as safethread: userdata is shared by pointer, not copied
+			void *ptr = lua_touserdata(L, idx);
+			append_type(s, SERIALISED_POINTER);
+			append(s, &ptr, sizeof(ptr));
+			return 1;
+		}
+		case LUA_TTABLE:
+			// Also guards against recursive tables, which cannot be serialised
+			if(depth >= SERIALISE_MAX_DEPTH) return 0;
+		{
+			append_type(s, SERIALISED_TABLE);
+			size_t start = s->size;
+			
+			/* Remember where each key and value starts, for sorting */
+			size_t n = 0, capacity = 0, *offsets = NULL;
+			lua_pushnil(L);
+			while(lua_next(L, idx) != 0){
+				if(n == capacity){
+					capacity = capacity ? capacity * 2 : 8;
+					size_t *grown = realloc(offsets, 2 * capacity * sizeof(size_t));
+					if(grown == NULL){
+						free(offsets);
+						lua_pop(L, 2);
+						return 0;
+					}
+					offsets = grown;
+				}
+				offsets[2*n] = s->size;
+				int ok = serialise_value_(L, -2, s, depth+1);
+				offsets[2*n + 1] = s->size;
+				if(!ok || !serialise_value_(L, -1, s, depth+1)){
+					free(offsets);
+					lua_pop(L, 2);
+					return 0;
+				}
+				n++;
+				lua_pop(L, 1);
+			}
+			int sorted = (n < 2) || sort_pairs(s, start, offsets, n);
+			free(offsets);
+			if(!sorted) return 0;
+			append_type(s, SERIALISED_TABLE_END);
+			return 1;
+		}
+		default:
+			return 0;
+	}
+}
+
+int serialise_value(lua_State *L, int idx, Serialised *s){
+	size_t size = s->size;
+	if(serialise_value_(L, idx, s, 0)) return 1;
+	s->size = size; // Discard partially serialised value
+	return 0;
+}
+
+const char *deserialise_value(lua_State *L, const char *data, const char *end){
+	if(data >= end) return NULL;
+	luaL_checkstack(L, 3, "too many nested tables");
+	SerialisedType type = *data++;
+	switch(type){
+		case SERIALISED_NIL:
+			lua_pushnil(L);
+			return data;
+		case SERIALISED_FALSE:
+		case SERIALISED_TRUE:
+			lua_pushboolean(L, type == SERIALISED_TRUE);
+			return data;
+		case SERIALISED_INTEGER: {
+			lua_Integer i;
+			if(data + sizeof(i) > end) return NULL;
+			memcpy(&i, data, sizeof(i));
+			lua_pushinteger(L, i);
+			return data + sizeof(i);
+		}
+		case SERIALISED_NUMBER: {
+			lua_Number n;
+			if(data + sizeof(n) > end) return NULL;
+			memcpy(&n, data, sizeof(n));
+			lua_pushnumber(L, n);
+			return data + sizeof(n);
+		}
+		case SERIALISED_STRING: {
+			size_t len;
+			if(data + sizeof(len) > end) return NULL;
+			memcpy(&len, data, sizeof(len));
+			data += sizeof(len);
+			if(len > (size_t)(end - data)) return NULL;
+			lua_pushlstring(L, data, len);
+			return data + len;
+		}
+		case SERIALISED_POINTER: {
+			void *ptr;
+			if(data + sizeof(ptr) > end) return NULL;
+			memcpy(&ptr, data, sizeof(ptr));
+			lua_pushlightuserdata(L, ptr);
+			return data + sizeof(ptr);
+		}
+		case SERIALISED_TABLE:
+			lua_newtable(L);
+			while(data < end && *data != SERIALISED_TABLE_END){
+				data = deserialise_value(L, data, end); // key
+				if(data == NULL) return NULL;
+				data = deserialise_value(L, data, end); // value
+				if(data == NULL) return NULL;
+				if(lua_isnil(L, -2)){
+					lua_pop(L, 2);
+				}else{
+					lua_settable(L, -3);
+				}
+			}
+			return (data < end) ? data + 1 : NULL;
+		default:
+			return NULL;
+	}
+}
+
+int deserialise_values(lua_State *L, const char *data, size_t size){
+	const char *end = data + size;
+	int n = 0;
+	while(data != NULL && data < end){
+		data = deserialise_value(L, data, end);
+		n++;
+	}
+	if(data == NULL) luaL_error(L, "malformed serialised data");
+	return n;
+}
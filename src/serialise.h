@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+
+#include <lua.h>
+
+/* C library definitions */
+
+// Maximum nesting depth of tables that can be serialised
+#define SERIALISE_MAX_DEPTH 64
+
+typedef enum SerialisedType {
+	SERIALISED_NIL,
+	SERIALISED_FALSE,
+	SERIALISED_TRUE,
+	SERIALISED_INTEGER,
+	SERIALISED_NUMBER,
+	SERIALISED_STRING,
+	SERIALISED_POINTER,   // light userdata or userdata, stored as a raw pointer
+	SERIALISED_TABLE,     // followed by key/value pairs
+	SERIALISED_TABLE_END, // marks the end of a table
+} SerialisedType;
+
+// A Lua value converted to a self-contained byte string, independent of any lua_State
+typedef struct Serialised {
+	char *data;
+	size_t size;
+	size_t capacity;
+} Serialised;
+
+// Initialise an empty serialised value
+void serialise_init(Serialised *s);
+
+// Free the memory held by a serialised value
+void serialise_free(Serialised *s);
+
+// Append the value at idx to s
+// Table keys are sorted, so equal values always give the same bytes
+// Returns 0 when the value (or something inside it) cannot be serialised
+int serialise_value(lua_State *L, int idx, Serialised *s);
+
+// Push the value stored at data onto the stack
+// Returns a pointer just past the value, or NULL when the data is malformed
+const char *deserialise_value(lua_State *L, const char *data, const char *end);
+
+// Push all values stored in data onto the stack, returns the number of values
+int deserialise_values(lua_State *L, const char *data, size_t size);
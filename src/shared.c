@@ -0,0 +1,331 @@
+/***
+ * The `shared` module provides a key-value store shared by all threads.
+ * 
+ * Every Lua state that requires this module (the main state and all
+ * `safethread` threads) gets access to the same store, so workers can share
+ * caches and counters without going through the main thread.
+ * Values are stored serialised, so the same types that can be passed to
+ * `safethread` can be stored, except for functions.
+ * 
+ * @module shared
+ */
+
+#include <stdlib.h> // for malloc, calloc, free
+#include <string.h> // for memcpy, memcmp
+#include <sched.h> // for sched_yield
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "threads.h"
+#include "serialise.h"
+#include "shared.h"
+
+/* C library definitions */
+
+// The shared library is only loaded once per process, so all Lua states
+// (and all threads) see the same shards
+static SharedShard shards[SHARED_N_SHARDS];
+
+static void shared_init(void){
+	static int state = 0; // 0: not initialised, 1: initialising, 2: initialised
+	int expected = 0;
+	if(__atomic_compare_exchange_n(&state, &expected, 1, 0, __ATOMIC_ACQ_REL, __ATOMIC_ACQUIRE)){
+		for(int i = 0; i < SHARED_N_SHARDS; i++){
+			create_mutex(shards[i].mutex);
+			shards[i].n_buckets = 16;
+			shards[i].n_entries = 0;
+			shards[i].buckets = calloc(shards[i].n_buckets, sizeof(SharedEntry*));
+		}
+		__atomic_store_n(&state, 2, __ATOMIC_RELEASE);
+	}else{
+		// Another thread is initialising, wait for it to finish
+		while(__atomic_load_n(&state, __ATOMIC_ACQUIRE) != 2) sched_yield();
+	}
+}
+
+// FNV-1a hash
+static uint64_t hash_key(const char *key, size_t len){
+	uint64_t hash = 0xcbf29ce484222325;
+	for(size_t i = 0; i < len; i++){
+		hash ^= (uint8_t)key[i];
+		hash *= 0x100000001b3;
+	}
+	return hash;
+}
+
+static SharedShard *get_shard(uint64_t hash){
+	// Use the high bits for the shard, the low bits for the bucket
+	return &shards[(hash >> 32) & (SHARED_N_SHARDS-1)];
+}
+
+// Find an entry, shard must be locked
+static SharedEntry **find_entry(SharedShard *shard, uint64_t hash, const char *key, size_t len){
+	SharedEntry **entry = &shard->buckets[hash & (shard->n_buckets-1)];
+	while(*entry != NULL){
+		if((*entry)->hash == hash && (*entry)->keylen == len && memcmp((*entry)->key, key, len) == 0){
+			return entry;
+		}
+		entry = &(*entry)->next;
+	}
+	return entry; // points to the NULL at the end of the chain
+}
+
+// Double the number of buckets, shard must be locked
+static void grow(SharedShard *shard){
+	size_t n_buckets = shard->n_buckets * 2;
+	SharedEntry **buckets = calloc(n_buckets, sizeof(SharedEntry*));
+	for(size_t i = 0; i < shard->n_buckets; i++){
+		SharedEntry *entry = shard->buckets[i];
+		while(entry != NULL){
+			SharedEntry *next = entry->next;
+			entry->next = buckets[entry->hash & (n_buckets-1)];
+			buckets[entry->hash & (n_buckets-1)] = entry;
+			entry = next;
+		}
+	}
+	free(shard->buckets);
+	shard->buckets = buckets;
+	shard->n_buckets = n_buckets;
+}
+
+// Replace the value of an entry, or insert a new entry. Takes ownership of value.
+// Shard must be locked, entry must be the result of find_entry
+static void store(SharedShard *shard, SharedEntry **entry, uint64_t hash,
+		const char *key, size_t len, Serialised *value){
+	if(*entry != NULL){
+		serialise_free(&(*entry)->value);
+		(*entry)->value = *value;
+		return;
+	}
+	SharedEntry *new = malloc(sizeof(SharedEntry));
+	new->hash = hash;
+	new->key = malloc(len);
+	memcpy(new->key, key, len);
+	new->keylen = len;
+	new->value = *value;
+	new->next = NULL;
+	*entry = new;
+	if(++shard->n_entries > shard->n_buckets) grow(shard);
+}
+
+// Remove an entry, shard must be locked
+static void remove_entry(SharedShard *shard, SharedEntry **entry){
+	if(*entry == NULL) return;
+	SharedEntry *old = *entry;
+	*entry = old->next;
+	serialise_free(&old->value);
+	free(old->key);
+	free(old);
+	shard->n_entries--;
+}
+
+// Serialise the value at idx, or throw an argument error
+static void check_serialise(lua_State *L, int idx, Serialised *s){
+	serialise_init(s);
+	if(lua_isnoneornil(L, idx)) return; // nil is stored as "no entry"
+	if(!serialise_value(L, idx, s)){
+		serialise_free(s);
+		luaL_argerror(L, idx, "unsupported type");
+	}
+}
+
+/* Lua API definitions */
+
+/***
+ * Get the value stored for a key.
+ * @function get
+ * @tparam string key
+ * @return the value, or `nil` when there is none
+ */
+int shared_get(lua_State *L){
+	size_t len;
+	const char *key = luaL_checklstring(L, 1, &len);
+	uint64_t hash = hash_key(key, len);
+	SharedShard *shard = get_shard(hash);
+	
+	// Copy the data into a userdata so the lock is not held while creating
+	// Lua values, which may raise an error. The userdata can only be created
+	// without the lock, so retry when the value grew in the meantime
+	int top = lua_gettop(L);
+	char *data = NULL;
+	size_t capacity = 0, size;
+	while(1){
+		lock_mutex(shard->mutex);
+		SharedEntry *entry = *find_entry(shard, hash, key, len);
+		if(entry == NULL){
+			unlock_mutex(shard->mutex);
+			lua_settop(L, top);
+			lua_pushnil(L);
+			return 1;
+		}
+		size = entry->value.size;
+		if(size <= capacity){
+			memcpy(data, entry->value.data, size);
+			unlock_mutex(shard->mutex);
+			break;
+		}
+		unlock_mutex(shard->mutex);
+		lua_settop(L, top);
+		data = lua_newuserdata(L, size); // stack: {copy, ...}
+		capacity = size;
+	}
+	
+	const char *end = deserialise_value(L, data, data + size); // stack: {value, copy, ...}
+	if(end == NULL) return luaL_error(L, "malformed value for key '%s'", key);
+	lua_remove(L, -2); // stack: {value, ...}
+	return 1;
+}
+
+/***
+ * Set the value stored for a key.
+ * Setting the value to `nil` removes the key.
+ * @function set
+ * @tparam string key
+ * @param value
+ */
+int shared_set(lua_State *L){
+	size_t len;
+	const char *key = luaL_checklstring(L, 1, &len);
+	Serialised value;
+	check_serialise(L, 2, &value);
+	uint64_t hash = hash_key(key, len);
+	SharedShard *shard = get_shard(hash);
+	
+	lock_mutex(shard->mutex);
+	SharedEntry **entry = find_entry(shard, hash, key, len);
+	if(value.size == 0){
+		remove_entry(shard, entry);
+	}else{
+		store(shard, entry, hash, key, len, &value);
+	}
+	unlock_mutex(shard->mutex);
+	return 0;
+}
+
+/***
+ * Compare and swap.
+ * Atomically sets the value for a key to `new`, but only if the current
+ * value equals `expected`. Tables are compared by their contents, including
+ * those of nested tables, so a table from `get` can be passed as `expected`.
+ * Pass `nil` as `expected` to only set the key when it does not exist yet.
+ * @function cas
+ * @tparam string key
+ * @param expected
+ * @param new
+ * @treturn boolean whether the value was swapped
+ */
+int shared_cas(lua_State *L){
+	size_t len;
+	const char *key = luaL_checklstring(L, 1, &len);
+	luaL_checkany(L, 2);
+	Serialised expected, value;
+	check_serialise(L, 2, &expected);
+	check_serialise(L, 3, &value);
+	uint64_t hash = hash_key(key, len);
+	SharedShard *shard = get_shard(hash);
+	
+	lock_mutex(shard->mutex);
+	SharedEntry **entry = find_entry(shard, hash, key, len);
+	int equal = (*entry == NULL)
+		? expected.size == 0
+		: (*entry)->value.size == expected.size
+			&& memcmp((*entry)->value.data, expected.data, expected.size) == 0;
+	if(equal){
+		if(value.size == 0){
+			remove_entry(shard, entry);
+		}else{
+			store(shard, entry, hash, key, len, &value);
+		}
+	}
+	unlock_mutex(shard->mutex);
+	
+	serialise_free(&expected);
+	if(!equal) serialise_free(&value);
+	lua_pushboolean(L, equal);
+	return 1;
+}
+
+/***
+ * Atomically add a number to the value stored for a key.
+ * A key without value counts as 0.
+ * @function increment
+ * @tparam string key
+ * @tparam[opt=1] number delta
+ * @treturn number the new value
+ */
+int shared_increment(lua_State *L){
+	size_t len;
+	const char *key = luaL_checklstring(L, 1, &len);
+	int isInteger = lua_isnoneornil(L, 2) || lua_isinteger(L, 2);
+	lua_Integer idelta = isInteger ? luaL_optinteger(L, 2, 1) : 0;
+	lua_Number ndelta = isInteger ? 0 : luaL_checknumber(L, 2);
+	uint64_t hash = hash_key(key, len);
+	SharedShard *shard = get_shard(hash);
+	
+	lock_mutex(shard->mutex);
+	SharedEntry **entry = find_entry(shard, hash, key, len);
+	
+	/* Read current value */
+	lua_Integer icurrent = 0;
+	lua_Number ncurrent = 0;
+	int currentIsInteger = 1;
+	if(*entry != NULL){
+		Serialised *s = &(*entry)->value;
+		if(s->data[0] == SERIALISED_INTEGER){
+			memcpy(&icurrent, s->data + 1, sizeof(icurrent));
+		}else if(s->data[0] == SERIALISED_NUMBER){
+			memcpy(&ncurrent, s->data + 1, sizeof(ncurrent));
+			currentIsInteger = 0;
+		}else{
+			unlock_mutex(shard->mutex);
+			return luaL_error(L, "attempt to increment a non-number value");
+		}
+	}
+	
+	/* Write new value */
+	Serialised value;
+	serialise_init(&value);
+	if(isInteger && currentIsInteger){
+		// Wrap around like Lua integer arithmetic
+		icurrent = (lua_Integer)((lua_Unsigned)icurrent + (lua_Unsigned)idelta);
+		char data[1 + sizeof(icurrent)] = {SERIALISED_INTEGER};
+		memcpy(data + 1, &icurrent, sizeof(icurrent));
+		value.data = malloc(sizeof(data));
+		memcpy(value.data, data, sizeof(data));
+		value.size = value.capacity = sizeof(data);
+	}else{
+		ncurrent = (currentIsInteger ? (lua_Number)icurrent : ncurrent)
+			+ (isInteger ? (lua_Number)idelta : ndelta);
+		char data[1 + sizeof(ncurrent)] = {SERIALISED_NUMBER};
+		memcpy(data + 1, &ncurrent, sizeof(ncurrent));
+		value.data = malloc(sizeof(data));
+		memcpy(value.data, data, sizeof(data));
+		value.size = value.capacity = sizeof(data);
+	}
+	store(shard, entry, hash, key, len, &value);
+	unlock_mutex(shard->mutex);
+	
+	if(isInteger && currentIsInteger){
+		lua_pushinteger(L, icurrent);
+	}else{
+		lua_pushnumber(L, ncurrent);
+	}
+	return 1;
+}
+
+static const struct luaL_Reg shared_f[] = {
+	{"get", shared_get},
+	{"set", shared_set},
+	{"cas", shared_cas},
+	{"increment", shared_increment},
+	{NULL, NULL}
+};
+
+LUAMOD_API int luaopen_shared(lua_State *L){
+	shared_init();
+	lua_newtable(L);
+	luaL_setfuncs(L, shared_f, 0);
+	return 1;
+}
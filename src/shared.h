@@ -0,0 +1,48 @@
+#pragma once
+
+#include <stdint.h> // for uint64_t
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "threads.h"
+#include "serialise.h"
+
+/* C library definitions */
+
+// Number of independently locked parts of the store
+// Must be a power of 2
+#define SHARED_N_SHARDS 16
+
+typedef struct SharedEntry SharedEntry; // forward-declare
+
+typedef struct SharedEntry {
+	uint64_t hash;
+	char *key;
+	size_t keylen;
+	Serialised value;
+	SharedEntry *next;
+} SharedEntry;
+
+typedef struct SharedShard {
+	MUTEX mutex;
+	SharedEntry **buckets;
+	size_t n_buckets; // always a power of 2
+	size_t n_entries;
+} SharedShard;
+
+/* Lua API definitions */
+
+// Get the value stored for a key
+int shared_get(lua_State *L);
+
+// Set or remove the value stored for a key
+int shared_set(lua_State *L);
+
+// Set the value for a key only if it currently equals the expected value
+int shared_cas(lua_State *L);
+
+// Add a number to the value stored for a key
+int shared_increment(lua_State *L);
+
+LUAMOD_API int luaopen_shared(lua_State *L);
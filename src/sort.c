@@ -0,0 +1,316 @@
+/***
+ * Sorting and searching of a `TypedArray`.
+ * 
+ * `sort` sorts the elements in place, optionally moving the elements of a
+ * second array along with them, and `argsort` gets the order of the elements
+ * without changing them. Both use a stable radix sort, which takes a few
+ * passes over the array instead of a comparison per step. Floats are sorted by
+ * value, with -0 before 0 and NaNs at the ends.
+ * 
+ * `lowerBound`, `upperBound` and `binarySearch` find values in a sorted array.
+ * 
+ * @submodule TypedArray
+ * @usage
+ * local times = Buffer.array("float64", {3.5, 1.25, 2})
+ * local ids = Buffer.array("uint32", {30, 10, 20})
+ * times:sort(ids)
+ * print(ids[0], times:lowerBound(2)) --> 10	1
+ */
+
+#include <math.h> // for isnan, signbit
+#include <string.h> // for memcpy, memset
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "TypedArray.h"
+#include "sort.h"
+
+/* C library definitions */
+
+// Radix sort keys of the unsigned type T, one byte per pass. Passes where all
+// keys have the same byte are skipped, so small values in a wide type are cheap
+#define SORT_RADIX(name, T) \
+	static void radix_##name(T *keys, T *tmp, uint32_t *idx, uint32_t *tmpidx, size_t n){ \
+		size_t counts[sizeof(T)][256]; \
+		memset(counts, 0, sizeof(counts)); \
+		for(size_t i = 0; i < n; i++){ \
+			for(size_t b = 0; b < sizeof(T); b++) counts[b][(keys[i] >> 8*b) & 0xff]++; \
+		} \
+		\
+		T *src = keys, *dst = tmp; \
+		uint32_t *isrc = idx, *idst = tmpidx; \
+		for(size_t b = 0; b < sizeof(T); b++){ \
+			size_t *offsets = counts[b]; \
+			if(offsets[(src[0] >> 8*b) & 0xff] == n) continue; \
+			size_t total = 0; \
+			for(int j = 0; j < 256; j++){ \
+				size_t count = offsets[j]; \
+				offsets[j] = total; \
+				total += count; \
+			} \
+			if(isrc){ \
+				for(size_t i = 0; i < n; i++){ \
+					size_t pos = offsets[(src[i] >> 8*b) & 0xff]++; \
+					dst[pos] = src[i]; \
+					idst[pos] = isrc[i]; \
+				} \
+				uint32_t *t = isrc; isrc = idst; idst = t; \
+			}else{ \
+				for(size_t i = 0; i < n; i++){ \
+					dst[offsets[(src[i] >> 8*b) & 0xff]++] = src[i]; \
+				} \
+			} \
+			T *t = src; src = dst; dst = t; \
+		} \
+		\
+		/* Move the result back after an odd number of passes */ \
+		if(src != keys){ \
+			memcpy(keys, src, n*sizeof(T)); \
+			if(idx) memcpy(idx, isrc, n*sizeof(uint32_t)); \
+		} \
+	}
+
+SORT_RADIX(8, uint8_t)
+SORT_RADIX(16, uint16_t)
+SORT_RADIX(32, uint32_t)
+SORT_RADIX(64, uint64_t)
+
+void sort_radix(void *keys, void *tmp, uint32_t *idx, uint32_t *tmpidx, size_t n, size_t width){
+	if(n < 2) return;
+	switch(width){
+		case 1: radix_8(keys, tmp, idx, tmpidx, n); break;
+		case 2: radix_16(keys, tmp, idx, tmpidx, n); break;
+		case 4: radix_32(keys, tmp, idx, tmpidx, n); break;
+		case 8: radix_64(keys, tmp, idx, tmpidx, n); break;
+	}
+}
+
+// Convert the elements to keys that sort as unsigned integers, or back.
+// Signed integers get their sign bit flipped, positive floats their sign bit
+// set and negative floats all their bits flipped
+#define SORT_KEYS(T) { \
+		T *k = keys; \
+		const T sign = (T)((T)1 << (8*sizeof(T) - 1)); \
+		for(size_t i = 0; i < array->length; i++){ \
+			uint8_t *p = typedarray_at(array, i); \
+			T u; \
+			if(decode){ \
+				u = k[i]; \
+				if(kind == SORT_SIGNED) u ^= sign; \
+				else if(kind == SORT_FLOAT) u = (u & sign) ? (T)(u ^ sign) : (T)~u; \
+				memcpy(p, &u, sizeof(T)); \
+			}else{ \
+				memcpy(&u, p, sizeof(T)); \
+				if(kind == SORT_SIGNED) u ^= sign; \
+				else if(kind == SORT_FLOAT) u = (u & sign) ? (T)~u : (T)(u | sign); \
+				k[i] = u; \
+			} \
+		} \
+	}
+
+enum { SORT_UNSIGNED, SORT_SIGNED, SORT_FLOAT };
+
+static void sort_keys(TypedArray *array, void *keys, int decode){
+	int kind = typedarray_isfloat(array->type) ? SORT_FLOAT
+		: (array->type % 2 == 0) ? SORT_SIGNED : SORT_UNSIGNED; // int8, int16, int32 and int64
+	switch(typedarray_size(array->type)){
+		case 1: SORT_KEYS(uint8_t) break;
+		case 2: SORT_KEYS(uint16_t) break;
+		case 4: SORT_KEYS(uint32_t) break;
+		case 8: SORT_KEYS(uint64_t) break;
+	}
+}
+
+// Push scratch memory for the keys of the array at idx, and indices when
+// withIndices, and sort them. Writes the sorted elements back to the array
+// when inPlace. Returns the sorted indices
+static uint32_t *sort_array(lua_State *L, int idx, int withIndices, int inPlace){
+	TypedArray *array = typedarray_check(L, idx);
+	size_t n = array->length;
+	size_t width = typedarray_size(array->type);
+	if(withIndices) luaL_argcheck(L, n <= UINT32_MAX, idx, "too many elements");
+	
+	/* Indices first, so that the keys are aligned */
+	size_t indices = withIndices ? n : 0;
+	uint8_t *scratch = lua_newuserdata(L, 2*indices*sizeof(uint32_t) + 2*n*width);
+	uint32_t *index = withIndices ? (uint32_t*)scratch : NULL;
+	uint8_t *keys = scratch + 2*indices*sizeof(uint32_t);
+	for(size_t i = 0; i < indices; i++) index[i] = i;
+	
+	sort_keys(array, keys, 0);
+	sort_radix(keys, keys + n*width, index, index + indices, n, width);
+	if(inPlace) sort_keys(array, keys, 1);
+	return index;
+}
+
+// A number to search for
+typedef struct SortKey {
+	int isinteger;
+	lua_Integer i;
+	lua_Number n;
+} SortKey;
+
+static void sort_checkkey(lua_State *L, int idx, SortKey *key){
+	key->n = luaL_checknumber(L, idx);
+	key->isinteger = lua_isinteger(L, idx);
+	key->i = key->isinteger ? lua_tointeger(L, idx) : 0;
+}
+
+static int sort_isnan(SortKey *key){
+	return !key->isinteger && isnan(key->n);
+}
+
+// Compare element i with a key, -1 when it is smaller, 1 when it is larger
+// NaNs are never equal, and go where sort puts them: negative ones first,
+// positive ones last. A NaN key goes with the positive ones
+#define SORT_CMP(a, b) (((a) < (b)) ? -1 : ((a) > (b)) ? 1 : 0)
+static int sort_compare(TypedArray *array, size_t i, SortKey *key){
+	if(typedarray_isfloat(array->type)){
+		lua_Number e = typedarray_get_number(array, i);
+		if(isnan(e)) return signbit(e) ? -1 : 1;
+		if(sort_isnan(key)) return -1;
+		return SORT_CMP(e, key->isinteger ? (lua_Number)key->i : key->n);
+	}
+	if(sort_isnan(key)) return -1;
+	if(array->type == TYPEDARRAY_UINT64){
+		uint64_t e = (uint64_t)typedarray_get_integer(array, i);
+		if(!key->isinteger) return SORT_CMP((lua_Number)e, key->n);
+		return (key->i < 0) ? 1 : SORT_CMP(e, (uint64_t)key->i);
+	}
+	lua_Integer e = typedarray_get_integer(array, i);
+	return key->isinteger ? SORT_CMP(e, key->i) : SORT_CMP((lua_Number)e, key->n);
+}
+
+// Index of the first element that is not smaller (or larger when upper) than the key
+static size_t sort_bound(TypedArray *array, SortKey *key, int upper){
+	size_t low = 0, high = array->length;
+	while(low < high){
+		size_t mid = low + (high - low) / 2;
+		int cmp = sort_compare(array, mid, key);
+		if(upper ? cmp <= 0 : cmp < 0){
+			low = mid + 1;
+		}else{
+			high = mid;
+		}
+	}
+	return low;
+}
+
+// Whether the elements of two arrays share any bytes, arrays with the fields
+// of the same records (at the same stride) do not
+static int sort_overlaps(TypedArray *a, TypedArray *b){
+	if(a->length == 0 || b->length == 0) return 0;
+	size_t a_size = typedarray_size(a->type), b_size = typedarray_size(b->type);
+	uintptr_t b_start = (uintptr_t)b->data;
+	uintptr_t a_end = (uintptr_t)typedarray_at(a, a->length - 1) + a_size;
+	uintptr_t b_end = (uintptr_t)typedarray_at(b, b->length - 1) + b_size;
+	if((uintptr_t)a->data >= b_end || b_start >= a_end) return 0;
+	
+	for(size_t i = 0; i < a->length; i++){
+		/* The first element of b that ends after element i of a starts */
+		uintptr_t start = (uintptr_t)typedarray_at(a, i);
+		size_t j = (start + 1 < b_start + b_size) ? 0 : (start + 1 - b_start - b_size + b->stride - 1) / b->stride;
+		if(j < b->length && (uintptr_t)typedarray_at(b, j) < start + a_size) return 1;
+	}
+	return 0;
+}
+
+/* Lua API definitions */
+
+/***
+ * Sort the elements in place, from small to large.
+ * The sort is stable: equal elements keep their order.
+ * @function sort
+ * @tparam[opt] TypedArray payload array of the same length, of any type,
+ * whose elements are moved along with the elements of this array, and which
+ * does not share memory with it
+ * @treturn TypedArray self
+ */
+int sort_sort(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	TypedArray *payload = NULL;
+	if(!lua_isnoneornil(L, 2)){
+		payload = typedarray_check(L, 2);
+		luaL_argcheck(L, payload->length == array->length, 2, "arrays must have the same length");
+		luaL_argcheck(L, !sort_overlaps(array, payload), 2, "payload shares memory with the array");
+	}
+	uint32_t *index = sort_array(L, 1, payload != NULL, 1);
+	
+	if(payload){
+		/* Move the payload from a copy */
+		size_t n = payload->length;
+		size_t size = typedarray_size(payload->type);
+		uint8_t *copy = lua_newuserdata(L, n*size);
+		for(size_t i = 0; i < n; i++) memcpy(copy + i*size, typedarray_at(payload, i), size);
+		for(size_t i = 0; i < n; i++) memcpy(typedarray_at(payload, i), copy + index[i]*size, size);
+	}
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get the order of the elements, without changing them.
+ * Equal elements keep their order.
+ * @function argsort
+ * @treturn TypedArray uint32 indices, of the smallest element first
+ * @usage local order = scores:argsort() -- scores[order[0]] is the lowest
+ */
+int sort_argsort(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	uint32_t *index = sort_array(L, 1, 1, 0);
+	TypedArray *result = typedarray_new(L, TYPEDARRAY_UINT32, array->length);
+	memcpy(result->data, index, array->length*sizeof(uint32_t));
+	return 1;
+}
+
+/***
+ * Find where a value would go in a sorted array.
+ * @function lowerBound
+ * @tparam number value
+ * @treturn number the index of the first element that is not smaller than
+ * the value, or the length of the array if there is none
+ */
+int sort_lowerBound(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	SortKey key;
+	sort_checkkey(L, 2, &key);
+	lua_pushinteger(L, sort_bound(array, &key, 0));
+	return 1;
+}
+
+/***
+ * Find where a value would go after the equal elements in a sorted array.
+ * @function upperBound
+ * @tparam number value
+ * @treturn number the index of the first element that is larger than the
+ * value, or the length of the array if there is none
+ */
+int sort_upperBound(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	SortKey key;
+	sort_checkkey(L, 2, &key);
+	lua_pushinteger(L, sort_bound(array, &key, 1));
+	return 1;
+}
+
+/***
+ * Find a value in a sorted array.
+ * @function binarySearch
+ * @tparam number value
+ * @treturn[1] number the index of the first element equal to the value
+ * @treturn[2] nil if there is none, always for NaN
+ */
+int sort_binarySearch(lua_State *L){
+	TypedArray *array = typedarray_check(L, 1);
+	SortKey key;
+	sort_checkkey(L, 2, &key);
+	size_t i = sort_bound(array, &key, 0);
+	if(!sort_isnan(&key) && i < array->length && sort_compare(array, i, &key) == 0){
+		lua_pushinteger(L, i);
+	}else{
+		lua_pushnil(L);
+	}
+	return 1;
+}
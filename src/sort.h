@@ -0,0 +1,24 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+#include "TypedArray.h"
+
+/* C library definitions */
+
+// Sort n keys of width bytes (1, 2, 4 or 8) as unsigned integers, with an LSD
+// radix sort that is stable. tmp needs room for n keys. When idx is not NULL,
+// the n indices in it are moved with their keys, using tmpidx for n indices
+void sort_radix(void *keys, void *tmp, uint32_t *idx, uint32_t *tmpidx, size_t n, size_t width);
+
+/* Lua API definitions */
+
+int sort_sort(lua_State *L);
+int sort_argsort(lua_State *L);
+int sort_lowerBound(lua_State *L);
+int sort_upperBound(lua_State *L);
+int sort_binarySearch(lua_State *L);
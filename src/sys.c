@@ -11,8 +11,18 @@
 #include <lualib.h>
 #include <lauxlib.h>
 
+#include "alloc.h"
+
 /* C library definitions */
 
+// Get the allocator of this Lua state, or NULL when it was not created by mb_init
+static Allocator *sys_get_allocator(lua_State *L){
+	lua_getfield(L, LUA_REGISTRYINDEX, "mb_allocator");
+	Allocator *allocator = lua_touserdata(L, -1);
+	lua_pop(L, 1);
+	return allocator;
+}
+
 /* Lua API definitions */
 
 /***
@@ -35,6 +45,50 @@ int sys_chdir(lua_State *L){
 	}
 }
 
+/***
+ * Get the memory usage of the current Lua state.
+ * Every thread has its own Lua state, so this only counts the memory of
+ * the calling thread.
+ * @function memory
+ * @treturn[1] table with the fields `live` (bytes in use), `peak` (maximum of
+ * `live`), `limit` (0 when there is no limit), `pooled` (bytes reserved for
+ * small objects) and `allocations` (total number of allocations)
+ * @treturn[2] nil when the Lua state was not created by MoonBox
+ */
+int sys_memory(lua_State *L){
+	Allocator *allocator = sys_get_allocator(L);
+	if(allocator == NULL) return 0;
+	
+	lua_createtable(L, 0, 5);
+	lua_pushinteger(L, allocator->live);
+	lua_setfield(L, -2, "live");
+	lua_pushinteger(L, allocator->peak);
+	lua_setfield(L, -2, "peak");
+	lua_pushinteger(L, allocator->limit);
+	lua_setfield(L, -2, "limit");
+	lua_pushinteger(L, allocator->pooled);
+	lua_setfield(L, -2, "pooled");
+	lua_pushinteger(L, allocator->n_allocs);
+	lua_setfield(L, -2, "allocations");
+	return 1;
+}
+
+/***
+ * Set the maximum amount of memory the current Lua state can use.
+ * Allocations that would go over the limit raise a "not enough memory" error.
+ * @function setMemoryLimit
+ * @tparam[opt] number limit in bytes, `nil` or 0 to remove the limit
+ * @treturn boolean whether the limit was set
+ */
+int sys_setMemoryLimit(lua_State *L){
+	lua_Integer limit = luaL_optinteger(L, 1, 0);
+	luaL_argcheck(L, limit >= 0, 1, "limit must be >= 0");
+	Allocator *allocator = sys_get_allocator(L);
+	if(allocator != NULL) allocator->limit = limit;
+	lua_pushboolean(L, allocator != NULL);
+	return 1;
+}
+
 /*** 
  * The number of CPU cores
  * @tfield number cores
@@ -52,6 +106,8 @@ int sys_chdir(lua_State *L){
 
 static const struct luaL_Reg sys_f[] = {
 	{"chdir", sys_chdir},
+	{"memory", sys_memory},
+	{"setMemoryLimit", sys_setMemoryLimit},
 	{NULL, NULL}
 };
 
@@ -10,4 +10,10 @@
 // Change directory
 int sys_chdir(lua_State *L);
 
+// Get the memory usage of the current Lua state
+int sys_memory(lua_State *L);
+
+// Set the maximum memory usage of the current Lua state
+int sys_setMemoryLimit(lua_State *L);
+
 LUAMOD_API int luaopen_sys(lua_State *L);
\ No newline at end of file
@@ -0,0 +1,707 @@
+/***
+ * A `Text` is an editable string for editors and REPLs, which stays fast when
+ * it is large or edited often.
+ * 
+ * The text is kept as a piece table: a balanced tree of pieces of bytes that
+ * are never moved or changed. Inserting and removing only rearranges pieces,
+ * which takes O(log n) time instead of copying the whole string. The tree
+ * also counts newlines, so finding lines takes O(log n) time too.
+ * 
+ * Positions are byte offsets starting at 0 and lines are numbered from 0, like
+ * the indices of a `Buffer`. `move` and `column` count UTF-8 characters.
+ * 
+ * Removed bytes stay in memory until the `Text` is collected.
+ * 
+ * @classmod Text
+ * @see Buffer
+ * @usage
+ * local text = Buffer.text("hello\nworld")
+ * text:insert(5, ", there")
+ * print(text:lines(), text:line(0)) --> 2	hello, there
+ */
+
+#include <stdlib.h> // for malloc, free
+#include <string.h> // for memcpy, memchr
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "Buffer.h"
+#include "text.h"
+
+/* C library definitions */
+
+static size_t node_total(TextNode *node){
+	return node ? node->total : 0;
+}
+
+static size_t node_newlines(TextNode *node){
+	return node ? node->totalNewlines : 0;
+}
+
+static void node_update(TextNode *node){
+	node->total = node_total(node->left) + node->length + node_total(node->right);
+	node->totalNewlines = node_newlines(node->left) + node->newlines + node_newlines(node->right);
+}
+
+static size_t text_newlines(const uint8_t *data, size_t size){
+	size_t count = 0;
+	const uint8_t *end = data + size;
+	while((data = memchr(data, '\n', end - data)) != NULL){
+		count++;
+		data++;
+	}
+	return count;
+}
+
+// Make sure the next insert of size bytes needs no allocations, or throw an error
+static void text_reserve(lua_State *L, Text *text, size_t size){
+	/* One node per piece, plus one for splitting a piece */
+	size_t nodes = size / TEXT_PIECE_SIZE + TEXT_BLOCK_SIZE / TEXT_PIECE_SIZE + 3;
+	while(text->nfree < nodes){
+		TextSlab *slab = malloc(sizeof(TextSlab));
+		if(slab == NULL) luaL_error(L, "not enough memory");
+		slab->next = text->slabs;
+		text->slabs = slab;
+		for(int i = 0; i < TEXT_SLAB_NODES; i++){
+			slab->nodes[i].right = text->free;
+			text->free = &slab->nodes[i];
+		}
+		text->nfree += TEXT_SLAB_NODES;
+	}
+	
+	size_t room = text->blocks ? TEXT_BLOCK_SIZE - text->blocks->used : 0;
+	size_t blocks = (size > room) ? (size - room + TEXT_BLOCK_SIZE - 1) / TEXT_BLOCK_SIZE : 0;
+	for(TextBlock *block = text->spare; block != NULL && blocks > 0; block = block->next) blocks--;
+	while(blocks-- > 0){
+		TextBlock *block = malloc(sizeof(TextBlock));
+		if(block == NULL) luaL_error(L, "not enough memory");
+		block->next = text->spare;
+		block->used = 0;
+		text->spare = block;
+	}
+}
+
+static TextNode *text_node(Text *text, const uint8_t *data, size_t length, size_t newlines){
+	TextNode *node = text->free;
+	text->free = node->right;
+	text->nfree--;
+	
+	/* xorshift32 */
+	uint32_t x = text->seed;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	text->seed = x;
+	
+	node->left = node->right = NULL;
+	node->data = data;
+	node->length = length;
+	node->newlines = newlines;
+	node->priority = x;
+	node_update(node);
+	return node;
+}
+
+static void text_release(Text *text, TextNode *node){
+	if(node == NULL) return;
+	text_release(text, node->left);
+	text_release(text, node->right);
+	node->right = text->free;
+	text->free = node;
+	text->nfree++;
+}
+
+// Split a tree into the first pos bytes and the rest, splitting a piece if needed
+static void text_split(Text *text, TextNode *node, size_t pos, TextNode **left, TextNode **right){
+	if(node == NULL){
+		*left = *right = NULL;
+		return;
+	}
+	size_t before = node_total(node->left);
+	if(pos <= before){
+		text_split(text, node->left, pos, left, &node->left);
+		node_update(node);
+		*right = node;
+	}else if(pos >= before + node->length){
+		text_split(text, node->right, pos - before - node->length, &node->right, right);
+		node_update(node);
+		*left = node;
+	}else{
+		/* Only count the newlines of the shorter part */
+		size_t cut = pos - before;
+		size_t rest = node->length - cut;
+		size_t newlines = (cut < rest)
+			? node->newlines - text_newlines(node->data, cut)
+			: text_newlines(node->data + cut, rest);
+		
+		/* The same priority keeps the treap valid */
+		TextNode *tail = text_node(text, node->data + cut, rest, newlines);
+		tail->priority = node->priority;
+		tail->right = node->right;
+		node_update(tail);
+		node->length = cut;
+		node->newlines -= newlines;
+		node->right = NULL;
+		node_update(node);
+		*left = node;
+		*right = tail;
+	}
+}
+
+static TextNode *text_merge(TextNode *left, TextNode *right){
+	if(left == NULL) return right;
+	if(right == NULL) return left;
+	if(left->priority > right->priority){
+		left->right = text_merge(left->right, right);
+		node_update(left);
+		return left;
+	}else{
+		right->left = text_merge(left, right->left);
+		node_update(right);
+		return right;
+	}
+}
+
+// The piece that ends at byte pos, or NULL
+static TextNode *text_ending(TextNode *node, size_t pos){
+	while(node != NULL){
+		size_t before = node_total(node->left);
+		if(pos <= before){
+			node = node->left;
+		}else if(pos <= before + node->length){
+			return (pos == before + node->length) ? node : NULL;
+		}else{
+			pos -= before + node->length;
+			node = node->right;
+		}
+	}
+	return NULL;
+}
+
+// Grow the piece that ends at byte pos
+static void text_extend(TextNode *node, size_t pos, size_t length, size_t newlines){
+	size_t before = node_total(node->left);
+	if(pos <= before){
+		text_extend(node->left, pos, length, newlines);
+	}else if(pos == before + node->length){
+		node->length += length;
+		node->newlines += newlines;
+	}else{
+		text_extend(node->right, pos - before - node->length, length, newlines);
+	}
+	node_update(node);
+}
+
+void text_put(lua_State *L, Text *text, size_t pos, const uint8_t *data, size_t size){
+	text_reserve(L, text, size);
+	
+	TextNode *pieces = NULL;
+	while(size > 0){
+		if(text->blocks == NULL || text->blocks->used == TEXT_BLOCK_SIZE){
+			TextBlock *block = text->spare;
+			text->spare = block->next;
+			block->next = text->blocks;
+			text->blocks = block;
+		}
+		TextBlock *block = text->blocks;
+		size_t n = (size < TEXT_BLOCK_SIZE - block->used) ? size : TEXT_BLOCK_SIZE - block->used;
+		n = (n < TEXT_PIECE_SIZE) ? n : TEXT_PIECE_SIZE;
+		uint8_t *dst = block->data + block->used;
+		memcpy(dst, data, n);
+		block->used += n;
+		size_t newlines = text_newlines(dst, n);
+		
+		/* Typing appends to the piece written last, instead of adding a piece per key */
+		TextNode *previous = (pieces == NULL) ? text_ending(text->root, pos) : NULL;
+		if(previous != NULL && previous->data + previous->length == dst && previous->length + n <= TEXT_PIECE_SIZE){
+			text_extend(text->root, pos, n, newlines);
+			pos += n;
+		}else{
+			pieces = text_merge(pieces, text_node(text, dst, n, newlines));
+		}
+		data += n;
+		size -= n;
+	}
+	
+	if(pieces != NULL){
+		TextNode *left, *right;
+		text_split(text, text->root, pos, &left, &right);
+		text->root = text_merge(text_merge(left, pieces), right);
+	}
+}
+
+void text_cut(lua_State *L, Text *text, size_t pos, size_t size){
+	text_reserve(L, text, 0);
+	TextNode *left, *middle, *right;
+	text_split(text, text->root, pos, &left, &right);
+	text_split(text, right, size, &middle, &right);
+	text_release(text, middle);
+	text->root = text_merge(left, right);
+}
+
+// Call fn for each part of a piece in size bytes at byte pos
+typedef void (*TextVisitor)(void *ud, const uint8_t *data, size_t size);
+static void text_each(TextNode *node, size_t pos, size_t size, TextVisitor fn, void *ud){
+	if(node == NULL || size == 0) return;
+	size_t before = node_total(node->left);
+	if(pos < before){
+		size_t n = (size < before - pos) ? size : before - pos;
+		text_each(node->left, pos, n, fn, ud);
+		pos += n;
+		size -= n;
+	}
+	if(size == 0) return;
+	size_t offset = pos - before;
+	if(offset < node->length){
+		size_t n = (size < node->length - offset) ? size : node->length - offset;
+		fn(ud, node->data + offset, n);
+		pos += n;
+		size -= n;
+	}
+	text_each(node->right, pos - before - node->length, size, fn, ud);
+}
+
+static void text_copier(void *ud, const uint8_t *data, size_t size){
+	uint8_t **dst = ud;
+	memcpy(*dst, data, size);
+	*dst += size;
+}
+
+void text_copy(Text *text, size_t pos, size_t size, uint8_t *dst){
+	text_each(text->root, pos, size, text_copier, &dst);
+}
+
+// Count UTF-8 characters, by counting the bytes that do not continue one
+static void text_counter(void *ud, const uint8_t *data, size_t size){
+	size_t *count = ud;
+	for(size_t i = 0; i < size; i++) *count += (data[i] & 0xc0) != 0x80;
+}
+
+// Find the piece at byte pos, and the offset of pos in it
+static TextNode *text_find(TextNode *node, size_t pos, size_t *offset){
+	while(node != NULL){
+		size_t before = node_total(node->left);
+		if(pos < before){
+			node = node->left;
+		}else if(pos < before + node->length){
+			*offset = pos - before;
+			return node;
+		}else{
+			pos -= before + node->length;
+			node = node->right;
+		}
+	}
+	return NULL;
+}
+
+static uint8_t text_byte(Text *text, size_t pos){
+	size_t offset;
+	TextNode *node = text_find(text->root, pos, &offset);
+	return node->data[offset];
+}
+
+// Byte position of the start of a line, or the length of the text plus one if there is none
+static size_t text_linestart(Text *text, size_t line){
+	if(line == 0) return 0;
+	if(line > node_newlines(text->root)) return node_total(text->root) + 1;
+	
+	/* Find the line'th newline */
+	TextNode *node = text->root;
+	size_t pos = 0;
+	while(1){
+		size_t before = node_newlines(node->left);
+		if(line <= before){
+			node = node->left;
+		}else if(line <= before + node->newlines){
+			line -= before;
+			pos += node_total(node->left);
+			const uint8_t *p = node->data;
+			while(1){
+				p = (const uint8_t*)memchr(p, '\n', node->data + node->length - p) + 1;
+				if(--line == 0) return pos + (p - node->data);
+			}
+		}else{
+			line -= before + node->newlines;
+			pos += node_total(node->left) + node->length;
+			node = node->right;
+		}
+	}
+}
+
+// Line number at byte pos
+static size_t text_lineat(Text *text, size_t pos){
+	TextNode *node = text->root;
+	size_t line = 0;
+	while(node != NULL){
+		size_t before = node_total(node->left);
+		if(pos <= before){
+			node = node->left;
+		}else if(pos <= before + node->length){
+			return line + node_newlines(node->left) + text_newlines(node->data, pos - before);
+		}else{
+			pos -= before + node->length;
+			line += node_newlines(node->left) + node->newlines;
+			node = node->right;
+		}
+	}
+	return line;
+}
+
+static Text *text_check(lua_State *L, int idx){
+	return luaL_checkudata(L, idx, "Text");
+}
+
+static size_t text_checkpos(lua_State *L, Text *text, int idx){
+	lua_Integer pos = luaL_checkinteger(L, idx);
+	luaL_argcheck(L, pos >= 0 && (size_t)pos <= node_total(text->root), idx, "position out of bounds");
+	return pos;
+}
+
+// Get the optional position at idx and size at idx+1, clamped to the text
+static size_t text_optrange(lua_State *L, Text *text, int idx, size_t *size){
+	lua_Integer pos = luaL_optinteger(L, idx, 0);
+	size_t total = node_total(text->root);
+	luaL_argcheck(L, pos >= 0 && (size_t)pos <= total, idx, "position out of bounds");
+	lua_Integer n = luaL_optinteger(L, idx + 1, total - pos);
+	luaL_argcheck(L, n >= 0, idx + 1, "size must be >= 0");
+	*size = ((size_t)n < total - pos) ? (size_t)n : total - pos;
+	return pos;
+}
+
+static void text_pushstring(lua_State *L, Text *text, size_t pos, size_t size){
+	luaL_Buffer b;
+	uint8_t *dst = (uint8_t*)luaL_buffinitsize(L, &b, size);
+	text_copy(text, pos, size, dst);
+	luaL_pushresultsize(&b, size);
+}
+
+// Push a Buffer with size bytes at byte pos of the Text at index 1,
+// which is a view when they are in a single piece
+static void text_pushbuffer(lua_State *L, Text *text, size_t pos, size_t size){
+	size_t offset;
+	TextNode *node = text_find(text->root, pos, &offset);
+	if(node != NULL && size <= node->length - offset){
+		Buffer *buffer = lua_newuserdata(L, sizeof(Buffer));
+		buffer->size = size;
+		buffer->buffer = (uint8_t*)node->data + offset;
+		buffer->capacity = size;
+		buffer->kind = BUFFER_VIEW;
+		buffer->owner = NULL;
+		buffer->views = 0;
+		lua_pushvalue(L, 1);
+		lua_setuservalue(L, -2);
+		luaL_setmetatable(L, "Buffer");
+	}else{
+		Buffer *buffer = buffer_newbuffer(L, size);
+		text_copy(text, pos, size, buffer->data);
+	}
+}
+
+/* Lua API definitions */
+
+/***
+ * Create a new `Text`.
+ * Part of the `Buffer` module.
+ * @function Buffer.text
+ * @tparam[opt] Buffer|string data the initial text
+ * @treturn Text
+ */
+int text_text(lua_State *L){
+	size_t size = 0;
+	const uint8_t *data = lua_isnoneornil(L, 1) ? NULL : buffer_checkbytes(L, 1, &size);
+	Text *text = lua_newuserdata(L, sizeof(Text));
+	memset(text, 0, sizeof(Text));
+	text->seed = 2463534242;
+	luaL_setmetatable(L, "Text");
+	if(size > 0) text_put(L, text, 0, data, size);
+	return 1;
+}
+
+/***
+ * Insert bytes.
+ * @function insert
+ * @tparam number pos
+ * @tparam Buffer|string data
+ * @treturn Text self
+ */
+int text_insert(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t pos = text_checkpos(L, text, 2);
+	size_t size;
+	const uint8_t *data = buffer_checkbytes(L, 3, &size);
+	text_put(L, text, pos, data, size);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Remove bytes.
+ * @function remove
+ * @tparam number pos
+ * @tparam number size the number of bytes, up to the end of the text
+ * @treturn Text self
+ */
+int text_remove(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t pos = text_checkpos(L, text, 2);
+	lua_Integer size = luaL_checkinteger(L, 3);
+	luaL_argcheck(L, size >= 0, 3, "size must be >= 0");
+	size_t rest = node_total(text->root) - pos;
+	text_cut(L, text, pos, ((size_t)size < rest) ? (size_t)size : rest);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get bytes as a string.
+ * @function sub
+ * @tparam[opt=0] number pos
+ * @tparam[optchain] number size the number of bytes, up to the end of the text by default
+ * @treturn string
+ */
+int text_sub(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t size;
+	size_t pos = text_optrange(L, text, 2, &size);
+	text_pushstring(L, text, pos, size);
+	return 1;
+}
+
+/***
+ * Get bytes as a `Buffer`.
+ * When the bytes are in a single piece, which is likely for short ranges, the
+ * result is a view of them without copying. Do not write to such a view.
+ * @function slice
+ * @tparam[opt=0] number pos
+ * @tparam[optchain] number size the number of bytes, up to the end of the text by default
+ * @treturn Buffer
+ */
+int text_slice(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t size;
+	size_t pos = text_optrange(L, text, 2, &size);
+	text_pushbuffer(L, text, pos, size);
+	return 1;
+}
+
+// upvalue 1: Text userdata
+// upvalue 2: position
+// upvalue 3: end position
+static int text_pieces_next(lua_State *L){
+	Text *text = lua_touserdata(L, lua_upvalueindex(1));
+	size_t pos = lua_tointeger(L, lua_upvalueindex(2));
+	size_t end = lua_tointeger(L, lua_upvalueindex(3));
+	size_t offset;
+	TextNode *node = (pos < end) ? text_find(text->root, pos, &offset) : NULL;
+	if(node == NULL) return 0;
+	
+	size_t size = (end - pos < node->length - offset) ? end - pos : node->length - offset;
+	lua_pushinteger(L, pos + size);
+	lua_replace(L, lua_upvalueindex(2));
+	lua_settop(L, 0);
+	lua_pushvalue(L, lua_upvalueindex(1));
+	text_pushbuffer(L, text, pos, size);
+	return 1;
+}
+
+/***
+ * Iterate over the pieces of the text, as `Buffer` views without copying.
+ * Do not change the text while iterating, or write to the views.
+ * @function pieces
+ * @tparam[opt=0] number pos
+ * @tparam[optchain] number size the number of bytes, up to the end of the text by default
+ * @treturn function iterator
+ * @usage for piece in text:pieces() do file:write(tostring(piece)) end
+ */
+int text_pieces(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t size;
+	size_t pos = text_optrange(L, text, 2, &size);
+	lua_pushvalue(L, 1);
+	lua_pushinteger(L, pos);
+	lua_pushinteger(L, pos + size);
+	lua_pushcclosure(L, text_pieces_next, 3);
+	return 1;
+}
+
+/***
+ * Get the number of lines, which is the number of newlines plus one.
+ * @function lines
+ * @treturn number
+ */
+int text_lines(lua_State *L){
+	Text *text = text_check(L, 1);
+	lua_pushinteger(L, node_newlines(text->root) + 1);
+	return 1;
+}
+
+/***
+ * Get the position where a line starts.
+ * @function lineStart
+ * @tparam number line
+ * @treturn[1] number
+ * @treturn[2] nil if there is no such line
+ */
+int text_lineStart(lua_State *L){
+	Text *text = text_check(L, 1);
+	lua_Integer line = luaL_checkinteger(L, 2);
+	size_t pos = (line >= 0) ? text_linestart(text, line) : node_total(text->root) + 1;
+	if(pos > node_total(text->root)){
+		lua_pushnil(L);
+	}else{
+		lua_pushinteger(L, pos);
+	}
+	return 1;
+}
+
+/***
+ * Get the line at a position.
+ * @function lineAt
+ * @tparam number pos
+ * @treturn number
+ */
+int text_lineAt(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t pos = text_checkpos(L, text, 2);
+	lua_pushinteger(L, text_lineat(text, pos));
+	return 1;
+}
+
+/***
+ * Get a line, without its newline.
+ * @function line
+ * @tparam number line
+ * @treturn[1] string
+ * @treturn[2] nil if there is no such line
+ */
+int text_line(lua_State *L){
+	Text *text = text_check(L, 1);
+	lua_Integer line = luaL_checkinteger(L, 2);
+	size_t total = node_total(text->root);
+	size_t start = (line >= 0) ? text_linestart(text, line) : total + 1;
+	if(start > total){
+		lua_pushnil(L);
+		return 1;
+	}
+	size_t end = text_linestart(text, line + 1);
+	end = (end > total) ? total : end - 1;
+	text_pushstring(L, text, start, end - start);
+	return 1;
+}
+
+/***
+ * Move a position by a number of UTF-8 characters.
+ * Stops at the start and end of the text.
+ * @function move
+ * @tparam number pos
+ * @tparam number n characters to move forward, or backward when negative
+ * @treturn number the new position
+ */
+int text_move(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t pos = text_checkpos(L, text, 2);
+	lua_Integer n = luaL_checkinteger(L, 3);
+	size_t total = node_total(text->root);
+	for(; n > 0 && pos < total; n--){
+		do pos++; while(pos < total && (text_byte(text, pos) & 0xc0) == 0x80);
+	}
+	for(; n < 0 && pos > 0; n++){
+		do pos--; while(pos > 0 && (text_byte(text, pos) & 0xc0) == 0x80);
+	}
+	lua_pushinteger(L, pos);
+	return 1;
+}
+
+/***
+ * Get the column of a position, in UTF-8 characters from the start of its line.
+ * @function column
+ * @tparam number pos
+ * @treturn number the column, starting at 0
+ */
+int text_column(lua_State *L){
+	Text *text = text_check(L, 1);
+	size_t pos = text_checkpos(L, text, 2);
+	size_t start = text_linestart(text, text_lineat(text, pos));
+	size_t count = 0;
+	text_each(text->root, start, pos - start, text_counter, &count);
+	lua_pushinteger(L, count);
+	return 1;
+}
+
+/* Lua metamethods */
+
+/***
+ * __len metamethod, returns the number of bytes.
+ * @function __len
+ * @treturn number
+ */
+int text__length(lua_State *L){
+	Text *text = text_check(L, 1);
+	lua_pushinteger(L, node_total(text->root));
+	return 1;
+}
+
+/***
+ * __tostring metamethod, returns the text as a string.
+ * @function __tostring
+ * @treturn string
+ */
+int text__tostring(lua_State *L){
+	Text *text = text_check(L, 1);
+	text_pushstring(L, text, 0, node_total(text->root));
+	return 1;
+}
+
+/***
+ * __gc metamethod, frees the pieces.
+ * @function __gc
+ */
+int text__gc(lua_State *L){
+	Text *text = text_check(L, 1);
+	TextBlock *lists[] = {text->blocks, text->spare};
+	for(int i = 0; i < 2; i++){
+		for(TextBlock *block = lists[i], *next; block != NULL; block = next){
+			next = block->next;
+			free(block);
+		}
+	}
+	for(TextSlab *slab = text->slabs, *next; slab != NULL; slab = next){
+		next = slab->next;
+		free(slab);
+	}
+	memset(text, 0, sizeof(Text));
+	return 0;
+}
+
+static const struct luaL_Reg text_f[] = {
+	{"insert", text_insert},
+	{"remove", text_remove},
+	{"sub", text_sub},
+	{"slice", text_slice},
+	{"pieces", text_pieces},
+	{"lines", text_lines},
+	{"lineStart", text_lineStart},
+	{"lineAt", text_lineAt},
+	{"line", text_line},
+	{"move", text_move},
+	{"column", text_column},
+	{"length", text__length},
+	{NULL, NULL}
+};
+
+void text_register(lua_State *L){
+	if(luaL_newmetatable(L, "Text")){ // stack: {metatable, ...}
+		lua_newtable(L); // stack: {methods, metatable, ...}
+		luaL_setfuncs(L, text_f, 0);
+		lua_setfield(L, -2, "__index");
+		lua_pushcfunction(L, text__length);
+		lua_setfield(L, -2, "__len");
+		lua_pushcfunction(L, text__tostring);
+		lua_setfield(L, -2, "__tostring");
+		lua_pushcfunction(L, text__gc);
+		lua_setfield(L, -2, "__gc");
+	}
+	lua_pop(L, 1); // stack: {...}
+}
@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stddef.h> // for size_t
+#include <stdint.h> // for uint8_t etc
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+// Bytes are stored in blocks which are never moved or changed once written,
+// so pieces (and Buffer views of them) stay valid until the Text is collected
+#define TEXT_BLOCK_SIZE (64 * 1024)
+// Longer pieces are split, which bounds the bytes scanned for newlines per step
+#define TEXT_PIECE_SIZE 4096
+#define TEXT_SLAB_NODES 256
+
+typedef struct TextNode TextNode; // forward-declare
+
+// A piece of the text, in a treap ordered by position
+typedef struct TextNode {
+	TextNode *left;
+	TextNode *right;        // also links the free nodes
+	const uint8_t *data;
+	size_t length;          // bytes in this piece
+	size_t newlines;        // newlines in this piece
+	size_t total;           // bytes in this subtree
+	size_t totalNewlines;   // newlines in this subtree
+	uint32_t priority;      // larger than the priorities of the children
+} TextNode;
+
+typedef struct TextBlock TextBlock; // forward-declare
+
+typedef struct TextBlock {
+	TextBlock *next;
+	size_t used;
+	uint8_t data[TEXT_BLOCK_SIZE];
+} TextBlock;
+
+typedef struct TextSlab TextSlab; // forward-declare
+
+typedef struct TextSlab {
+	TextSlab *next;
+	TextNode nodes[TEXT_SLAB_NODES];
+} TextSlab;
+
+typedef struct Text {
+	TextNode *root;
+	TextBlock *blocks; // the block being written first
+	TextBlock *spare;  // blocks reserved for the next insert
+	TextSlab *slabs;
+	TextNode *free;
+	size_t nfree;
+	uint32_t seed;
+} Text;
+
+// Insert size bytes at byte pos, or throw an error without changing the text
+void text_put(lua_State *L, Text *text, size_t pos, const uint8_t *data, size_t size);
+
+// Remove up to size bytes at byte pos
+void text_cut(lua_State *L, Text *text, size_t pos, size_t size);
+
+// Copy size bytes at byte pos, which must be inside the text
+void text_copy(Text *text, size_t pos, size_t size, uint8_t *dst);
+
+// Create the Text metatable
+void text_register(lua_State *L);
+
+/* Lua API definitions */
+
+int text_text(lua_State *L);
+
+int text_insert(lua_State *L);
+int text_remove(lua_State *L);
+int text_sub(lua_State *L);
+int text_slice(lua_State *L);
+int text_pieces(lua_State *L);
+int text_lines(lua_State *L);
+int text_lineStart(lua_State *L);
+int text_lineAt(lua_State *L);
+int text_line(lua_State *L);
+int text_move(lua_State *L);
+int text_column(lua_State *L);
+
+/* Lua metamethods */
+
+int text__length(lua_State *L);
+int text__tostring(lua_State *L);
+int text__gc(lua_State *L);
@@ -2,6 +2,7 @@
 
 #if defined(_WIN32) || defined(__WIN32__)
 	#include <windows.h>
+	#include <errno.h>
 	#define THREAD HANDLE
 	#define MUTEX CRITICAL_SECTION // Use more lightweight critical section as mutex
 	#define CONDITION CONDITION_VARIABLE
@@ -20,9 +21,28 @@
 	#define create_cond(c) InitializeConditionVariable(&(c))
 	#define destroy_cond(c) (void)(c)
 	#define wait_cond(c, m) SleepConditionVariableCS(&(c), &(m), INFINITE)
+	#define wait_cond_ms(c, m, ms) SleepConditionVariableCS(&(c), &(m), (ms))
 	#define signal_cond(c) WakeConditionVariable(&(c))
+	
+	// These return 0 on success, or an error number
+	#define THREAD_ID DWORD
+	#define CPUSET DWORD_PTR
+	#define self_thread_id() GetCurrentThreadId()
+	#define cpuset_clear(s) ((s) = 0)
+	#define cpuset_add(s, cpu) ((s) |= (DWORD_PTR)1 << (cpu))
+	#define cpuset_has(s, cpu) (((s) >> (cpu)) & 1)
+	#define set_thread_affinity(thread, s) (SetThreadAffinityMask((thread), (s)) ? 0 : EINVAL)
+	#define get_thread_affinity(thread, s) ENOSYS
+	#define set_thread_name(thread, name) ENOSYS
+	#define set_thread_nice(thread, id, nice) (SetThreadPriority((thread), \
+		(nice) < -10 ? THREAD_PRIORITY_HIGHEST : \
+		(nice) < 0 ? THREAD_PRIORITY_ABOVE_NORMAL : \
+		(nice) == 0 ? THREAD_PRIORITY_NORMAL : \
+		(nice) <= 10 ? THREAD_PRIORITY_BELOW_NORMAL : THREAD_PRIORITY_LOWEST) ? 0 : EINVAL)
+	#define set_thread_policy(thread, policy, priority) ENOSYS
 #else
 	#include <pthread.h>
+	#include <time.h> // for clock_gettime in wait_cond_ms
 	#define THREAD pthread_t
 	#define MUTEX pthread_mutex_t
 	#define CONDITION pthread_cond_t
@@ -41,5 +61,49 @@
 	#define create_cond(c) pthread_cond_init(&(c), NULL)
 	#define destroy_cond(c) pthread_cond_destroy(&(c))
 	#define wait_cond(c, m) pthread_cond_wait(&(c), &(m))
+	#define wait_cond_ms(c, m, ms) do { \
+			struct timespec ts_; \
+			clock_gettime(CLOCK_REALTIME, &ts_); \
+			ts_.tv_nsec += (long)((ms) % 1000) * 1000000; \
+			ts_.tv_sec += (ms) / 1000 + ts_.tv_nsec / 1000000000; \
+			ts_.tv_nsec %= 1000000000; \
+			pthread_cond_timedwait(&(c), &(m), &ts_); \
+		} while(0)
 	#define signal_cond(c) pthread_cond_signal(&(c))
+	
+	#if defined(__linux__)
+		// Needs _GNU_SOURCE to be defined before including any header
+		#include <sched.h> // for cpu_set_t
+		#include <unistd.h> // for syscall
+		#include <sys/syscall.h> // for SYS_gettid
+		#include <sys/resource.h> // for setpriority
+		#include <errno.h>
+		
+		// These return 0 on success, or an error number
+		#define THREAD_ID pid_t
+		#define CPUSET cpu_set_t
+		#define self_thread_id() ((pid_t)syscall(SYS_gettid))
+		#define cpuset_clear(s) CPU_ZERO(&(s))
+		#define cpuset_add(s, cpu) CPU_SET((cpu), &(s))
+		#define cpuset_has(s, cpu) CPU_ISSET((cpu), &(s))
+		#define set_thread_affinity(thread, s) pthread_setaffinity_np((thread), sizeof(s), &(s))
+		#define get_thread_affinity(thread, s) pthread_getaffinity_np((thread), sizeof(s), &(s))
+		#define set_thread_name(thread, name) pthread_setname_np((thread), (name))
+		#define set_thread_nice(thread, id, nice) (setpriority(PRIO_PROCESS, (id), (nice)) == 0 ? 0 : errno)
+		#define set_thread_policy(thread, policy, priority) \
+			pthread_setschedparam((thread), (policy), &(struct sched_param){.sched_priority = (priority)})
+	#else
+		#include <errno.h>
+		#define THREAD_ID int
+		#define CPUSET unsigned long
+		#define self_thread_id() 1 // never 0, which means "not started"
+		#define cpuset_clear(s) ((s) = 0)
+		#define cpuset_add(s, cpu) ((s) |= 1UL << (cpu))
+		#define cpuset_has(s, cpu) (((s) >> (cpu)) & 1)
+		#define set_thread_affinity(thread, s) ENOSYS
+		#define get_thread_affinity(thread, s) ENOSYS
+		#define set_thread_name(thread, name) ENOSYS
+		#define set_thread_nice(thread, id, nice) ENOSYS
+		#define set_thread_policy(thread, policy, priority) ENOSYS
+	#endif
 #endif
@@ -0,0 +1,549 @@
+/***
+ * Element-wise operations and reductions on a `TypedArray`.
+ * 
+ * The element-wise operations change the array in place and return it, so
+ * they can be chained without creating new arrays. The other operand is either
+ * a number or another `TypedArray` with the same type and length. Integer
+ * arithmetic wraps around like in C.
+ * 
+ * Large arrays can be split across multiple threads, see `Buffer.setThreads`.
+ * 
+ * @submodule TypedArray
+ * @usage
+ * local signal = Buffer.array("float32", {0.5, -2, 1.5})
+ * signal:scale(2, 1):clamp(-1, 1)
+ * print(signal:sum(), signal:max()) --> 1.0	1.0
+ */
+
+#define _GNU_SOURCE // for threads.h
+
+#include <string.h> // for memcpy
+#include <stdint.h> // for UINT64_MAX
+
+#include <lua.h>
+#include <lualib.h>
+#include <lauxlib.h>
+
+#include "TypedArray.h"
+#include "vecmath.h"
+#include "threads.h"
+
+/* C library definitions */
+
+typedef enum VecOp {
+	VECMATH_ADD,
+	VECMATH_SUB,
+	VECMATH_MUL,
+	VECMATH_SCALE,
+	VECMATH_CLAMP,
+	VECMATH_SUM,
+	VECMATH_MIN,
+	VECMATH_MAX,
+	VECMATH_DOT,
+} VecOp;
+
+typedef union VecValue {
+	int64_t i;
+	uint64_t u;
+	double n;
+} VecValue;
+
+// One part of an operation, which runs on a single thread
+typedef struct VecTask {
+	VecOp op;
+	TypedArrayType type;
+	uint8_t *a;       // first element of the array
+	const uint8_t *b; // first element of the other array, or NULL for a number
+	size_t sa, sb;    // strides of both arrays
+	size_t n;         // number of elements
+	int integer;      // whether the numbers for scale are integers
+	VecValue x, y;    // number operands
+	VecValue result;  // result of a reduction
+} VecTask;
+
+static int n_threads = 1;
+
+static lua_Integer vecmath_tointeger(double value){
+	lua_Integer integer;
+	if(!lua_numbertointeger(value, &integer)) integer = 0;
+	return integer;
+}
+
+// Whether the integer type T is signed, without comparing unsigned values to 0
+#define VECMATH_SIGNED(T) ((T)-1 < (T)1)
+
+// Limit an integer to the range of an integer type of size bytes
+static int64_t vecmath_saturate(int64_t x, size_t size, int isSigned){
+	if(isSigned){
+		int64_t max = (int64_t)(UINT64_MAX >> (65 - size*8));
+		return (x > max) ? max : (x < -max - 1) ? -max - 1 : x;
+	}
+	if(x < 0) return 0;
+	if(size < sizeof(uint64_t) && x > (int64_t)(UINT64_MAX >> (64 - size*8))){
+		return (int64_t)(UINT64_MAX >> (64 - size*8));
+	}
+	return x;
+}
+
+// Replace every element v of the array by expr
+// Elements are copied with memcpy because they need not be aligned
+#define VECMATH_MAP(T, expr) \
+	for(size_t i = 0; i < n; i++){ \
+		T v; \
+		memcpy(&v, a + i*sa, sizeof(T)); \
+		v = (expr); \
+		memcpy(a + i*sa, &v, sizeof(T)); \
+	}
+
+// Replace every element v of the array by expr, with w the element of the other array
+#define VECMATH_ZIP(T, expr) \
+	for(size_t i = 0; i < n; i++){ \
+		T v, w; \
+		memcpy(&v, a + i*sa, sizeof(T)); \
+		memcpy(&w, b + i*sb, sizeof(T)); \
+		v = (expr); \
+		memcpy(a + i*sa, &v, sizeof(T)); \
+	}
+
+// Run stmt for every element v, and w of the other array when there is one
+#define VECMATH_FOLD(T, stmt) \
+	for(size_t i = 0; i < n; i++){ \
+		T v; \
+		memcpy(&v, a + i*sa, sizeof(T)); \
+		stmt; \
+	}
+#define VECMATH_FOLD2(T, stmt) \
+	for(size_t i = 0; i < n; i++){ \
+		T v, w; \
+		memcpy(&v, a + i*sa, sizeof(T)); \
+		memcpy(&w, b + i*sb, sizeof(T)); \
+		stmt; \
+	}
+
+// The kernels are always inlined into a version for contiguous arrays, where
+// the strides are constants and the compiler can vectorise the loops
+#define VECMATH_KERNEL(name, T) \
+	static void run_##name(VecTask *t){ \
+		if(t->sa == sizeof(T) && (t->b == NULL || t->sb == sizeof(T))){ \
+			body_##name(t, sizeof(T), sizeof(T)); \
+		}else{ \
+			body_##name(t, t->sa, t->sb); \
+		} \
+	}
+
+// Kernel for an integer type T, which does arithmetic in the unsigned type U
+// so that it wraps around
+#define VECMATH_INT(name, T, U) \
+	static inline __attribute__((always_inline)) void body_##name(VecTask *t, size_t sa, size_t sb){ \
+		uint8_t *a = t->a; \
+		const uint8_t *b = t->b; \
+		size_t n = t->n; \
+		U x = (U)t->x.u, y = (U)t->y.u; \
+		switch(t->op){ \
+			case VECMATH_ADD: \
+				if(b){ VECMATH_ZIP(T, (U)v + (U)w) }else{ VECMATH_MAP(T, (U)v + x) } \
+				break; \
+			case VECMATH_SUB: \
+				if(b){ VECMATH_ZIP(T, (U)v - (U)w) }else{ VECMATH_MAP(T, (U)v - x) } \
+				break; \
+			case VECMATH_MUL: \
+				if(b){ VECMATH_ZIP(T, (U)v * (U)w) }else{ VECMATH_MAP(T, (U)v * x) } \
+				break; \
+			case VECMATH_SCALE: \
+				if(t->integer){ \
+					VECMATH_MAP(T, (U)v * x + y) \
+				}else{ \
+					VECMATH_MAP(T, vecmath_tointeger(v * t->x.n + t->y.n)) \
+				} \
+				break; \
+			case VECMATH_CLAMP: { \
+				T lo = (T)vecmath_saturate(t->x.i, sizeof(T), VECMATH_SIGNED(T)); \
+				T hi = (T)vecmath_saturate(t->y.i, sizeof(T), VECMATH_SIGNED(T)); \
+				VECMATH_MAP(T, (v < lo) ? lo : (v > hi) ? hi : v) \
+				break; \
+			} \
+			case VECMATH_SUM: { \
+				uint64_t sum = 0; \
+				VECMATH_FOLD(T, sum += (uint64_t)(int64_t)v) \
+				t->result.u = sum; \
+				break; \
+			} \
+			case VECMATH_DOT: { \
+				uint64_t sum = 0; \
+				VECMATH_FOLD2(T, sum += (uint64_t)(int64_t)v * (uint64_t)(int64_t)w) \
+				t->result.u = sum; \
+				break; \
+			} \
+			case VECMATH_MIN: { \
+				T m; \
+				memcpy(&m, a, sizeof(T)); \
+				VECMATH_FOLD(T, m = (v < m) ? v : m) \
+				t->result.i = (int64_t)m; \
+				break; \
+			} \
+			case VECMATH_MAX: { \
+				T m; \
+				memcpy(&m, a, sizeof(T)); \
+				VECMATH_FOLD(T, m = (v > m) ? v : m) \
+				t->result.i = (int64_t)m; \
+				break; \
+			} \
+		} \
+	} \
+	VECMATH_KERNEL(name, T)
+
+// Kernel for a floating point type T
+#define VECMATH_FLOAT(name, T) \
+	static inline __attribute__((always_inline)) void body_##name(VecTask *t, size_t sa, size_t sb){ \
+		uint8_t *a = t->a; \
+		const uint8_t *b = t->b; \
+		size_t n = t->n; \
+		T x = (T)t->x.n; \
+		switch(t->op){ \
+			case VECMATH_ADD: \
+				if(b){ VECMATH_ZIP(T, v + w) }else{ VECMATH_MAP(T, v + x) } \
+				break; \
+			case VECMATH_SUB: \
+				if(b){ VECMATH_ZIP(T, v - w) }else{ VECMATH_MAP(T, v - x) } \
+				break; \
+			case VECMATH_MUL: \
+				if(b){ VECMATH_ZIP(T, v * w) }else{ VECMATH_MAP(T, v * x) } \
+				break; \
+			case VECMATH_SCALE: \
+				VECMATH_MAP(T, v * t->x.n + t->y.n) \
+				break; \
+			case VECMATH_CLAMP: { \
+				T lo = (T)t->x.n, hi = (T)t->y.n; \
+				VECMATH_MAP(T, (v < lo) ? lo : (v > hi) ? hi : v) \
+				break; \
+			} \
+			case VECMATH_SUM: { \
+				double sum = 0; \
+				VECMATH_FOLD(T, sum += v) \
+				t->result.n = sum; \
+				break; \
+			} \
+			case VECMATH_DOT: { \
+				double sum = 0; \
+				VECMATH_FOLD2(T, sum += (double)v * w) \
+				t->result.n = sum; \
+				break; \
+			} \
+			case VECMATH_MIN: { \
+				T m; \
+				memcpy(&m, a, sizeof(T)); \
+				VECMATH_FOLD(T, m = (v < m) ? v : m) \
+				t->result.n = m; \
+				break; \
+			} \
+			case VECMATH_MAX: { \
+				T m; \
+				memcpy(&m, a, sizeof(T)); \
+				VECMATH_FOLD(T, m = (v > m) ? v : m) \
+				t->result.n = m; \
+				break; \
+			} \
+		} \
+	} \
+	VECMATH_KERNEL(name, T)
+
+VECMATH_INT(int8, int8_t, uint8_t)
+VECMATH_INT(uint8, uint8_t, uint8_t)
+VECMATH_INT(int16, int16_t, uint16_t)
+VECMATH_INT(uint16, uint16_t, uint16_t)
+VECMATH_INT(int32, int32_t, uint32_t)
+VECMATH_INT(uint32, uint32_t, uint32_t)
+VECMATH_INT(int64, int64_t, uint64_t)
+VECMATH_INT(uint64, uint64_t, uint64_t)
+VECMATH_FLOAT(float32, float)
+VECMATH_FLOAT(float64, double)
+
+// In the order of TypedArrayType
+static void (*const kernels[])(VecTask*) = {
+	run_int8, run_uint8, run_int16, run_uint16, run_int32, run_uint32,
+	run_int64, run_uint64, run_float32, run_float64,
+};
+
+// Combine the result of a part into the result of the whole task
+static void combine(VecTask *task, VecValue *part){
+	VecValue *r = &task->result;
+	int isfloat = typedarray_isfloat(task->type);
+	int issigned = (task->type % 2 == 0); // int8, int16, int32 and int64
+	switch(task->op){
+		case VECMATH_SUM:
+		case VECMATH_DOT:
+			if(isfloat) r->n += part->n;
+			else r->u += part->u;
+			break;
+		case VECMATH_MIN:
+			if(isfloat ? part->n < r->n : issigned ? part->i < r->i : part->u < r->u) *r = *part;
+			break;
+		case VECMATH_MAX:
+			if(isfloat ? part->n > r->n : issigned ? part->i > r->i : part->u > r->u) *r = *part;
+			break;
+		default:
+			break;
+	}
+}
+
+// Gets called in the new thread
+#if defined(_WIN32) || defined(__WIN32__)
+static DWORD WINAPI run_thread(LPVOID data){
+#else
+static void *run_thread(void *data){
+#endif
+	VecTask *t = (VecTask*)data;
+	kernels[t->type](t);
+	return 0;
+}
+
+// Run a task, split into parts on multiple threads when the array is large
+static void run(VecTask *task){
+	size_t max = task->n / VECMATH_MIN_PER_THREAD;
+	size_t threads = __atomic_load_n(&n_threads, __ATOMIC_RELAXED);
+	size_t n_parts = (max < threads) ? max : threads;
+	if(n_parts <= 1){
+		kernels[task->type](task);
+		return;
+	}
+	
+	VecTask parts[n_parts];
+	THREAD handles[n_parts];
+	size_t size = task->n / n_parts;
+	for(size_t i = 0; i < n_parts; i++){
+		parts[i] = *task;
+		parts[i].a = task->a + i*size*task->sa;
+		if(task->b) parts[i].b = task->b + i*size*task->sb;
+		parts[i].n = (i == n_parts-1) ? task->n - i*size : size;
+		if(i > 0) create_thread(handles[i], run_thread, &parts[i]);
+	}
+	
+	/* Run the first part on this thread */
+	kernels[task->type](&parts[0]);
+	task->result = parts[0].result;
+	for(size_t i = 1; i < n_parts; i++){
+		join_thread(handles[i]);
+		combine(task, &parts[i].result);
+	}
+}
+
+// Set up a task for the TypedArray at index 1
+static TypedArray *init_task(lua_State *L, VecTask *t, VecOp op){
+	TypedArray *array = typedarray_check(L, 1);
+	memset(t, 0, sizeof(VecTask));
+	t->op = op;
+	t->type = array->type;
+	t->a = array->data;
+	t->sa = array->stride;
+	t->n = array->length;
+	return array;
+}
+
+// Use the TypedArray at idx as the other operand
+static void check_other(lua_State *L, VecTask *t, TypedArray *array, int idx){
+	TypedArray *other = typedarray_check(L, idx);
+	luaL_argcheck(L, other->type == array->type, idx, "arrays must have the same type");
+	luaL_argcheck(L, other->length == array->length, idx, "arrays must have the same length");
+	t->b = other->data;
+	t->sb = other->stride;
+}
+
+// Push the result of a sum or dot product
+static void push_sum(lua_State *L, VecTask *t){
+	if(typedarray_isfloat(t->type)){
+		lua_pushnumber(L, t->result.n);
+	}else{
+		lua_pushinteger(L, (lua_Integer)t->result.u);
+	}
+}
+
+static int elementwise(lua_State *L, VecOp op){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, op);
+	if(lua_type(L, 2) == LUA_TNUMBER){
+		if(typedarray_isfloat(array->type)) t.x.n = luaL_checknumber(L, 2);
+		else t.x.i = luaL_checkinteger(L, 2);
+	}else{
+		check_other(L, &t, array, 2);
+	}
+	run(&t);
+	lua_settop(L, 1);
+	return 1;
+}
+
+static int minmax(lua_State *L, VecOp op){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, op);
+	if(array->length == 0) return 0;
+	run(&t);
+	if(typedarray_isfloat(array->type)){
+		lua_pushnumber(L, t.result.n);
+	}else{
+		lua_pushinteger(L, (lua_Integer)t.result.i);
+	}
+	return 1;
+}
+
+/* Lua API definitions */
+
+/***
+ * Set the maximum number of threads used by the operations on large arrays.
+ * Arrays are only split when every thread gets at least 65536 elements.
+ * This setting is shared by all threads. Part of the `Buffer` module.
+ * @function Buffer.setThreads
+ * @tparam number n 1 to never split arrays, which is the default
+ */
+int vecmath_setThreads(lua_State *L){
+	lua_Integer n = luaL_checkinteger(L, 1);
+	luaL_argcheck(L, n >= 1 && n <= 256, 1, "must be between 1 and 256");
+	__atomic_store_n(&n_threads, (int)n, __ATOMIC_RELAXED);
+	return 0;
+}
+
+/***
+ * Add a number or another array to every element.
+ * @function add
+ * @tparam number|TypedArray other
+ * @treturn TypedArray self
+ */
+int vecmath_add(lua_State *L){
+	return elementwise(L, VECMATH_ADD);
+}
+
+/***
+ * Subtract a number or another array from every element.
+ * @function sub
+ * @tparam number|TypedArray other
+ * @treturn TypedArray self
+ */
+int vecmath_sub(lua_State *L){
+	return elementwise(L, VECMATH_SUB);
+}
+
+/***
+ * Multiply every element by a number or the element of another array.
+ * @function mul
+ * @tparam number|TypedArray other
+ * @treturn TypedArray self
+ */
+int vecmath_mul(lua_State *L){
+	return elementwise(L, VECMATH_MUL);
+}
+
+/***
+ * Multiply every element by a factor and add an offset.
+ * For integer arrays with a non-integer factor or offset, the result is
+ * rounded towards 0 (and becomes 0 when it does not fit).
+ * @function scale
+ * @tparam number factor
+ * @tparam[opt=0] number offset
+ * @treturn TypedArray self
+ */
+int vecmath_scale(lua_State *L){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, VECMATH_SCALE);
+	if(!typedarray_isfloat(array->type) && lua_isinteger(L, 2)
+			&& (lua_isnoneornil(L, 3) || lua_isinteger(L, 3))){
+		t.integer = 1;
+		t.x.i = lua_tointeger(L, 2);
+		t.y.i = luaL_optinteger(L, 3, 0);
+	}else{
+		t.x.n = luaL_checknumber(L, 2);
+		t.y.n = luaL_optnumber(L, 3, 0);
+	}
+	run(&t);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Limit every element to a range.
+ * For integer arrays, bounds outside the range of the type are limited to it.
+ * @function clamp
+ * @tparam number min
+ * @tparam number max
+ * @treturn TypedArray self
+ */
+int vecmath_clamp(lua_State *L){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, VECMATH_CLAMP);
+	if(typedarray_isfloat(array->type)){
+		t.x.n = luaL_checknumber(L, 2);
+		t.y.n = luaL_checknumber(L, 3);
+	}else{
+		t.x.i = luaL_checkinteger(L, 2);
+		t.y.i = luaL_checkinteger(L, 3);
+	}
+	luaL_argcheck(L, lua_compare(L, 2, 3, LUA_OPLE), 3, "max must be >= min");
+	run(&t);
+	lua_settop(L, 1);
+	return 1;
+}
+
+/***
+ * Get the sum of all elements.
+ * For integer arrays, the sum wraps around at 64 bits.
+ * @function sum
+ * @treturn number
+ */
+int vecmath_sum(lua_State *L){
+	VecTask t;
+	init_task(L, &t, VECMATH_SUM);
+	run(&t);
+	push_sum(L, &t);
+	return 1;
+}
+
+/***
+ * Get the smallest element.
+ * @function min
+ * @treturn[1] number
+ * @treturn[2] nil when the array is empty
+ */
+int vecmath_min(lua_State *L){
+	return minmax(L, VECMATH_MIN);
+}
+
+/***
+ * Get the largest element.
+ * @function max
+ * @treturn[1] number
+ * @treturn[2] nil when the array is empty
+ */
+int vecmath_max(lua_State *L){
+	return minmax(L, VECMATH_MAX);
+}
+
+/***
+ * Get the dot product with another array, the sum of the products of the elements.
+ * @function dot
+ * @tparam TypedArray other
+ * @treturn number
+ */
+int vecmath_dot(lua_State *L){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, VECMATH_DOT);
+	check_other(L, &t, array, 2);
+	run(&t);
+	push_sum(L, &t);
+	return 1;
+}
+
+/***
+ * Get the average of all elements.
+ * @function mean
+ * @treturn[1] number
+ * @treturn[2] nil when the array is empty
+ */
+int vecmath_mean(lua_State *L){
+	VecTask t;
+	TypedArray *array = init_task(L, &t, VECMATH_SUM);
+	if(array->length == 0) return 0;
+	run(&t);
+	double sum;
+	if(typedarray_isfloat(array->type)) sum = t.result.n;
+	else if(array->type % 2 == 0) sum = (double)t.result.i;
+	else sum = (double)t.result.u;
+	lua_pushnumber(L, sum / array->length);
+	return 1;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <lua.h>
+#include <lauxlib.h>
+
+/* C library definitions */
+
+// Arrays with fewer elements per thread than this are not split across threads
+#define VECMATH_MIN_PER_THREAD 65536
+
+/* Lua API definitions */
+
+int vecmath_setThreads(lua_State *L);
+
+int vecmath_add(lua_State *L);
+int vecmath_sub(lua_State *L);
+int vecmath_mul(lua_State *L);
+int vecmath_scale(lua_State *L);
+int vecmath_clamp(lua_State *L);
+
+int vecmath_sum(lua_State *L);
+int vecmath_min(lua_State *L);
+int vecmath_max(lua_State *L);
+int vecmath_dot(lua_State *L);
+int vecmath_mean(lua_State *L);
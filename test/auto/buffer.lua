@@ -18,3 +18,296 @@ assert(fortytwo:get() == 42)
 assert(fortytwo + 1 == Value.of(43))
 assert(fortytwo == Value.of('*'))
 assert(tostring(fortytwo) == '*')
+
+local shared = Buffer.new(16)
+shared:atomicStore(0, 10)
+assert(shared:atomicAdd(0, 5) == 10)
+assert(shared:atomicLoad(0) == 15)
+assert(shared:atomicExchange(0, 1) == 15)
+assert(shared:atomicCas(0, 1, 2))
+assert(not shared:atomicCas(0, 1, 3))
+shared:atomicStore(8, 1 << 40, 8)
+assert(shared:atomicLoad(8, 8) == 1 << 40)
+assert(shared:wait(0, 42) == "not-equal")
+assert(shared:wait(0, 2, 0.001) == "timed-out")
+assert(not pcall(shared.atomicLoad, shared, 1))
+
+local typed = Buffer.new(16)
+typed:writeUint32(0, 0x01020304)
+assert(typed:readUint8(0) == 1)
+assert(typed:readUint32(0) == 0x01020304)
+assert(typed:readUint32(0, true) == 0x04030201)
+typed:writeInt16(4, -2, true)
+assert(typed:readInt16(4, true) == -2)
+assert(typed:readUint16(4, true) == 0xfffe)
+typed:writeFloat64(8, 1.5)
+assert(typed:readFloat64(8) == 1.5)
+typed:writeFloat32(0, -0.25, true)
+assert(typed:readFloat32(0, true) == -0.25)
+assert(not pcall(typed.readUint32, typed, 13))
+
+local floats = Buffer.array("float64", {1.5, 2.5, 3.5, 4.5})
+assert(#floats == 4)
+assert(floats[0] == 1.5 and floats[4] == nil and floats[0.5] == nil)
+floats[1] = 10
+assert(floats:totable()[2] == 10)
+local odd = floats:slice(1, nil, 2)
+assert(#odd == 2 and odd[1] == 4.5)
+local bytes = floats:buffer():as("uint8")
+assert(#bytes == 32)
+local ints = Buffer.new(8):as("int16")
+ints:set({-1, 2, 3}, 1)
+assert(ints[1] == -1 and ints[3] == 3)
+assert(ints:buffer():as("uint16")[1] == 0xffff)
+assert(not pcall(function() ints[0] = 1.5 end))
+
+local block = Buffer.new(100)
+block:fill(0xaa)
+assert(block:popcount() == 400)
+block:fill(0, 10, 80)
+assert(block:readUint8(9) == 0xaa and block:readUint8(10) == 0 and block:readUint8(90) == 0xaa)
+block:copyFrom("needle", 50)
+assert(block:find("needle") == 50 and block:find(0x6e) == 50)
+assert(block:find("needle", 51) == nil)
+local copy = Buffer.new(100):copyFrom(block)
+assert(copy:compare(block) == 0)
+copy:writeUint8(70, 1)
+local order, at = copy:compare(block)
+assert(order == 1 and at == 70)
+assert(block:compare(tostring(block):sub(1, 50)) == 1)
+copy:xor(block)
+assert(copy:popcount() == 1 and copy:readUint8(70) == 1)
+assert(not pcall(block.copyFrom, block, "xy", 99))
+
+local signal = Buffer.array("float64", {0.5, -2, 1.5, 0})
+signal:scale(2, 1):clamp(-1, 1)
+assert(signal[0] == 1 and signal[1] == -1 and signal[3] == 1)
+assert(signal:sum() == 2 and signal:mean() == 0.5)
+assert(signal:min() == -1 and signal:max() == 1)
+local counts = Buffer.array("int8", {127, 1, -3})
+counts:add(1)
+assert(counts[0] == -128 and counts:min() == -128 and counts:max() == 2)
+counts:mul(Buffer.array("int8", {1, 2, 3}))
+assert(counts:dot(Buffer.array("int8", {1, 1, 1})) == -128 + 4 - 6)
+assert(Buffer.array("uint16", 0):max() == nil)
+assert(not pcall(counts.add, counts, 0.5))
+assert(not pcall(counts.add, counts, Buffer.array("int16", 3)))
+Buffer.setThreads(4)
+local big = Buffer.array("int32", 1 << 18):add(3)
+assert(big:sum() == 3 << 18 and big:max() == 3)
+Buffer.setThreads(1)
+
+local out = Buffer.builder()
+assert(#out == 0)
+out:append("MBOX"):append(0x0102, 2):append(0x0304, 2, true)
+assert(#out == 8 and out:readUint16(4) == 0x0102 and out:readUint16(6, true) == 0x0304)
+for _ = 1, 5 do out:append(out) end
+assert(#out == 8 * 32 and tostring(out):sub(9, 12) == "MBOX")
+out:truncate(4)
+assert(tostring(out) == "MBOX")
+out:reserve(1024):append(Buffer.of("!"))
+assert(tostring(out) == "MBOX!" and out:find("!") == 4)
+assert(not pcall(Buffer.new(4).append, Buffer.new(4), "x"))
+do
+	local grown = Buffer.builder(16):append("view")
+	local head, words = grown:view(1, 2), grown:as("uint16")
+	grown:append(head)
+	assert(not pcall(grown.reserve, grown, 1024))
+	assert(tostring(head) == "ie" and #words == 2)
+	head, words = nil, nil
+	grown:reserve(1024)
+	assert(tostring(grown) == "viewie")
+end
+
+assert(#Buffer.of("a\0b") == 3)
+local path = os.tmpname()
+local file = io.open(path, "wb")
+file:write("map\0me")
+file:close()
+local mapped = assert(Buffer.map(path))
+assert(#mapped == 6 and mapped:readUint8(3) == 0 and mapped:find("me") == 4)
+mapped:writeUint8(0, 0x4d) -- private, does not change the file
+local shared = assert(Buffer.map(path, "rw"))
+assert(shared:readUint8(0) == 0x6d)
+shared:set(4, "ME")
+assert(tostring(shared:view(3, 2)) == "\0M")
+assert(shared:sync() and shared:advise("sequential"))
+file = io.open(path, "rb")
+assert(file:read("a") == "map\0ME")
+file:close()
+assert(Buffer.map(path .. ".missing") == nil)
+os.remove(path)
+
+local Point = Buffer.schema{ {"id", "u16le"}, {"x", "f32"}, {"dy", "i8"}, {"tag", "bytes", 3} }
+assert(#Point == 10)
+local records = Buffer.new(30):fill(0)
+Point:write(records, 0, {id = 513, x = 1.5, dy = -2, tag = "ab"})
+Point:write(records, 10, {id = 7, x = -4, dy = 127, tag = "xyz"})
+assert(records:readUint16(0, true) == 513 and records:readInt8(6) == -2)
+local p = Point:read(records, 0)
+assert(p.id == 513 and p.x == 1.5 and p.dy == -2 and p.tag == "ab\0")
+local all = Point:readMany(records)
+assert(#all == 3 and all[2].x == -4 and all[2].tag == "xyz" and all[3].id == 0)
+assert(#Point:readMany(records, 10, nil, 20) == 1)
+assert(not pcall(Point.read, Point, records, 25))
+assert(not pcall(Point.write, Point, records, 0, {id = 1, x = "no", dy = 0, tag = ""}))
+assert(not pcall(Buffer.schema, {{"a", "u12"}}))
+
+assert(Buffer.crc32c("123456789") == 0xe3069283)
+assert(Buffer.of("123456789"):crc32c() == 0xe3069283)
+assert(Buffer.crc32c("456789", Buffer.crc32c("123")) == 0xe3069283)
+assert(Buffer.xxh64("") == 0xef46db3751d8e999)
+assert(Buffer.xxh64("abc") == 0x44bc2cf5ad770999)
+local long = string.rep("MoonBox", 100)
+local hasher = Buffer.hasher("xxh64", 7)
+for i = 1, #long, 13 do hasher:update(long:sub(i, i+12)) end
+assert(hasher:digest() == Buffer.xxh64(long, 7))
+assert(Buffer.hasher("crc32c"):update("1234"):update(Buffer.of("56789")):digest() == 0xe3069283)
+
+assert(Buffer.xxh32("") == 0x02cc5d05)
+assert(Buffer.xxh32("abc") == 0x32d153ff)
+
+local text = string.rep("MoonBox compresses Buffers. ", 200)
+local block = Buffer.compress(text)
+assert(#block < #text)
+assert(block:decompress(#text):compare(text) == 0)
+assert(Buffer.decompress("\x50garbage", 100) == nil)
+assert(Buffer.compressFrame(""):compare("\x04\x22\x4d\x18\x64\x40\xa7\0\0\0\0\x05\x5d\xcc\x02") == 0)
+local frame = Buffer.compressFrame(text)
+assert(Buffer.decompressFrame(frame):compare(text) == 0)
+assert(Buffer.decompressFrame(frame:view(0, #frame-2)) == nil)
+local into = Buffer.builder():append(text)
+assert(not pcall(Buffer.compress, into:view(0, 100), into))
+local compressor, packed = Buffer.compressor(), Buffer.builder()
+for i = 1, #text, 1000 do compressor:update(text:sub(i, i+999), packed) end
+compressor:finish(packed)
+local decompressor, unpacked = Buffer.decompressor(), Buffer.builder()
+for i = 0, #packed-1, 7 do
+	local chunk = {}
+	for j = i, math.min(i+6, #packed-1) do chunk[#chunk+1] = string.char(packed:readUint8(j)) end
+	assert(decompressor:update(table.concat(chunk), unpacked))
+end
+assert(decompressor:finish())
+assert(unpacked:compare(text) == 0)
+
+assert(Buffer.toBase64("MoonBox!") == "TW9vbkJveCE=")
+assert(Buffer.toBase64("\xfb\xff", "-_", false) == "-_8")
+assert(tostring(Buffer.fromBase64("TW9vbkJveCE")) == "MoonBox!")
+assert(tostring(Buffer.fromBase64("TW9vbkJv\r\neCE=")) == "MoonBox!")
+assert(Buffer.fromBase64("TW9v*kJveCE=") == nil)
+assert(Buffer.fromBase64("TW9vbkJveCE", nil, nil, true, true) == nil)
+assert(tostring(Buffer.fromBase64("-_8", "-_")) == "\xfb\xff")
+assert(Buffer.of("\x01\xab"):toHex() == "01ab")
+assert(Buffer.toHex("\x01\xab", true) == "01AB")
+assert(tostring(Buffer.fromHex("01aB")) == "\x01\xab")
+assert(Buffer.fromHex("01a") == nil)
+local binary = string.rep("\0\1\2\253\254\255", 100)
+assert(tostring(Buffer.fromBase64(Buffer.toBase64(binary))) == binary)
+assert(tostring(Buffer.fromHex(Buffer.toHex(binary))) == binary)
+
+local bits = Buffer.bitWriter()
+bits:write(3, 5):write(13, 1000):writeUE(7, 0):writeSE(-3, 4):writeVarint(300):write(8, -2)
+local bitBytes = bits:flush()
+assert(bitBytes:readUint16(0) == 0xa3e8)
+local reader = bitBytes:bitReader()
+assert(reader:peek(3) == 5)
+assert(select("#", reader:read(3, 0)) == 0)
+local a, b, ue1, ue2, se1, se2, varint, signed = reader:readFields{3, 13, "ue", "ue", "se", "se", "varint", -8}
+assert(a == 5 and b == 1000 and ue1 == 7 and ue2 == 0 and se1 == -3 and se2 == 4 and varint == 300 and signed == -2)
+assert(not pcall(bits.writeUE, Buffer.bitWriter(), 1 << 40) and not pcall(bits.writeSE, Buffer.bitWriter(), math.mininteger))
+assert(reader:remaining() < 8)
+local lsb = Buffer.bitWriter(nil, true):write(3, 5):write(5, 1):write(64, -1):flush()
+assert(lsb:readUint8(0) == 0x0d)
+local lsbReader = Buffer.bitReader(tostring(lsb), true)
+assert(select(2, lsbReader:readFields{3, 5}) == 1 and lsbReader:readSigned(64) == -1)
+assert(not pcall(lsbReader.read, lsbReader, 1))
+
+local byte = Value.new(1)
+assert(byte:set(255) == nil and (byte + 1):get() == 0 and byte:get() == 255)
+assert(byte:add(2):get() == 1 and byte:shl(7):get() == 128 and byte:shl(1):get() == 0)
+local short = Value.new(2, true)
+short:set(-7)
+assert((short // 2):get() == -4 and (short % 2):get() == 1 and (-short):get() == 7)
+assert(short:mul(0x2000):get() == 0x2000 and (short >> 13):get() == 1)
+local word = Value.new(4, true)
+word:set(-1)
+assert(word:get() == -1 and (word >> 1):get() == 0x7fffffff and (~word):get() == 0)
+assert(not pcall(word.idiv, word, 0))
+
+local wide = Buffer.array("uint8", {1, 2, 255}):convert("uint32")
+assert(wide:type() == "uint32" and wide[2] == 255)
+wide[0] = 0x1ff
+assert(table.concat(wide:convert("uint8"):totable(), ",") == "255,2,255")
+local pcm = Buffer.of("\x80\x00\x40\x00"):as("int16"):convert("float32", 1/32768, true)
+assert(pcm[0] == -1 and pcm[1] == 0.5)
+assert(table.concat(Buffer.array("float64", {2.9, -2.9, 1e300}):convert("int16"):totable(), ",") == "2,-2,0")
+local swapped = Buffer.of("\1\2\3\4\5\6\7\8\9"):byteswap(4)
+assert(tostring(swapped) == "\4\3\2\1\8\7\6\5\9")
+assert(tostring(swapped:byteswap(2, 2, 4)) == "\4\3\1\2\7\8\6\5\9")
+assert(not pcall(swapped.byteswap, swapped, 2, 0, 3))
+local halves = Buffer.array("uint16", {0x0102, 0x0304})
+assert(halves:byteswap()[0] == 0x0201 and halves[1] == 0x0403)
+
+local keys = Buffer.array("int16", {5, -3, 5, 0, -3})
+local ids = Buffer.array("uint8", {1, 2, 3, 4, 5})
+assert(keys:sort(ids) == keys)
+assert(table.concat(keys:totable(), ",") == "-3,-3,0,5,5" and table.concat(ids:totable(), ",") == "2,5,4,1,3")
+assert(keys:lowerBound(5) == 3 and keys:upperBound(5) == 5 and keys:lowerBound(-10) == 0 and keys:lowerBound(0.5) == 3)
+assert(keys:binarySearch(0) == 2 and keys:binarySearch(1) == nil)
+local reals = Buffer.array("float32", {2.5, -1, 0.25, -8})
+assert(table.concat(reals:argsort():totable(), ",") == "3,1,2,0" and reals[0] == 2.5)
+assert(reals:binarySearch(0/0) == nil and keys:binarySearch(0/0) == nil and not pcall(keys.sort, keys, keys))
+local records = Buffer.new(16)
+records:as("int32", 0, nil, 8):set({7, 3})
+records:as("uint32", 4, nil, 8):set({70, 30})
+records:as("int32", 0, nil, 8):sort(records:as("uint32", 4, nil, 8))
+assert(table.concat(records:as("uint32"):totable(), ",") == "3,30,7,70")
+assert(table.concat(reals:sort():totable(), ",") == "-8.0,-1.0,0.25,2.5")
+local big = Buffer.array("uint64", {-1, 2, 1})
+assert(big:sort()[2] == -1 and big:lowerBound(3) == 2 and big:binarySearch(-5) == nil)
+
+local ring = Buffer.ring(6)
+assert(ring:capacity() == 8 and ring:space() == 8 and #ring == 0)
+assert(ring:write("abcdef") == 6 and ring:write("ghi") == 0 and ring:write("ghi", true) == 2)
+assert(ring:peek(3) == "abc" and ring:read(3) == "abc" and ring:skip(1) == 1 and #ring == 4)
+assert(ring:write(Buffer.of("xyz")) == 3)
+local first, second = ring:readable()
+assert(tostring(first) == "efgh" and tostring(second) == "xyz")
+local drained = Buffer.builder()
+assert(ring:read(nil, drained) == 7 and tostring(drained) == "efghxyz" and ring:read() == "")
+local free = ring:writable()
+free:set(0, "12")
+ring:commit(2)
+assert(ring:read() == "12" and not pcall(ring.commit, ring, 9))
+local log = Buffer.ring(8, true)
+log:write("abc")
+assert(log:write("defghijk") == 8 and log:read() == "defghijk")
+
+local text = Buffer.text("hello\nworld")
+assert(text:insert(5, ", there") == text and tostring(text) == "hello, there\nworld" and #text == 18)
+assert(text:lines() == 2 and text:line(0) == "hello, there" and text:line(1) == "world" and text:line(2) == nil)
+assert(text:lineStart(1) == 13 and text:lineStart(2) == nil and text:lineAt(12) == 0 and text:lineAt(13) == 1)
+text:remove(0, 7)
+assert(text:sub() == "there\nworld" and text:sub(6) == "world" and tostring(text:slice(0, 5)) == "there")
+local joined = {}
+for piece in text:pieces(2, 6) do joined[#joined + 1] = tostring(piece) end
+assert(table.concat(joined) == "ere\nwo")
+local unicode = Buffer.text("a\xc3\xa9\xe2\x82\xac\nb")
+assert(unicode:move(0, 2) == 3 and unicode:move(3, 1) == 6 and unicode:move(6, -2) == 1 and unicode:move(0, 100) == 8)
+assert(unicode:column(6) == 3 and unicode:column(8) == 1)
+assert(not pcall(unicode.insert, unicode, 9, "x"))
+
+local digits = Buffer.of("0123456789")
+local blocks = os.tmpname()
+local out = assert(io.open(blocks, "wb"))
+assert(out:writeFrom(digits, 2, 5) == 5 and out:writeFrom(digits) == 10)
+out:close()
+local inp = assert(io.open(blocks, "rb"))
+local block = Buffer.new(8)
+assert(inp:readInto(block) == 8 and tostring(block) == "23456012")
+assert(inp:readInto(block, 2, 3) == 3 and tostring(block) == "23345012")
+assert(inp:readInto(block) == 4 and tostring(block) == "67895012" and inp:readInto(block) == 0)
+assert(not pcall(inp.readInto, inp, block, 6, 3))
+inp:close()
+assert(not pcall(inp.readInto, inp, block))
+os.remove(blocks)
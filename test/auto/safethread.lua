@@ -64,3 +64,39 @@ do
 	assert(a == 10)
 	assert(b == 20)
 end
+
+do
+	-- Stats
+	local t = Thread()
+	t:pcall(function(s) return #s end, string.rep("x", 1000))
+	local stats = t:stats()
+	assert(stats.jobs == 1)
+	assert(stats.bytes >= 1000)
+	assert(stats.busy >= 0 and stats.copy > 0)
+	assert(stats.waiting == 0)
+	local found = false
+	for _, s in ipairs(Thread.stats().threads) do
+		if s.id == stats.id then found = true end
+	end
+	assert(found)
+	t:wait()
+end
+
+do
+	-- Actors
+	local shared = require "shared"
+	Thread.spawn("test.sum", function(n)
+		sum = (sum or 0) + n
+		require("shared").set("test.sum", sum)
+	end)
+	assert(not pcall(Thread.spawn, "test.sum", function() end))
+	for i = 1, 100 do assert(Thread.send("test.sum", i)) end
+	assert(Thread.stop("test.sum"))
+	assert(not Thread.send("test.sum", 1))
+	local start = os.clock()
+	while shared.get("test.sum") ~= 5050 and os.clock() - start < 5 do
+		Thread.sleep(0.001)
+	end
+	assert(shared.get("test.sum") == 5050)
+	shared.set("test.sum", nil)
+end
@@ -0,0 +1,39 @@
+local shared = require "shared"
+local Thread = require "safethread"
+
+shared.set("answer", 42)
+assert(shared.get("answer") == 42)
+assert(shared.get("nothing") == nil)
+
+shared.set("t", {1, 2, x = "y", nested = {true}})
+local t = shared.get("t")
+assert(t[1] == 1 and t[2] == 2 and t.x == "y" and t.nested[1] == true)
+
+assert(shared.cas("answer", 42, 43))
+assert(not shared.cas("answer", 42, 44))
+assert(shared.get("answer") == 43)
+assert(shared.cas("new", nil, "created"))
+assert(not shared.cas("new", nil, "again"))
+assert(shared.cas("t", shared.get("t"), {x = "y", 1, nested = {true}, 2}))
+assert(shared.cas("t", {a = 1, b = 2, c = 3, d = 4}, nil) == false)
+shared.set("new", nil)
+assert(shared.get("new") == nil)
+
+assert(shared.increment("counter") == 1)
+assert(shared.increment("counter", 10) == 11)
+assert(shared.increment("counter", 0.5) == 11.5)
+
+do
+	-- Access from other threads
+	shared.set("counter", 0)
+	local threads = {}
+	for i = 1, 4 do
+		threads[i] = Thread()
+		threads[i]:async(function()
+			local shared = require "shared"
+			for _ = 1, 1000 do shared.increment("counter") end
+		end)()
+	end
+	for i = 1, 4 do threads[i]:wait() end
+	assert(shared.get("counter") == 4000)
+end
@@ -0,0 +1,26 @@
+local taskgraph = require "taskgraph"
+
+local graph = taskgraph.new(2)
+graph:add("a", function() return 1 end)
+graph:add("b", function() return 2 end)
+graph:add("sum", function(a, b) return a + b end, {"a", "b"})
+graph:add("double", function(x)
+	-- Take long enough to be on the critical path
+	local clock = require("safethread").time
+	local start = clock()
+	while clock() - start < 0.05 do end
+	return x * 2, "extra"
+end, {"sum"})
+graph:add("fail", function() error("oops") end)
+graph:add("after", function() return true end, {"fail"})
+
+local report = graph:run()
+assert(graph:result("sum") == 3)
+assert(select(2, graph:result("double")) == "extra")
+assert(report.failed.fail)
+assert(report.skipped.after == "fail")
+assert(report.criticalPath[#report.criticalPath] == "double")
+assert(report.criticalTime >= 0.05 and report.total >= report.criticalTime)
+assert(report.jobs.double.start >= report.jobs.sum.finish)
+graph:close()
+assert(graph:result("sum") == nil)
@@ -0,0 +1,52 @@
+-- Compare the Buffer byte methods with the same operations written as a
+-- per-byte Lua loop over __index/__newindex, which read bytes as Values
+local Buffer = require "Buffer"
+
+local size = 1 << 20
+local a = Buffer.new(size)
+local b = Buffer.new(size)
+for i = 0, size-1, 4096 do a:writeUint32(i, i) end
+b:copyFrom(a)
+
+local function bench(name, loop, native)
+	local start = os.clock()
+	loop()
+	local loopTime = os.clock() - start
+	start = os.clock()
+	for _ = 1, 100 do native() end
+	local nativeTime = (os.clock() - start) / 100
+	print(string.format("%-10s loop %8.3f ms  native %8.3f ms  (%.0fx)",
+		name, loopTime*1000, nativeTime*1000, loopTime / nativeTime))
+end
+
+print("Buffer byte kernels: "..Buffer.simd..", "..size.." bytes")
+
+bench("fill",
+	function() for i = 0, size-1 do b[i] = 0 end end,
+	function() b:fill(0) end)
+
+bench("copyFrom",
+	function() for i = 0, size-1 do b[i] = a[i] end end,
+	function() b:copyFrom(a) end)
+
+bench("compare",
+	function() for i = 0, size-1 do if a[i] ~= b[i] then break end end end,
+	function() a:compare(b) end)
+
+bench("find",
+	function() for i = 0, size-1 do if a[i]:get() == 0xff then break end end end,
+	function() a:find(0xff) end)
+
+bench("xor",
+	function() for i = 0, size-1 do b[i] = b[i] ~ a[i] end end,
+	function() b:xor(a) end)
+
+bench("popcount",
+	function()
+		local n = 0
+		for i = 0, size-1 do
+			local x = a[i]:get()
+			while x ~= 0 do n = n + (x & 1); x = x >> 1 end
+		end
+	end,
+	function() a:popcount() end)
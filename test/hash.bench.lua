@@ -0,0 +1,39 @@
+-- Compare the native checksums with a CRC-32C written in Lua over the
+-- bytes of a Buffer
+local Buffer = require "Buffer"
+
+local size = 1 << 20
+local data = Buffer.new(size)
+for i = 0, size-1, 8 do data:writeUint64(i, i * 0x9e3779b97f4a7c15) end
+
+local function lua_crc32c(buffer)
+	local crc = 0xffffffff
+	for i = 0, #buffer-1 do
+		crc = crc ~ buffer:readUint8(i)
+		for _ = 1, 8 do
+			crc = (crc >> 1) ~ (0x82f63b78 & -(crc & 1))
+		end
+	end
+	return crc ~ 0xffffffff
+end
+
+local function bench(name, fn, runs)
+	local start = os.clock()
+	local result
+	for _ = 1, runs do result = fn() end
+	local time = (os.clock() - start) / runs
+	print(string.format("%-12s %10.3f ms  %8.1f MB/s  %016x",
+		name, time*1000, size / time / 1e6, result))
+	return result
+end
+
+print("Hashing "..size.." bytes")
+local expected = bench("crc32c lua", function() return lua_crc32c(data) end, 1)
+assert(bench("crc32c", function() return data:crc32c() end, 100) == expected)
+local digest = bench("xxh64", function() return data:xxh64() end, 100)
+local hasher = Buffer.hasher("xxh64")
+assert(bench("xxh64 stream", function()
+	hasher:reset()
+	for i = 0, size-1, 4096 do hasher:update(data:view(i, 4096)) end
+	return hasher:digest()
+end, 100) == digest)
@@ -0,0 +1,29 @@
+-- Measure LZ4 compression of text-like data, in blocks, frames and parts
+local Buffer = require "Buffer"
+
+local words = {"the ", "quick ", "brown ", "fox ", "jumps ", "over ", "lazy ", "dog ", "\n"}
+local parts = {}
+for i = 1, 1 << 18 do parts[i] = words[math.random(#words)] end
+local text = Buffer.of(table.concat(parts))
+local size = #text
+
+local function bench(name, fn, runs)
+	local start = os.clock()
+	local result
+	for _ = 1, runs do result = fn() end
+	local time = (os.clock() - start) / runs
+	print(string.format("%-18s %10.3f ms  %8.1f MB/s", name, time*1000, size / time / 1e6))
+	return result
+end
+
+print("Compressing "..size.." bytes")
+local frame = bench("compressFrame", function() return text:compressFrame() end, 20)
+print(string.format("ratio %.3f", #frame / size))
+local result = bench("decompressFrame", function() return frame:decompressFrame() end, 20)
+assert(result:compare(text) == 0)
+local stream = bench("compressor 4KiB", function()
+	local compressor, out = Buffer.compressor(), Buffer.builder(size)
+	for i = 0, size-1, 4096 do compressor:update(text:view(i, math.min(4096, size-i)), out) end
+	return compressor:finish(out)
+end, 20)
+assert(stream:decompressFrame():compare(text) == 0)
@@ -0,0 +1,24 @@
+-- Compare TypedArray:sort and argsort with table.sort on the same numbers
+local Buffer = require "Buffer"
+
+local n = 1000000
+local numbers = {}
+for i = 1, n do numbers[i] = math.random() * 1000 - 500 end
+local array = Buffer.array("float64", numbers)
+
+local start = os.clock()
+table.sort(numbers)
+local tableTime = os.clock() - start
+
+start = os.clock()
+local order = array:argsort()
+local argsortTime = os.clock() - start
+
+start = os.clock()
+array:sort()
+local sortTime = os.clock() - start
+
+assert(array[0] == numbers[1] and array[n-1] == numbers[n])
+assert(array[0] == array:totable()[1] and order:length() == n)
+print(string.format("%d float64: table.sort %.3f s, sort %.3f s (%.0fx), argsort %.3f s",
+	n, tableTime, sortTime, tableTime / sortTime, argsortTime))
@@ -1,3 +1,5 @@
 local sys = require "sys"
 
-print("CPU: "..sys.cores.." core", "RAM: "..sys.ram.." MB", "OS: "..sys.os)
\ No newline at end of file
+print("CPU: "..sys.cores.." core", "RAM: "..sys.ram.." MB", "OS: "..sys.os)
+local memory = sys.memory()
+print("Memory: "..memory.live.." bytes live, "..memory.peak.." bytes peak")
@@ -8,6 +8,8 @@ print("Automatic tests")
 test("auto/buffer.lua")
 test("auto/require.lua")
 test("auto/safethread.lua")
+test("auto/shared.lua")
+test("auto/taskgraph.lua")
 
 print("Manual tests")
 test("hello.lua")